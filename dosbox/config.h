@@ -35,6 +35,12 @@
 /* Determines if the compilers supports fastcall attribute. */
 /* #undef C_ATTRIBUTE_FASTCALL */
 
+/* Define to 1 to build the micro benchmarks run with -bench, they're left out
+   of the iOS app */
+#if !defined(IPHONEOS)
+#define C_BENCHMARKS 1
+#endif
+
 /* Define to 1 to use inlined memory functions in cpu core */
 /* #undef C_CORE_INLINE */
 
@@ -50,7 +56,7 @@
 
 /* Define to 1 to use recompiling cpu core. Can not be used together with the
    dynamic-x86 core */
-#ifndef __LP64__
+#if !defined(__LP64__) || defined(__aarch64__)
 #define C_DYNREC 1
 #endif
 
@@ -92,7 +98,9 @@
 /* #undef C_SSHOT */
 
 /* The type of cpu this target has */
-#if TARGET_IPHONE_SIMULATOR
+#if defined(__aarch64__)
+#define C_TARGETCPU ARMV8LE
+#elif TARGET_IPHONE_SIMULATOR
 #define C_TARGETCPU X86
 #else
 #if TARGET_CPU_ARM
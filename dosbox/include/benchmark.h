@@ -0,0 +1,91 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_BENCHMARK_H
+#define DOSBOX_BENCHMARK_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+/*
+	Headless benchmarking and input replay.
+
+	-benchmark <seconds> runs the configured machine for that many emulated
+	seconds with the dummy SDL video and audio drivers and without real time
+	throttling, then prints the emulated cycles, rendered frames and mixed
+	audio samples together with the host time spent in each subsystem.
+
+	-record <file> writes all keyboard and mouse input to a script, stamped
+	with the emulated milliseconds since startup. -replay <file> feeds such a
+	script back at the same emulated times, so a benchmark run always sees
+	the same input.
+*/
+
+enum BenchTimer {
+	BENCH_TIMER_TICK,		/* timer tick handlers, includes the mixer */
+	BENCH_TIMER_MIXER,
+	BENCH_TIMER_RENDER,		/* vga line drawing and scaling */
+	BENCH_TIMER_EVENTS,		/* host event handling */
+	BENCH_TIMER_MAX
+};
+
+enum BenchCounter {
+	BENCH_COUNT_CYCLES,		/* cycles the ticks used, including the idle ones */
+	BENCH_COUNT_IDLE,		/* cycles skipped while the guest idles or halts */
+	BENCH_COUNT_FRAMES,
+	BENCH_COUNT_SAMPLES,
+	BENCH_COUNT_INPUT,
+	BENCH_COUNT_MAX
+};
+
+extern bool BENCH_Active;
+extern bool BENCH_Recording;
+extern Bit64u BENCH_Counts[BENCH_COUNT_MAX];
+extern Bit64u BENCH_Times[BENCH_TIMER_MAX];
+
+/* Host time in microseconds */
+Bit64u BENCH_Time(void);
+
+static INLINE Bit64u BENCH_Begin(void) {
+	return GCC_UNLIKELY(BENCH_Active) ? BENCH_Time() : 0;
+}
+static INLINE void BENCH_End(BenchTimer timer,Bit64u start) {
+	if (GCC_UNLIKELY(BENCH_Active)) BENCH_Times[timer]+=BENCH_Time()-start;
+}
+static INLINE void BENCH_Count(BenchCounter counter,Bitu amount) {
+	if (GCC_UNLIKELY(BENCH_Active)) BENCH_Counts[counter]+=amount;
+}
+
+/* Input recording, only called while BENCH_Recording is set */
+void BENCH_RecordKey(Bitu key,bool pressed);
+void BENCH_RecordMouseMove(float xrel,float yrel,float x,float y,bool emulate);
+void BENCH_RecordMouseButton(Bit8u button,bool pressed);
+
+/* True when the command line asks for a headless run, checked before SDL starts */
+bool BENCH_Headless(void);
+/* Called in copies started by CLONE, stdout goes to clone<index>.txt and the
+   input script to <script>.<index> */
+void BENCH_Clone(Bitu index);
+
+#if C_BENCHMARKS
+/* Runs the micro benchmark given with -bench <name>, false without -bench */
+bool BENCH_RunMicro(void);
+#endif
+
+#endif
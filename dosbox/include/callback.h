@@ -56,6 +56,7 @@ static INLINE PhysPt CALLBACK_GetBase(void) {
 }
 
 Bitu CALLBACK_Allocate();
+void CALLBACK_DeAllocate(Bitu in);
 
 void CALLBACK_Idle(void);
 
@@ -80,6 +80,26 @@ Bits CPU_Core_Dynrec_Trap_Run(void);
 Bits CPU_Core_Prefetch_Run(void);
 Bits CPU_Core_Prefetch_Trap_Run(void);
 
+/* Code cache counters of the recompiling core */
+struct CPU_DynrecCacheStats {
+	Bit32u blocks_compiled;		// blocks translated
+	Bit32u blocks_invalidated;	// blocks cleared by writes to their code
+	Bit32u blocks_evicted;		// blocks overwritten to make room
+	Bit32u pages_evicted;		// code pages released to make room
+	Bit32u cache_wraps;			// times the code cache restarted at the beginning
+	Bit32u flushes;				// full flushes of the code cache
+	Bit32u link_hits;			// block links that found a translated target
+	Bit32u link_misses;			// block links whose target wasn't translated yet
+	Bit32u superblocks;			// blocks rebuilt along their hot exits
+	Bit32u indirect_misses;		// indirect jumps whose target wasn't cached
+	Bit32u flags_links;			// links that let a block skip its flags generation
+	Bitu blocks_total;
+	Bitu code_size;
+};
+void CPU_Core_Dynrec_Cache_Stats(CPU_DynrecCacheStats & stats);
+/* Run random programs on the recompiler and the normal core and compare them, for -checkdynrec */
+void CPU_Core_Dynrec_Check(void);
+
 void CPU_Enable_SkipAutoAdjust(void);
 void CPU_Disable_SkipAutoAdjust(void);
 void CPU_Reset_AutoAdjust(void);
@@ -127,6 +147,9 @@ void CPU_CALL(bool use32,Bitu selector,Bitu offset,Bitu oldeip);
 void CPU_RET(bool use32,Bitu bytes,Bitu oldeip);
 void CPU_IRET(bool use32,Bitu oldeip);
 void CPU_HLT(Bitu oldeip);
+/* The guest waits for an interrupt, end the current slice without the
+ * skipped cycles counting for the auto cycles adjustment */
+void CPU_Idle(void);
 
 bool CPU_POPF(Bitu use32);
 bool CPU_PUSHF(Bitu use32);
@@ -107,6 +107,8 @@ public:
 	}
 	void WriteControllerReg(Bitu reg,Bitu val,Bitu len);
 	Bitu ReadControllerReg(Bitu reg,Bitu len);
+	void SaveState(void);
+	void LoadState(void);
 };
 
 DmaChannel * GetDMAChannel(Bit8u chan);
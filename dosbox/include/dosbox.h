@@ -33,6 +33,8 @@ class Section;
 typedef Bitu (LoopHandler)(void);
 
 void DOSBOX_RunMachine();
+/* Number of nested DOSBOX_RunMachine calls currently on the stack */
+Bitu DOSBOX_RunDepth(void);
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
 
@@ -30,6 +30,10 @@
 
 typedef Bitu IO_ReadHandler(Bitu port,Bitu iolen);
 typedef void IO_WriteHandler(Bitu port,Bitu val,Bitu iolen);
+/* Returns the emulated time (in PIC_FullIndex units) at which a status port
+ * can next read a different value, or a negative value when it only changes
+ * through pic events or other port accesses */
+typedef double IO_PollHandler(Bitu port);
 
 extern IO_WriteHandler * io_writehandlers[3][IO_MAX];
 extern IO_ReadHandler * io_readhandlers[3][IO_MAX];
@@ -40,6 +44,11 @@ void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu
 void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range=1);
 void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range=1);
 
+/* Guests that keep reading the same value from a port with a poll handler
+ * get emulated time skipped ahead to the next possible change */
+void IO_RegisterPollHandler(Bitu port,IO_PollHandler * handler,Bitu range=1);
+void IO_FreePollHandler(Bitu port,Bitu range=1);
+
 void IO_WriteB(Bitu port,Bitu val);
 void IO_WriteW(Bitu port,Bitu val);
 void IO_WriteD(Bitu port,Bitu val);
@@ -67,6 +76,11 @@ public:
 	void Install(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu range=1);
 	~IO_WriteHandleObject();
 };
+class IO_PollHandleObject: private IO_Base{
+public:
+	void Install(Bitu port,IO_PollHandler * handler,Bitu range=1);
+	~IO_PollHandleObject();
+};
 
 static INLINE void IO_Write(Bitu port,Bit8u val) {
 	IO_WriteB(port,val);
@@ -32,6 +32,8 @@ typedef Bit32s MemHandle;
 #define MEM_PAGESIZE 4096
 
 extern HostPt MemBase;
+/* Pages written directly, they have to be part of the next incremental save state */
+extern Bit8u * MemDirty;
 HostPt GetMemBase(void);
 
 bool MEM_A20_Enabled(void);
@@ -129,12 +131,15 @@ void mem_writew(PhysPt pt,Bit16u val);
 void mem_writed(PhysPt pt,Bit32u val);
 
 static INLINE void phys_writeb(PhysPt addr,Bit8u val) {
+	MemDirty[addr/MEM_PAGESIZE]=1;
 	host_writeb(MemBase+addr,val);
 }
 static INLINE void phys_writew(PhysPt addr,Bit16u val){
+	MemDirty[addr/MEM_PAGESIZE]=1;
 	host_writew(MemBase+addr,val);
 }
 static INLINE void phys_writed(PhysPt addr,Bit32u val){
+	MemDirty[addr/MEM_PAGESIZE]=1;
 	host_writed(MemBase+addr,val);
 }
 
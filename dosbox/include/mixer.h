@@ -93,6 +93,12 @@ MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * nam
 MixerChannel * MIXER_FindChannel(const char * name);
 /* Find the device you want to delete with findchannel "delchan gets deleted" */
 void MIXER_DelChannel(MixerChannel* delchan); 
+/* Latency of the sound output in ms and how often the audio callback ran dry or the buffer overflowed */
+void MIXER_GetStats(Bitu & latency,Bitu & underruns,Bitu & overruns);
+#if C_BENCHMARKS
+/* Time mixing a set of typical channels, plain and with SIMD, for -bench mixer */
+void MIXER_BenchmarkMix(void);
+#endif
 
 /* Object to maintain a mixerchannel; As all objects it registers itself with create
  * and removes itself when destroyed. */
@@ -28,22 +28,24 @@
 #include "mem.h"
 #endif
 
-// disable this to reduce the size of the TLB
-// NOTE: does not work with the dynamic core (dynrec is fine)
+// The full TLB keeps flat arrays for all 1M pages (tens of MB), the dynamic
+// x86 core addresses those directly. Other builds use a two level TLB that
+// only allocates the banks that actually get linked.
+#if C_DYNAMIC_X86
 #define USE_FULL_TLB
+#endif
 
 class PageDirectory;
 
 #define MEM_PAGE_SIZE	(4096)
 #define XMS_START		(0x110)
 
-#if defined(USE_FULL_TLB)
 #define TLB_SIZE		(1024*1024)
-#else
-#define TLB_SIZE		65536	// This must a power of 2 and greater then LINK_START
-#define BANK_SHIFT		28
-#define BANK_MASK		0xffff // always the same as TLB_SIZE-1?
-#define TLB_BANKS		((1024*1024/TLB_SIZE)-1)
+#if !defined(USE_FULL_TLB)
+#define TLB_BANK_SHIFT	12		// 16 MB of linear space per bank
+#define TLB_BANK_SIZE	(1 << TLB_BANK_SHIFT)
+#define TLB_BANK_MASK	(TLB_BANK_SIZE-1)
+#define TLB_BANKS		(TLB_SIZE >> TLB_BANK_SHIFT)
 #endif
 
 #define PFLAG_READABLE		0x1
@@ -86,6 +88,9 @@ Bitu PAGING_GetDirBase(void);
 void PAGING_SetDirBase(Bitu cr3);
 void PAGING_InitTLB(void);
 void PAGING_ClearTLB(void);
+#if C_BENCHMARKS
+void PAGING_BenchmarkTLB(void);
+#endif
 
 void PAGING_LinkPage(Bitu lin_page,Bitu phys_page);
 void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page);
@@ -147,6 +152,7 @@ typedef struct {
 	PageHandler * readhandler;
 	PageHandler * writehandler;
 	Bit32u phys_page;
+	Bit32u gen;					// paging.tlbh_gen at the time the entry was set up
 } tlb_entry;
 #endif
 
@@ -166,8 +172,8 @@ struct PagingBlock {
 		Bit32u	phys_page[TLB_SIZE];
 	} tlb;
 #else
-	tlb_entry tlbh[TLB_SIZE];
 	tlb_entry *tlbh_banks[TLB_BANKS];
+	Bit32u tlbh_gen;			// bumped by every flush, older entries count as unlinked
 #endif
 	struct {
 		Bitu used;
@@ -195,6 +201,21 @@ bool mem_unalignedreadd_checked(PhysPt address,Bit32u * val);
 bool mem_unalignedwritew_checked(PhysPt address,Bit16u val);
 bool mem_unalignedwrited_checked(PhysPt address,Bit32u val);
 
+/* The page handler calls of the inlined accessors below, kept out of line
+   so the profiler can account for them */
+Bit8u PAGING_ReadB(PhysPt address);
+Bit16u PAGING_ReadW(PhysPt address);
+Bit32u PAGING_ReadD(PhysPt address);
+void PAGING_WriteB(PhysPt address,Bit8u val);
+void PAGING_WriteW(PhysPt address,Bit16u val);
+void PAGING_WriteD(PhysPt address,Bit32u val);
+bool PAGING_ReadB_Checked(PhysPt address,Bit8u * val);
+bool PAGING_ReadW_Checked(PhysPt address,Bit16u * val);
+bool PAGING_ReadD_Checked(PhysPt address,Bit32u * val);
+bool PAGING_WriteB_Checked(PhysPt address,Bit8u val);
+bool PAGING_WriteW_Checked(PhysPt address,Bit16u val);
+bool PAGING_WriteD_Checked(PhysPt address,Bit32u val);
+
 #if defined(USE_FULL_TLB)
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
@@ -221,17 +242,16 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 
 #else
 
-void PAGING_InitTLBBank(tlb_entry **bank);
+tlb_entry * PAGING_InitTLBBank(Bitu bank);
+void PAGING_ResetTLBEntry(tlb_entry * entry);
 
 static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
 	Bitu index=(address>>12);
-	if (TLB_BANKS && (index > TLB_SIZE)) {
-		Bitu bank=(address>>BANK_SHIFT) - 1;
-		if (!paging.tlbh_banks[bank])
-			PAGING_InitTLBBank(&paging.tlbh_banks[bank]);
-		return &paging.tlbh_banks[bank][index & BANK_MASK];
-	}
-	return &paging.tlbh[index];
+	tlb_entry * bank=paging.tlbh_banks[index >> TLB_BANK_SHIFT];
+	if (GCC_UNLIKELY(!bank)) bank=PAGING_InitTLBBank(index >> TLB_BANK_SHIFT);
+	tlb_entry * entry=&bank[index & TLB_BANK_MASK];
+	if (GCC_UNLIKELY(entry->gen!=paging.tlbh_gen)) PAGING_ResetTLBEntry(entry);
+	return entry;
 }
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
@@ -264,14 +284,14 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 static INLINE Bit8u mem_readb_inline(PhysPt address) {
 	HostPt tlb_addr=get_tlb_read(address);
 	if (tlb_addr) return host_readb(tlb_addr+address);
-	else return (Bit8u)(get_tlb_readhandler(address))->readb(address);
+	else return PAGING_ReadB(address);
 }
 
 static INLINE Bit16u mem_readw_inline(PhysPt address) {
 	if ((address & 0xfff)<0xfff) {
 		HostPt tlb_addr=get_tlb_read(address);
 		if (tlb_addr) return host_readw(tlb_addr+address);
-		else return (Bit16u)(get_tlb_readhandler(address))->readw(address);
+		else return PAGING_ReadW(address);
 	} else return mem_unalignedreadw(address);
 }
 
@@ -279,21 +299,21 @@ static INLINE Bit32u mem_readd_inline(PhysPt address) {
 	if ((address & 0xfff)<0xffd) {
 		HostPt tlb_addr=get_tlb_read(address);
 		if (tlb_addr) return host_readd(tlb_addr+address);
-		else return (get_tlb_readhandler(address))->readd(address);
+		else return PAGING_ReadD(address);
 	} else return mem_unalignedreadd(address);
 }
 
 static INLINE void mem_writeb_inline(PhysPt address,Bit8u val) {
 	HostPt tlb_addr=get_tlb_write(address);
 	if (tlb_addr) host_writeb(tlb_addr+address,val);
-	else (get_tlb_writehandler(address))->writeb(address,val);
+	else PAGING_WriteB(address,val);
 }
 
 static INLINE void mem_writew_inline(PhysPt address,Bit16u val) {
 	if ((address & 0xfff)<0xfff) {
 		HostPt tlb_addr=get_tlb_write(address);
 		if (tlb_addr) host_writew(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writew(address,val);
+		else PAGING_WriteW(address,val);
 	} else mem_unalignedwritew(address,val);
 }
 
@@ -301,7 +321,7 @@ static INLINE void mem_writed_inline(PhysPt address,Bit32u val) {
 	if ((address & 0xfff)<0xffd) {
 		HostPt tlb_addr=get_tlb_write(address);
 		if (tlb_addr) host_writed(tlb_addr+address,val);
-		else (get_tlb_writehandler(address))->writed(address,val);
+		else PAGING_WriteD(address,val);
 	} else mem_unalignedwrited(address,val);
 }
 
@@ -311,7 +331,7 @@ static INLINE bool mem_readb_checked(PhysPt address, Bit8u * val) {
 	if (tlb_addr) {
 		*val=host_readb(tlb_addr+address);
 		return false;
-	} else return (get_tlb_readhandler(address))->readb_checked(address, val);
+	} else return PAGING_ReadB_Checked(address,val);
 }
 
 static INLINE bool mem_readw_checked(PhysPt address, Bit16u * val) {
@@ -320,7 +340,7 @@ static INLINE bool mem_readw_checked(PhysPt address, Bit16u * val) {
 		if (tlb_addr) {
 			*val=host_readw(tlb_addr+address);
 			return false;
-		} else return (get_tlb_readhandler(address))->readw_checked(address, val);
+		} else return PAGING_ReadW_Checked(address,val);
 	} else return mem_unalignedreadw_checked(address, val);
 }
 
@@ -330,7 +350,7 @@ static INLINE bool mem_readd_checked(PhysPt address, Bit32u * val) {
 		if (tlb_addr) {
 			*val=host_readd(tlb_addr+address);
 			return false;
-		} else return (get_tlb_readhandler(address))->readd_checked(address, val);
+		} else return PAGING_ReadD_Checked(address,val);
 	} else return mem_unalignedreadd_checked(address, val);
 }
 
@@ -339,7 +359,7 @@ static INLINE bool mem_writeb_checked(PhysPt address,Bit8u val) {
 	if (tlb_addr) {
 		host_writeb(tlb_addr+address,val);
 		return false;
-	} else return (get_tlb_writehandler(address))->writeb_checked(address,val);
+	} else return PAGING_WriteB_Checked(address,val);
 }
 
 static INLINE bool mem_writew_checked(PhysPt address,Bit16u val) {
@@ -348,7 +368,7 @@ static INLINE bool mem_writew_checked(PhysPt address,Bit16u val) {
 		if (tlb_addr) {
 			host_writew(tlb_addr+address,val);
 			return false;
-		} else return (get_tlb_writehandler(address))->writew_checked(address,val);
+		} else return PAGING_WriteW_Checked(address,val);
 	} else return mem_unalignedwritew_checked(address,val);
 }
 
@@ -358,7 +378,7 @@ static INLINE bool mem_writed_checked(PhysPt address,Bit32u val) {
 		if (tlb_addr) {
 			host_writed(tlb_addr+address,val);
 			return false;
-		} else return (get_tlb_writehandler(address))->writed_checked(address,val);
+		} else return PAGING_WriteD_Checked(address,val);
 	} else return mem_unalignedwrited_checked(address,val);
 }
 
@@ -64,4 +64,7 @@ void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val);
 
 void PIC_SetIRQMask(Bitu irq, bool masked);
+#if C_BENCHMARKS
+void PIC_BenchmarkQueue(void);
+#endif
 #endif
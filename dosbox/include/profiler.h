@@ -0,0 +1,70 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_PROFILER_H
+#define DOSBOX_PROFILER_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+/*
+	Sampling profiler.
+
+	The emulation thread marks the subsystem it is in with PROF_Enter and
+	PROF_Leave, which keep a small stack up to date even while the profiler
+	is off, so it's right when it gets started in the middle of a section. A
+	separate thread wakes up every millisecond and counts the current stack
+	and, while the cpu core runs, the guest CS:EIP. Stopping the profiler
+	writes a flat report and a folded stack file for flame graph tools to
+	the capture directory.
+*/
+
+enum ProfSection {
+	PROF_CPU,
+	PROF_PAGING,
+	PROF_IO,
+	PROF_PIC,
+	PROF_TIMER,
+	PROF_MIXER,
+	PROF_VGA,
+	PROF_SCALER,
+	PROF_EVENTS,
+	PROF_MAX
+};
+
+#define PROF_STACKSIZE 16
+
+extern volatile bool PROF_Active;
+extern volatile Bitu PROF_Depth;
+extern volatile Bit8u PROF_Stack[PROF_STACKSIZE];
+
+static INLINE void PROF_Enter(ProfSection section) {
+	Bitu depth=PROF_Depth;
+	if (depth<PROF_STACKSIZE) PROF_Stack[depth]=(Bit8u)section;
+	PROF_Depth=depth+1;
+}
+
+static INLINE void PROF_Leave(void) {
+	if (PROF_Depth) PROF_Depth--;
+}
+
+void PROF_Start(void);
+void PROF_Stop(void);
+
+#endif
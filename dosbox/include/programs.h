@@ -73,6 +73,7 @@ public:
 	std::string temp_line;
 	CommandLine * cmd;
 	DOS_PSP * psp;
+	Bit8u exitcode;						/* Becomes the errorlevel */
 	virtual void Run(void)=0;
 	bool GetEnvStr(const char * entry,std::string & result);
 	bool GetEnvNum(Bitu num,std::string & result);
@@ -29,7 +29,7 @@
 
 #define RENDER_SKIP_CACHE	16
 //Enable this for scalers to support 0 input for empty lines
-//#define RENDER_NULL_INPUT
+#define RENDER_NULL_INPUT
 
 typedef struct {
 	struct { 
@@ -70,6 +70,7 @@ typedef struct {
 		scalerOperation_t op;
 		bool clearCache;
 		bool forced;
+		bool simd;
 		ScalerLineHandler_t lineHandler;
 		ScalerLineHandler_t linePalHandler;
 		ScalerComplexHandler_t complexHandler;
@@ -85,6 +86,7 @@ typedef struct {
 	bool active;
 	bool aspect;
 	bool fullFrame;
+	bool nullInput;		/* unchanged lines may be passed as 0 this frame */
 } Render_t;
 
 extern Render_t render;
@@ -92,6 +94,11 @@ extern ScalerLineHandler_t RENDER_DrawLine;
 void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool dblw,bool dblh);
 bool RENDER_StartUpdate(void);
 void RENDER_EndUpdate(bool abort);
+void RENDER_Sync(void);
+bool RENDER_ThreadRunning(void);
+#if C_BENCHMARKS
+void RENDER_BenchmarkScalers(void);
+#endif
 void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue);
 
 
@@ -0,0 +1,86 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef DOSBOX_SAVESTATE_H
+#define DOSBOX_SAVESTATE_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+
+/*
+	Machine state snapshots.
+
+	Every module that keeps state in statics registers a save and a load
+	handler. Inside them the state is streamed with SAVESTATE_Write and read
+	back in exactly the same order with SAVESTATE_Read. Pointers to code
+	(event handlers, decoders) have to go through SAVESTATE_WriteCode so they
+	survive a relaunch of the same binary.
+
+	A state file is a chain of records. The first record is a full snapshot,
+	every incremental save appends a record that only holds the guest RAM
+	pages written since the previous one together with the complete device
+	state. Once a file holds 16 records the next save starts it over with a
+	full snapshot. Host side state like the shell, open host files and
+	mounted drives is not part of a snapshot, restore into a session booted
+	from the same configuration.
+*/
+
+typedef void (* SaveStateHandler)(void);
+
+/* chained handlers are loaded from every record in the file, the others only from the last one */
+void SAVESTATE_AddHandler(const char * name,SaveStateHandler save,SaveStateHandler load,bool chained=false);
+void SAVESTATE_RemoveHandler(const char * name);
+
+void SAVESTATE_Write(const void * data,Bitu size);
+void SAVESTATE_Read(void * data,Bitu size);
+void SAVESTATE_WriteCode(const void * code);
+void * SAVESTATE_ReadCode(void);
+/* True while the current save only has to contain the changes since the last one,
+   or while the record being loaded is such an incremental one */
+bool SAVESTATE_Incremental(void);
+
+/* 
+	Large buffers are compared in 4kb pages against hashes of the last save,
+	only the pages that changed go into an incremental save. Use them from
+	chained handlers, the hashes array needs one entry for every page.
+*/
+#define SAVESTATE_PAGESIZE 4096
+#define SAVESTATE_PAGES(_SIZE_) (((_SIZE_)+SAVESTATE_PAGESIZE-1)/SAVESTATE_PAGESIZE)
+void SAVESTATE_WritePages(const void * data,Bitu size,Bit64u * hashes);
+void SAVESTATE_ReadPages(void * data,Bitu size,Bit64u * hashes);
+
+template <class T> static INLINE void SAVESTATE_WriteVar(const T & var) {
+	SAVESTATE_Write(&var,sizeof(T));
+}
+template <class T> static INLINE void SAVESTATE_ReadVar(T & var) {
+	SAVESTATE_Read(&var,sizeof(T));
+}
+
+bool SAVESTATE_Save(const char * filename,bool incremental);
+bool SAVESTATE_Load(const char * filename);
+
+/* Requests can come from any thread, they are handled between two emulated ticks */
+void SAVESTATE_RequestSave(const char * filename);
+void SAVESTATE_RequestLoad(const char * filename);
+void SAVESTATE_Service(void);
+/* Copies started by CLONE save to <savestate>.<index> */
+void SAVESTATE_Clone(Bitu index);
+extern volatile bool SAVESTATE_Pending;
+
+#endif
@@ -25,10 +25,12 @@
 #include "dosbox.h"
 #endif
 
-//Don't enable keeping changes and mapping lfb probably...
+//With the lfb mapped the linear modes can't use the change map and compare their lines
 #define VGA_LFB_MAPPED
-//#define VGA_KEEP_CHANGES
+#define VGA_KEEP_CHANGES
 #define VGA_CHANGE_SHIFT	9
+/* Fastmem is twice the size of the video memory and the map covers it completely */
+#define VGA_CHANGE_MAPSIZE	(((vga.vmemsize << 1) >> VGA_CHANGE_SHIFT) + 32)
 
 class PageHandler;
 
@@ -363,12 +365,11 @@ typedef struct {
 
 typedef struct {
 	//Add a few more just to be safe
-	Bit8u*	map; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
+	Bit8u*	map; /* allocated dynamically: [((VGA_MEMORY*2) >> VGA_CHANGE_SHIFT) + 32] */
 	Bit8u	checkMask, frame, writeMask;
-	bool	active;
-	Bit32u  clearMask;
-	Bit32u	start, last;
-	Bit32u	lastAddress;
+	bool	active;		/* unchanged lines are skipped this frame */
+	bool	compare;	/* lines are compared with a copy instead of checking the map */
+	bool	redraw;		/* something the map doesn't cover changed, draw the next frame completely */
 } VGA_Changes;
 
 typedef struct {
@@ -423,6 +424,7 @@ void VGA_ChangedBank(void);
 /* Some DAC/Attribute functions */
 void VGA_DAC_CombineColor(Bit8u attr,Bit8u pal);
 void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue);
+void VGA_DAC_UpdateColorPalette(void);
 void VGA_ATTR_SetPalette(Bit8u index,Bit8u val);
 
 /* The VGA Subfunction startups */
@@ -435,6 +437,10 @@ void VGA_SetupGFX(void);
 void VGA_SetupSEQ(void);
 void VGA_SetupOther(void);
 void VGA_SetupXGA(void);
+void VGA_SetupTables(void);
+#if C_BENCHMARKS
+void VGA_BenchmarkPlanar(void);
+#endif
 
 /* Some Support Functions */
 void VGA_SetClock(Bitu which,Bitu target);
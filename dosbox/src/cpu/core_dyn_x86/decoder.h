@@ -497,7 +497,7 @@ static void dyn_read_intro(DynReg * addr,bool release_addr=true) {
 }
 
 bool mem_readb_checked_dcx86(PhysPt address) {
-	return get_tlb_readhandler(address)->readb_checked(address, (Bit8u*)(&core_dyn.readdata));
+	return PAGING_ReadB_Checked(address,(Bit8u*)(&core_dyn.readdata));
 }
 
 static void dyn_read_byte(DynReg * addr,DynReg * dst,Bitu high) {
@@ -583,7 +583,7 @@ bool mem_readd_checked_dcx86(PhysPt address) {
 			core_dyn.readdata=host_readd(tlb_addr+address);
 			return false;
 		} else {
-			return get_tlb_readhandler(address)->readd_checked(address, &core_dyn.readdata);
+			return PAGING_ReadD_Checked(address,&core_dyn.readdata);
 		}
 	} else return mem_unalignedreadd_checked(address, &core_dyn.readdata);
 }
@@ -2521,7 +2521,18 @@ restart_prefix:
 			dyn_jmp_far_imm();
 			goto finish_block;
 			/* Jmp Ibx */
-		case 0xeb:dyn_exit_link((Bit8s)decode_fetchb());goto finish_block;
+		case 0xeb:
+			{
+				Bit8s eip_change=(Bit8s)decode_fetchb();
+				/* jmp $ just waits for an interrupt */
+				if (eip_change==-2) {
+					gen_protectflags();
+					gen_releasereg(DREG(CYCLES));
+					gen_call_function((void*)&CPU_Idle,"");
+				}
+				dyn_exit_link(eip_change);
+			}
+			goto finish_block;
 		/* IN AL/AX,DX*/
 		case 0xec:
 			dyn_add_iocheck(1);
@@ -28,6 +28,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <vector>
 
 #if defined (WIN32)
 #include <windows.h>
@@ -61,6 +62,9 @@
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+#define DYN_TRACE_HOT	(1024)	// conditional exits before a block is rebuilt as superblock
+#define DYN_TRACE_LENGTH	(4)		// maximal number of branches followed by a superblock
+#define DYN_TRACE_GAP	(128)	// maximal forward jump followed by a superblock
 
 #if 0
 #define DYN_LOG	LOG_MSG
@@ -115,7 +119,8 @@ enum BlockReturn {
 #endif
 	BR_Iret,
 	BR_CallBack,
-	BR_SMCBlock
+	BR_SMCBlock,
+	BR_Indirect
 };
 
 // identificator to signal self-modification of the currently executed block
@@ -141,6 +146,7 @@ static struct {
 #define MIPSEL		0x03
 #define ARMV4LE		0x04
 #define POWERPC		0x04
+#define ARMV8LE		0x05
 
 #if C_TARGETCPU == X86_64
 #include "core_dynrec/risc_x64.h"
@@ -150,6 +156,8 @@ static struct {
 #include "core_dynrec/risc_mipsel32.h"
 #elif C_TARGETCPU == ARMV4LE
 #include "core_dynrec/risc_armv4le.h"
+#elif C_TARGETCPU == ARMV8LE
+#include "core_dynrec/risc_armv8le.h"
 #elif C_TARGETCPU == POWERPC
 #include "core_dynrec/risc_ppc.h"
 #endif
@@ -160,14 +168,23 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 	CacheBlockDynRec * block=NULL;
 	// the last instruction was a control flow modifying instruction
 	Bitu temp_ip=SegPhys(cs)+reg_eip;
+	cache_flagsclear();
 	CodePageHandlerDynRec * temp_handler=(CodePageHandlerDynRec *)get_tlb_readhandler(temp_ip);
 	if (temp_handler->flags & PFLAG_HASCODE) {
 		// see if the target is an already translated block
 		block=temp_handler->FindCacheBlock(temp_ip & 4095);
-		if (!block) return NULL;
+		if (!block) {
+			cache_stats.link_misses++;
+			return NULL;
+		}
+		cache_stats.link_hits++;
+		// a block that got cleared while running can't be linked anymore
+		if (!cache.block.running->page.handler) return block;
 
 		// found it, link the current block to 
 		cache.block.running->LinkTo(ret==BR_Link2,block);
+		if ((ret==BR_Link1) && cache.block.running->exit.flags_patch &&
+			block->exit.flags_dead && (block!=cache.block.running)) LinkFlags(cache.block.running);
 		return block;
 	}
 	return NULL;
@@ -186,7 +203,15 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 */
 
 Bits CPU_Core_Dynrec_Run(void) {
+	// block that left through an indirect jump whose target wasn't cached
+	CacheBlockDynRec * indirect=0;
 	for (;;) {
+		CacheBlockDynRec * indirect_block=indirect;
+		indirect=0;
+
+		// blocks that depend on cleared blocks must not be found anymore
+		cache_flagsclear();
+
 		// Determine the linear address of CS:EIP
 		PhysPt ip_point=SegPhys(cs)+reg_eip;
 		#if C_HEAVY_DEBUG
@@ -204,6 +229,9 @@ Bits CPU_Core_Dynrec_Run(void) {
 		// page doesn't contain code or is special
 		if (GCC_UNLIKELY(!chandler)) return CPU_Core_Normal_Run();
 
+		// keep the page list in least recently used order
+		if (cache_adaptive && (chandler!=cache.last_page)) chandler->Touch();
+
 		// find correct Dynamic Block to run
 		CacheBlockDynRec * block=chandler->FindCacheBlock(ip_point&4095);
 		if (!block) {
@@ -224,6 +252,17 @@ Bits CPU_Core_Dynrec_Run(void) {
 				CPU_CycleLeft+=old_cycles;
 				return nc_retcode; 
 			}
+		} else {
+			if (GCC_UNLIKELY(block->exit.count[0]+block->exit.count[1]>=DYN_TRACE_HOT)) {
+				// hot conditional exit, try to rebuild the block as superblock
+				block=CreateSuperBlock(chandler,ip_point,block);
+			} else if (indirect_block && indirect_block->page.handler) {
+				// cache the new target of the indirect jump
+				indirect_block->Unlink(0);
+				indirect_block->exit.target=(Bit32u)(-(Bit32s)ip_point);
+				indirect_block->LinkTo(0,block);
+				cache_stats.indirect_misses++;
+			}
 		}
 
 run_block:
@@ -255,6 +294,15 @@ run_block:
 #endif
 			break;
 
+		case BR_Indirect:
+			// near indirect jump to a target that is not the cached one,
+			// remember the block to cache the new target
+#if C_HEAVY_DEBUG
+			if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
+#endif
+			indirect=cache.block.running;
+			break;
+
 		case BR_Cycles:
 			// cycles went negative, return from the core to handle
 			// external events, schedule the pic...
@@ -327,8 +375,283 @@ void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	cache_init(enable_cache);
 }
 
+void CPU_Core_Dynrec_Cache_Configure(Bitu size,bool adaptive) {
+	cache_configure(size,adaptive);
+}
+
+void CPU_Core_Dynrec_Cache_Stats(CPU_DynrecCacheStats & stats) {
+	stats=cache_stats;
+}
+
 void CPU_Core_Dynrec_Cache_Close(void) {
 	cache_close();
 }
 
+void CPU_Core_Dynrec_Cache_Flush(void) {
+	cache_flush();
+}
+
+/*
+	Differential check against the normal core. Pseudo random real mode
+	programs of flag setting and flag reading instructions are cut into
+	blocks by direct, conditional and indirect jumps and run a few times in a
+	loop, so blocks get linked and the flags generation at their exits gets
+	dropped. Some programs also change the code of blocks that are already
+	linked. Every program runs from the same state on both cores, afterwards
+	the registers, flags and memory have to be the same.
+*/
+
+#define CHECK_PROGRAMS 500
+#define CHECK_LOOPS 8
+#define CHECK_CODESEG 0x2000
+#define CHECK_DATASEG 0x3000
+/* Word accesses at offset 0xffff write one byte past the segment */
+#define CHECK_DATASIZE (0x10000+16)
+
+static Bit32u check_seed;
+
+static Bitu DYNREC_CheckRandom(Bitu range) {
+	check_seed=check_seed*1664525+1013904223;
+	return (check_seed>>16)%range;
+}
+
+/* Registers the programs change, cx counts the loop and sp isn't touched */
+static Bit8u DYNREC_CheckReg(void) {
+	static const Bit8u regs[6]={0,2,3,5,6,7};
+	return regs[DYNREC_CheckRandom(6)];
+}
+
+/* ax, dx, bx, ah, dh and bh as byte registers */
+static Bit8u DYNREC_CheckByteReg(void) {
+	static const Bit8u regs[6]={0,2,3,4,6,7};
+	return regs[DYNREC_CheckRandom(6)];
+}
+
+static void DYNREC_CheckInstruction(std::vector<Bit8u> & code,std::vector<Bitu> & immediates) {
+	Bit8u reg=DYNREC_CheckReg();
+	switch (DYNREC_CheckRandom(16)) {
+	case 0:case 1:case 2:		/* alu reg,reg with add, or, adc, sbb, and, sub, xor or cmp */
+		if (DYNREC_CheckRandom(4)==0) code.push_back(0x66);
+		code.push_back(0x01+(Bit8u)(DYNREC_CheckRandom(8)<<3));
+		code.push_back(0xc0+(Bit8u)(DYNREC_CheckRandom(8)<<3)+reg);
+		break;
+	case 3:case 4:				/* alu reg,imm8, the immediate can be changed later */
+		code.push_back(0x83);
+		code.push_back(0xc0+(Bit8u)(DYNREC_CheckRandom(8)<<3)+reg);
+		immediates.push_back(code.size());
+		code.push_back((Bit8u)DYNREC_CheckRandom(256));
+		break;
+	case 5:						/* inc and dec keep the carry */
+		code.push_back((DYNREC_CheckRandom(2) ? 0x40 : 0x48)+reg);
+		break;
+	case 6:						/* neg, not, imul */
+		switch (DYNREC_CheckRandom(3)) {
+		case 0:code.push_back(0xf7);code.push_back(0xd8+reg);break;
+		case 1:code.push_back(0xf7);code.push_back(0xd0+reg);break;
+		case 2:code.push_back(0x6b);code.push_back(0xc0+(reg<<3)+DYNREC_CheckReg());
+			code.push_back((Bit8u)DYNREC_CheckRandom(256));break;
+		}
+		break;
+	case 7:						/* shifts and rotates by 1, cl or an immediate, a count of 0 keeps the flags */
+		switch (DYNREC_CheckRandom(3)) {
+		case 0:code.push_back(0xd1);break;
+		case 1:code.push_back(0xd3);break;
+		case 2:code.push_back(0xc1);break;
+		}
+		code.push_back(0xc0+(Bit8u)(DYNREC_CheckRandom(8)<<3)+reg);
+		if (code[code.size()-2]==0xc1) {
+			static const Bit8u counts[6]={0,1,3,15,16,31};
+			code.push_back(counts[DYNREC_CheckRandom(6)]);
+		}
+		break;
+	case 8:						/* alu with memory */
+		code.push_back((Bit8u)(DYNREC_CheckRandom(8)<<3)+(DYNREC_CheckRandom(2) ? 0x01 : 0x03));
+		{
+			static const Bit8u rms[7]={0,1,2,3,4,5,7};
+			code.push_back((Bit8u)(reg<<3)+rms[DYNREC_CheckRandom(7)]);
+		}
+		break;
+	case 9:						/* clc, stc, cmc, test */
+		switch (DYNREC_CheckRandom(4)) {
+		case 0:code.push_back(0xf8);break;
+		case 1:code.push_back(0xf9);break;
+		case 2:code.push_back(0xf5);break;
+		case 3:code.push_back(0x85);code.push_back(0xc0+(Bit8u)(DYNREC_CheckRandom(8)<<3)+reg);break;
+		}
+		break;
+	case 10:					/* pushf, pop reg */
+		code.push_back(0x9c);
+		code.push_back(0x58+reg);
+		break;
+	case 11:					/* setcc */
+		code.push_back(0x0f);
+		code.push_back(0x90+(Bit8u)DYNREC_CheckRandom(16));
+		code.push_back(0xc0+DYNREC_CheckByteReg());
+		break;
+	case 12:					/* jcc over an xchg */
+		code.push_back(0x70+(Bit8u)DYNREC_CheckRandom(16));
+		code.push_back(0x01);
+		code.push_back(0x90+reg);
+		break;
+	case 13:					/* lahf */
+		code.push_back(0x9f);
+		break;
+	case 14:					/* mov reg,imm16 */
+		code.push_back(0xb8+reg);
+		code.push_back((Bit8u)DYNREC_CheckRandom(256));
+		code.push_back((Bit8u)DYNREC_CheckRandom(256));
+		break;
+	case 15:					/* change an immediate of code that already ran */
+		if (immediates.empty()) break;
+		{
+			Bitu pos=immediates[DYNREC_CheckRandom(immediates.size())];
+			code.push_back(0x2e);
+			code.push_back(0xa2);
+			code.push_back((Bit8u)pos);
+			code.push_back((Bit8u)(pos>>8));
+		}
+		break;
+	}
+}
+
+static void DYNREC_CheckProgram(std::vector<Bit8u> & code,Bitu callback) {
+	std::vector<Bitu> immediates;
+	code.clear();
+	code.push_back(0xfa);										/* cli */
+	code.push_back(0xb9);code.push_back(CHECK_LOOPS);code.push_back(0);	/* mov cx,loops */
+	Bitu start=code.size();
+	Bitu blocks=8+DYNREC_CheckRandom(32);
+	for (Bitu b=0;b<blocks;b++) {
+		for (Bitu i=DYNREC_CheckRandom(6);i>0;i--) DYNREC_CheckInstruction(code,immediates);
+		switch (DYNREC_CheckRandom(3)) {
+		case 0:													/* jmp short over some garbage */
+			code.push_back(0xeb);code.push_back(2);
+			code.push_back(0xfe);code.push_back(0xff);
+			break;
+		case 1:													/* jcc, both ways go on */
+			code.push_back(0x70+(Bit8u)DYNREC_CheckRandom(16));code.push_back(2);
+			code.push_back(0xeb);code.push_back(0);
+			break;
+		case 2: {												/* push ax, mov ax,next, jmp ax, next: pop ax */
+			Bitu next=code.size()+7;
+			code.push_back(0x50);
+			code.push_back(0xb8);code.push_back((Bit8u)next);code.push_back((Bit8u)(next>>8));
+			code.push_back(0xff);code.push_back(0xe0);
+			code.push_back(0xcc);
+			code.push_back(0x58);
+			break;
+			}
+		}
+	}
+	/* loop start, then stop with the callback */
+	Bitu loop=code.size();
+	code.push_back(0xe2);code.push_back(3);
+	code.push_back(0xe9);code.push_back(3);code.push_back(0);
+	Bitu back=start-(loop+8);
+	code.push_back(0xe9);code.push_back((Bit8u)back);code.push_back((Bit8u)(back>>8));
+	code.push_back(0xfe);code.push_back(0x38);
+	code.push_back((Bit8u)callback);code.push_back((Bit8u)(callback>>8));
+}
+
+struct DYNREC_CheckState {
+	Bit32u regs[8];
+	Bit32u flags;
+	Bit32u eip;
+	std::vector<Bit8u> code;
+	std::vector<Bit8u> data;
+};
+
+static bool DYNREC_CheckRun(CPU_Decoder * core,Bitu callback,const std::vector<Bit8u> & code,
+	const std::vector<Bit8u> & data,const Bit32u * regs,Bit32u flags,DYNREC_CheckState & state) {
+	MEM_BlockWrite(CHECK_CODESEG<<4,&code[0],code.size());
+	MEM_BlockWrite(CHECK_DATASEG<<4,&data[0],data.size());
+	SegSet16(cs,CHECK_CODESEG);
+	SegSet16(ds,CHECK_DATASEG);
+	SegSet16(es,CHECK_DATASEG);
+	SegSet16(ss,CHECK_DATASEG);
+	for (Bitu i=0;i<8;i++) cpu_regs.regs[i].dword[DW_INDEX]=regs[i];
+	reg_esp=0xfff0;
+	reg_eip=0;
+	reg_flags=flags;
+	lflags.type=t_UNKNOWN;
+	bool done=false;
+	for (Bitu slices=0;slices<1000 && !done;slices++) {
+		CPU_Cycles=10000;
+		CPU_CycleLeft=0;
+		Bits ret=core();
+		if (ret==(Bits)callback) done=true;
+		else if (ret) break;
+	}
+	FillFlags();
+	for (Bitu i=0;i<8;i++) state.regs[i]=cpu_regs.regs[i].dword[DW_INDEX];
+	state.flags=reg_flags;
+	state.eip=reg_eip;
+	state.code.resize(code.size());
+	state.data.resize(data.size());
+	MEM_BlockRead(CHECK_CODESEG<<4,&state.code[0],code.size());
+	MEM_BlockRead(CHECK_DATASEG<<4,&state.data[0],data.size());
+	return done;
+}
+
+void CPU_Core_Dynrec_Check(void) {
+	static const char * const names[8]={"eax","ecx","edx","ebx","esp","ebp","esi","edi"};
+	CPU_Decoder * olddecoder=cpudecoder;
+	Bits oldCycles=CPU_Cycles;
+	Bits oldLeft=CPU_CycleLeft;
+	Bitu callback=CALLBACK_Allocate();
+	CPU_Core_Dynrec_Cache_Init(true);
+	Bit32u links=cache_stats.flags_links;
+	std::vector<Bit8u> code,data(CHECK_DATASIZE);
+	DYNREC_CheckState normal,dynrec;
+	Bitu failed=0;
+	for (Bitu program=0;program<CHECK_PROGRAMS;program++) {
+		check_seed=program+1;
+		DYNREC_CheckProgram(code,callback);
+		for (Bitu i=0;i<data.size();i++) data[i]=(Bit8u)DYNREC_CheckRandom(256);
+		Bit32u regs[8];
+		for (Bitu i=0;i<8;i++) regs[i]=(Bit32u)DYNREC_CheckRandom(0x10000)|((Bit32u)DYNREC_CheckRandom(0x10000)<<16);
+		Bit32u flags=0x2|(Bit32u)(DYNREC_CheckRandom(0x1000)&(FLAG_CF|FLAG_PF|FLAG_AF|FLAG_ZF|FLAG_SF|FLAG_OF));
+		bool normalDone=DYNREC_CheckRun(&CPU_Core_Normal_Run,callback,code,data,regs,flags,normal);
+		bool dynrecDone=DYNREC_CheckRun(&CPU_Core_Dynrec_Run,callback,code,data,regs,flags,dynrec);
+		if (!normalDone || !dynrecDone) {
+			printf("program %d: didn't finish on the %s core\n",(int)program,normalDone ? "dynrec" : "normal");
+			failed++;
+			continue;
+		}
+		bool same=true;
+		for (Bitu i=0;i<8;i++) {
+			if (normal.regs[i]==dynrec.regs[i]) continue;
+			printf("program %d: %s normal %08X dynrec %08X\n",(int)program,names[i],normal.regs[i],dynrec.regs[i]);
+			same=false;
+		}
+		if (normal.flags!=dynrec.flags) {
+			printf("program %d: flags normal %04X dynrec %04X\n",(int)program,normal.flags,dynrec.flags);
+			same=false;
+		}
+		if (normal.eip!=dynrec.eip) {
+			printf("program %d: eip normal %04X dynrec %04X\n",(int)program,normal.eip,dynrec.eip);
+			same=false;
+		}
+		if (normal.code!=dynrec.code || normal.data!=dynrec.data) {
+			printf("program %d: memory differs\n",(int)program);
+			same=false;
+		}
+		if (!same) failed++;
+	}
+	CALLBACK_DeAllocate(callback);
+	cpudecoder=olddecoder;
+	CPU_Cycles=oldCycles;
+	CPU_CycleLeft=oldLeft;
+	printf("Dynrec check: %d programs, %d differ from the normal core, %d links dropped flags generation\n",
+		CHECK_PROGRAMS,(int)failed,(int)(cache_stats.flags_links-links));
+}
+
+#else
+
+#include <stdio.h>
+
+void CPU_Core_Dynrec_Check(void) {
+	printf("The recompiling core isn't built in\n");
+}
+
 #endif
@@ -19,6 +19,18 @@
 
 class CodePageHandlerDynRec;	// forward
 
+// flag generating functions at the end of a block that can be replaced by
+// their simpler variants once the block is linked to a block that doesn't
+// use the flags before overwriting them
+struct CacheFlagsPatch {
+	Bitu num;
+	struct {
+		Bit8u * pos;
+		void * fct_ptr;
+		Bitu ftype;
+	} fct[4];
+};
+
 // basic cache block representation
 class CacheBlockDynRec {
 public:
@@ -55,6 +67,18 @@ public:
 		CacheBlockDynRec * from;	// the from-block can transfer control to this block
 	} link[2];	// maximal two links (conditional jumps)
 	CacheBlockDynRec * crossblock;
+	struct {
+		Bit32u count[2];	// how often the conditional exit was not taken/taken
+		Bit32u target;		// negated linear address of the cached indirect jump target
+		bool indirect;		// the block ends with an indirect jump, link[0] caches its target
+		bool trace;			// superblock, the exits aren't profiled
+		bool flags_dead;	// the block overwrites the flags before using them
+		bool flags_linked;	// flags generation was dropped because of the link[0] target
+		bool flags_stale;	// the link[0] target got cleared, the block is cleared soon
+		CacheFlagsPatch * flags_patch;
+	} exit;
+	// remove the link of the code path index
+	void Unlink(Bitu index);
 };
 
 static struct {
@@ -70,6 +94,16 @@ static struct {
 	CodePageHandlerDynRec * last_page;		// the last used page
 } cache;
 
+// counters that can be queried at runtime through CPU_Core_Dynrec_Cache_Stats
+static CPU_DynrecCacheStats cache_stats;
+
+// size of the code cache and the limit up to which the adaptive mode grows it
+static Bitu cache_total=CACHE_TOTAL;
+static Bitu cache_total_max=CACHE_TOTAL;
+static Bitu cache_pages=0;
+// grow the cache and release the least recently used pages first
+static bool cache_adaptive=false;
+
 
 // cache memory pointers, to be malloc'd later
 static Bit8u * cache_code_start_ptr=NULL;
@@ -131,6 +165,7 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();		// clear the block, decrements the write_map accordingly
+					cache_stats.blocks_invalidated++;
 				}
 				block=nextblock;
 			}
@@ -139,11 +174,17 @@ public:
 		return is_current_block;
 	}
 
+	// the incremental save states only store the ram pages that were written to
+	void MarkDirty(void) {
+		if (phys_page<MEM_TotalPages()) MemDirty[phys_page]=1;
+	}
+
 	// the following functions will clean all cache blocks that are invalid now due to the write
 	void writeb(PhysPt addr,Bitu val){
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return;
 		host_writeb(hostmem+addr,val);
+		MarkDirty();
 		// see if there's code where we are writing to
 		if (!host_readb(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -161,6 +202,7 @@ public:
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return;
 		host_writew(hostmem+addr,val);
+		MarkDirty();
 		// see if there's code where we are writing to
 		if (!host_readw(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -183,6 +225,7 @@ public:
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return;
 		host_writed(hostmem+addr,val);
+		MarkDirty();
 		// see if there's code where we are writing to
 		if (!host_readd(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -223,6 +266,7 @@ public:
 			}
 		}
 		host_writeb(hostmem+addr,val);
+		MarkDirty();
 		return false;
 	}
 	bool writew_checked(PhysPt addr,Bitu val) {
@@ -252,6 +296,7 @@ public:
 			}
 		}
 		host_writew(hostmem+addr,val);
+		MarkDirty();
 		return false;
 	}
 	bool writed_checked(PhysPt addr,Bitu val) {
@@ -281,6 +326,7 @@ public:
 			}
 		}
 		host_writed(hostmem+addr,val);
+		MarkDirty();
 		return false;
 	}
 
@@ -335,6 +381,19 @@ public:
 		}
 	}
 
+	// move this page to the end of the page list, so the start of the
+	// list holds the least recently used pages
+	void Touch(void) {
+		if (!next) return;
+		if (prev) prev->next=next;
+		else cache.used_pages=next;
+		next->prev=prev;
+		prev=cache.last_page;
+		prev->next=this;
+		next=0;
+		cache.last_page=this;
+	}
+
 	void Release(void) {
 		MEM_SetPageHandler(phys_page,1,old_pagehandler);	// revert to old handler
 		PAGING_ClearTLB();
@@ -403,15 +462,66 @@ static INLINE void cache_addunusedblock(CacheBlockDynRec * block) {
 	cache.block.free=block;
 }
 
+// add another chunk of cache blocks to the freelist, only in adaptive mode
+static bool cache_growblocks(void) {
+	if (!cache_adaptive) return false;
+	Bitu count=CACHE_BLOCKS/4;
+	CacheBlockDynRec * blocks=(CacheBlockDynRec*)malloc(count*sizeof(CacheBlockDynRec));
+	if (!blocks) return false;
+	memset(blocks,0,count*sizeof(CacheBlockDynRec));
+	for (Bitu i=0;i<count;i++) {
+		blocks[i].link[0].to=(CacheBlockDynRec *)1;
+		blocks[i].link[1].to=(CacheBlockDynRec *)1;
+		blocks[i].cache.next=(i<count-1) ? &blocks[i+1] : cache.block.free;
+	}
+	cache.block.free=&blocks[0];
+	cache_stats.blocks_total+=count;
+	return true;
+}
+
 static CacheBlockDynRec * cache_getblock(void) {
 	// get a free cache block and advance the free pointer
 	CacheBlockDynRec * ret=cache.block.free;
-	if (!ret) E_Exit("Ran out of CacheBlocks" );
+	if (!ret) {
+		if (!cache_growblocks()) E_Exit("Ran out of CacheBlocks" );
+		ret=cache.block.free;
+	}
 	cache.block.free=ret->cache.next;
 	ret->cache.next=0;
 	return ret;
 }
 
+// blocks whose flags generation was dropped for a block that got cleared,
+// they are unlinked at once but only cleared when no cache lists are walked
+static std::vector<CacheBlockDynRec *> cache_flags_stale;
+
+static void cache_flagsstale(CacheBlockDynRec * block) {
+	block->exit.flags_linked=false;
+	block->exit.flags_stale=true;
+	cache_flags_stale.push_back(block);
+	// make sure the block isn't entered through a link anymore
+	for (Bitu ind=0;ind<2;ind++) {
+		CacheBlockDynRec * fromlink=block->link[ind].from;
+		block->link[ind].from=0;
+		while (fromlink) {
+			CacheBlockDynRec * nextlink=fromlink->link[ind].next;
+			fromlink->link[ind].next=0;
+			fromlink->link[ind].to=&link_blocks[ind];
+			if (fromlink->exit.flags_linked) cache_flagsstale(fromlink);
+			fromlink=nextlink;
+		}
+	}
+}
+
+// clear the blocks collected by cache_flagsstale
+static void cache_flagsclear(void) {
+	while (GCC_UNLIKELY(!cache_flags_stale.empty())) {
+		CacheBlockDynRec * block=cache_flags_stale.back();
+		cache_flags_stale.pop_back();
+		if (block->exit.flags_stale) block->Clear();
+	}
+}
+
 void CacheBlockDynRec::Clear(void) {
 	Bitu ind;
 	// check if this is not a cross page block
@@ -423,6 +533,8 @@ void CacheBlockDynRec::Clear(void) {
 			// clear the next-link and let the block point to the standard linkcode
 			fromlink->link[ind].next=0;
 			fromlink->link[ind].to=&link_blocks[ind];
+			// the block doesn't generate the flags this block overwrote
+			if (fromlink->exit.flags_linked) cache_flagsstale(fromlink);
 
 			fromlink=nextlink;
 		}
@@ -438,6 +550,7 @@ void CacheBlockDynRec::Clear(void) {
 			else {
 				LOG(LOG_CPU,LOG_ERROR)("Cache anomaly. please investigate");
 			}
+			link[ind].to=&link_blocks[ind];
 		}
 	} else 
 		cache_addunusedblock(this);
@@ -456,6 +569,24 @@ void CacheBlockDynRec::Clear(void) {
 		free(cache.wmapmask);
 		cache.wmapmask=NULL;
 	}
+	if (exit.flags_patch) {
+		free(exit.flags_patch);
+		exit.flags_patch=NULL;
+	}
+	exit.flags_linked=false;
+	exit.flags_stale=false;
+}
+
+
+void CacheBlockDynRec::Unlink(Bitu index) {
+	if (link[index].to==&link_blocks[index]) return;
+	CacheBlockDynRec * * wherelink=&link[index].to->link[index].from;
+	while (*wherelink != this && *wherelink) {
+		wherelink = &(*wherelink)->link[index].next;
+	}
+	if (*wherelink) *wherelink = (*wherelink)->link[index].next;
+	link[index].to=&link_blocks[index];
+	link[index].next=0;
 }
 
 
@@ -464,8 +595,20 @@ static CacheBlockDynRec * cache_openblock(void) {
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlockDynRec * nextblock=block->cache.next;
-	if (block->page.handler) 
+	if (block->page.handler) {
 		block->Clear();
+		cache_stats.blocks_evicted++;
+	}
+	cache_stats.blocks_compiled++;
+	block->exit.count[0]=0;
+	block->exit.count[1]=0;
+	block->exit.target=0;
+	block->exit.indirect=false;
+	block->exit.trace=false;
+	block->exit.flags_dead=false;
+	block->exit.flags_linked=false;
+	block->exit.flags_stale=false;
+	block->exit.flags_patch=NULL;
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -473,8 +616,10 @@ static CacheBlockDynRec * cache_openblock(void) {
 		// merge blocks
 		size+=nextblock->cache.size;
 		CacheBlockDynRec * tempblock=nextblock->cache.next;
-		if (nextblock->page.handler) 
+		if (nextblock->page.handler) {
 			nextblock->Clear();
+			cache_stats.blocks_evicted++;
+		}
 		// block is free now
 		cache_addunusedblock(nextblock);
 		nextblock=tempblock;
@@ -487,6 +632,47 @@ skipresize:
 	return block;
 }
 
+#if defined (WIN32)
+// the code cache is only reserved at its maximum size, the memory
+// gets committed when the cache grows
+static bool cache_code_reserved=false;
+
+static bool cache_commit(Bit8u * start,Bitu size) {
+	if (!cache_code_reserved) return true;
+	return VirtualAlloc(start,size,MEM_COMMIT,PAGE_EXECUTE_READWRITE)!=NULL;
+}
+#endif
+
+// append more code memory to the end of the block list when the cache is
+// full, instead of overwriting the oldest blocks (adaptive mode only)
+static bool cache_growcode(CacheBlockDynRec * block) {
+	if (!cache_adaptive || (cache_total>=cache_total_max)) return false;
+	CacheBlockDynRec * tail=block;
+	while (tail->cache.next) tail=tail->cache.next;
+	Bit8u * start=cache_code+cache_total;
+	if (tail==block) {
+		// the last block may have overrun its size
+		Bit8u * pos=(Bit8u*)((((Bitu)cache.pos)+CACHE_ALIGN-1)&~(CACHE_ALIGN-1));
+		if (pos>start) start=pos;
+	}
+	Bitu new_total=cache_total+cache_total_max/4;
+	if (new_total>cache_total_max) new_total=cache_total_max;
+	if (start+CACHE_MAXSIZE>cache_code+new_total) return false;
+#if defined (WIN32)
+	// the overrun area past the end is committed already
+	if (!cache_commit(cache_code+cache_total+CACHE_MAXSIZE,new_total-cache_total)) return false;
+#endif
+	CacheBlockDynRec * newblock=cache_getblock();
+	newblock->cache.start=start;
+	newblock->cache.size=(Bitu)(cache_code+new_total-start);
+	newblock->cache.next=0;
+	tail->cache.size=(Bitu)(start-tail->cache.start);
+	tail->cache.next=newblock;
+	cache_total=new_total;
+	cache_stats.code_size=cache_total;
+	return true;
+}
+
 static void cache_closeblock(void) {
 	CacheBlockDynRec * block=cache.block.active;
 	// links point to the default linking code
@@ -518,9 +704,14 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
+	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + cache_total - CACHE_MAXSIZE))) {
+		if (cache_growcode(block)) {
+			cache.block.active=block->cache.next;
+		} else {
+//			LOG_MSG("Cache full restarting");
+			cache.block.active=cache.block.first;
+			cache_stats.cache_wraps++;
+		}
 	} else {
 		cache.block.active=block->cache.next;
 	}
@@ -553,6 +744,8 @@ static INLINE void cache_addq(Bit64u val) {
 
 static void dyn_return(BlockReturn retcode,bool ret_exception);
 static void dyn_run_code(void);
+// make newly written code visible to instruction fetch, implemented by the backends
+static void cache_block_closing(Bit8u* block_start,Bitu block_size);
 
 
 /* Define temporary pagesize so the MPROTECT case and the regular case share as much code as possible */
@@ -586,15 +779,17 @@ static void cache_init(bool enable) {
 		if (cache_code_start_ptr==NULL) {
 			// allocate the code cache memory
 #if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
-				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
-			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,cache_total_max+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+				MEM_RESERVE,PAGE_EXECUTE_READWRITE);
+			if (cache_code_start_ptr)
+				cache_code_reserved=true;
+			else
+				cache_code_start_ptr=(Bit8u*)malloc(cache_total_max+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #else
 #ifndef IPHONEOS
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)malloc(cache_total_max+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #else
-            cache_code_start_ptr=(Bit8u*)mmap(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+            cache_code_start_ptr=(Bit8u*)mmap(0,cache_total_max+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
                                       PROT_WRITE|PROT_READ|PROT_EXEC,
                                       MAP_PRIVATE|MAP_ANON, 0, 0);
             if (cache_code_start_ptr==(Bit8u*)-1) {
@@ -609,9 +804,14 @@ static void cache_init(bool enable) {
 
 			cache_code_link_blocks=cache_code;
 			cache_code=cache_code+PAGESIZE_TEMP;
+#if defined (WIN32)
+			// the link blocks and the cache without growing
+			if (!cache_commit(cache_code_link_blocks,PAGESIZE_TEMP+cache_total+CACHE_MAXSIZE))
+				E_Exit("Allocating dynamic cache failed");
+#endif
 #ifndef IPHONEOS
 #if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+			if(mprotect(cache_code_link_blocks,cache_total_max+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting excute permission on the code cache has failed");
 #endif
 #endif
@@ -619,7 +819,7 @@ static void cache_init(bool enable) {
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_total;
 			block->cache.next=0;						// last block in the list
 		}
 		// setup the default blocks for block linkage returns
@@ -636,6 +836,7 @@ static void cache_init(bool enable) {
 		core_dynrec.runcode=(BlockReturn (*)(Bit8u*))cache.pos;
 //		link_blocks[1].cache.start=cache.pos;
 		dyn_run_code();
+		cache_block_closing(cache_code_link_blocks,PAGESIZE_TEMP);
 
 		cache.free_pages=0;
 		cache.last_page=0;
@@ -646,9 +847,41 @@ static void cache_init(bool enable) {
 			newpage->next=cache.free_pages;
 			cache.free_pages=newpage;
 		}
+		cache_pages=CACHE_PAGES;
+		cache_stats.blocks_total=CACHE_BLOCKS;
+		cache_stats.code_size=cache_total;
 	}
 }
 
+// set up the code cache size, has no effect once the cache is allocated
+static void cache_configure(Bitu size,bool adaptive) {
+	if (cache_code_start_ptr!=NULL) return;
+	if (size<CACHE_MAXSIZE*16) size=CACHE_MAXSIZE*16;
+	cache_adaptive=adaptive;
+	cache_total=size;
+	cache_total_max=adaptive ? size*4 : size;
+}
+
+// add more code pages instead of releasing used ones (adaptive mode only)
+static bool cache_growpages(void) {
+	if (!cache_adaptive || (cache_pages>=CACHE_PAGES*4)) return false;
+	for (Bitu i=0;i<CACHE_PAGES/4;i++) {
+		CodePageHandlerDynRec * newpage=new CodePageHandlerDynRec();
+		newpage->next=cache.free_pages;
+		cache.free_pages=newpage;
+	}
+	cache_pages+=CACHE_PAGES/4;
+	return true;
+}
+
+// throw away all translated code, the memory it came from changed
+static void cache_flush(void) {
+	if (!cache_initialized) return;
+	while (cache.used_pages) cache.used_pages->ClearRelease();
+	cache_flags_stale.clear();
+	cache_stats.flushes++;
+}
+
 static void cache_close(void) {
 /*	for (;;) {
 		if (cache.used_pages) {
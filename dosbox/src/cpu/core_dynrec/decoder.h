@@ -43,6 +43,8 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 	decode.page.first=start >> 12;
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=(Bit16u)decode.page.index;
+	decode.block->exit.trace=(decode.trace.count>0);
+	decode.trace.pos=0;
 	codepage->AddCacheBlock(decode.block);
 
 	InitFlagsOptimization();
@@ -195,9 +197,9 @@ restart_prefix:
 				// short conditional jumps
 				case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:	
 				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:	
-					dyn_branched_exit((BranchTypes)(dual_code&0xf),
-						decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
-					goto finish_block;
+					if (dyn_branched_exit((BranchTypes)(dual_code&0xf),
+						decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw())) goto finish_block;
+					break;
 
 				// conditional byte set instructions
 /*				case 0x90:case 0x91:case 0x92:case 0x93:case 0x94:case 0x95:case 0x96:case 0x97:	
@@ -296,8 +298,8 @@ restart_prefix:
 		// short conditional jumps
 		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:	
 		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:	
-			dyn_branched_exit((BranchTypes)(opcode&0xf),(Bit8s)decode_fetchb());	
-			goto finish_block;
+			if (dyn_branched_exit((BranchTypes)(opcode&0xf),(Bit8s)decode_fetchb())) goto finish_block;
+			break;
 
 		// 'op []/reg8,imm8'
 		case 0x80:
@@ -519,9 +521,13 @@ restart_prefix:
 			dyn_jmp_far_imm();
 			goto finish_block;
 		// 'jmp short imm8'
-		case 0xeb:
-			dyn_exit_link((Bit8s)decode_fetchb());
+		case 0xeb: {
+			Bit8s eip_change=(Bit8s)decode_fetchb();
+			// jmp $ just waits for an interrupt
+			if (eip_change==-2) gen_call_function_raw((void *)&CPU_Idle);
+			dyn_exit_link(eip_change);
 			goto finish_block;
+			}
 
 
 		// repeat prefixes
@@ -573,6 +579,8 @@ restart_prefix:
 				goto core_close_block;
 			case 2:
 				goto illegalopcode;
+			case 3:
+				goto core_close_indirect;
 			default:
 				break;
 			}
@@ -587,6 +595,7 @@ restart_prefix:
 	dyn_set_eip_end();
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
+	SaveFlagsForLink();
 	dyn_closeblock();
     goto finish_block;
 core_close_block:
@@ -594,6 +603,10 @@ core_close_block:
 	dyn_return(BR_Normal);
 	dyn_closeblock();
 	goto finish_block;
+core_close_indirect:
+	dyn_reduce_cycles();
+	dyn_exit_indirect();
+	goto finish_block;
 illegalopcode:
 	// some unhandled opcode has been encountered
 	dyn_set_eip_last();
@@ -608,5 +621,39 @@ finish_block:
 	decode.active_block->page.end=(Bit16u)decode.page.index;
 //	LOG_MSG("Created block size %d start %d end %d",decode.block->cache.size,decode.block->page.start,decode.block->page.end);
 
+	decode.trace.count=0;
 	return decode.block;
 }
+
+/*
+	Blocks that end with a conditional branch count how often each side
+	is taken. Once a block got hot and one side clearly dominates, the
+	block is translated again as superblock that continues on the hot
+	side (and on the hot sides of the blocks linked from there), so the
+	chain runs without block transitions.
+*/
+
+static CacheBlockDynRec * CreateSuperBlock(CodePageHandlerDynRec * codepage,PhysPt start,CacheBlockDynRec * block) {
+	decode.trace.count=0;
+	CacheBlockDynRec * hot=block;
+	while (decode.trace.count<DYN_TRACE_LENGTH) {
+		Bit32u total=hot->exit.count[0]+hot->exit.count[1];
+		if (total<DYN_TRACE_HOT/16) break;
+		Bitu dir;
+		if (hot->exit.count[1]>=total-total/8) dir=1;
+		else if (hot->exit.count[0]>=total-total/8) dir=0;
+		else break;
+		decode.trace.dir[decode.trace.count++]=dir;
+		// follow the link to the next block on the hot side
+		hot=hot->link[dir].to;
+		if ((hot==&link_blocks[dir]) || (hot==block) || (hot->page.handler!=codepage)) break;
+	}
+	// start profiling again if no side dominates
+	block->exit.count[0]=0;
+	block->exit.count[1]=0;
+	if (!decode.trace.count) return block;
+
+	block->Clear();
+	cache_stats.superblocks++;
+	return CreateCacheBlock(codepage,start,32);
+}
@@ -119,6 +119,13 @@ static struct DynDecode {
 		Bitu first;		// page number 
 	} page;
 
+	// hot direction of the conditional branches a superblock follows
+	struct {
+		Bitu dir[DYN_TRACE_LENGTH];
+		Bitu count;
+		Bitu pos;
+	} trace;
+
 	// modrm state of the current instruction (if used)
 	struct {
 		Bitu val;
@@ -163,7 +170,8 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandlerDynRec * &cph) {
 		return false;
 	}
 	// find a free CodePage
-	if (!cache.free_pages) {
+	if (!cache.free_pages && !cache_growpages()) {
+		cache_stats.pages_evicted++;
 		if (cache.used_pages!=decode.page.code) cache.used_pages->ClearRelease();
 		else {
 			// try another page to avoid clearing our source-crosspage
@@ -693,7 +701,7 @@ bool DRC_CALL_CONV mem_readb_checked_drc(PhysPt address) {
 		*((Bit8u*)(&core_dynrec.readdata))=host_readb(tlb_addr+address);
 		return false;
 	} else {
-		return get_tlb_readhandler(address)->readb_checked(address, (Bit8u*)(&core_dynrec.readdata));
+		return PAGING_ReadB_Checked(address,(Bit8u*)(&core_dynrec.readdata));
 	}
 }
 
@@ -703,7 +711,7 @@ bool DRC_CALL_CONV mem_writeb_checked_drc(PhysPt address,Bit8u val) {
 	if (tlb_addr) {
 		host_writeb(tlb_addr+address,val);
 		return false;
-	} else return get_tlb_writehandler(address)->writeb_checked(address,val);
+	} else return PAGING_WriteB_Checked(address,val);
 }
 
 bool DRC_CALL_CONV mem_readw_checked_drc(PhysPt address) DRC_FC;
@@ -713,7 +721,7 @@ bool DRC_CALL_CONV mem_readw_checked_drc(PhysPt address) {
 		if (tlb_addr) {
 			*((Bit16u*)(&core_dynrec.readdata))=host_readw(tlb_addr+address);
 			return false;
-		} else return get_tlb_readhandler(address)->readw_checked(address, (Bit16u*)(&core_dynrec.readdata));
+		} else return PAGING_ReadW_Checked(address,(Bit16u*)(&core_dynrec.readdata));
 	} else return mem_unalignedreadw_checked(address, ((Bit16u*)(&core_dynrec.readdata)));
 }
 
@@ -724,7 +732,7 @@ bool DRC_CALL_CONV mem_readd_checked_drc(PhysPt address) {
 		if (tlb_addr) {
 			*((Bit32u*)(&core_dynrec.readdata))=host_readd(tlb_addr+address);
 			return false;
-		} else return get_tlb_readhandler(address)->readd_checked(address, (Bit32u*)(&core_dynrec.readdata));
+		} else return PAGING_ReadD_Checked(address,(Bit32u*)(&core_dynrec.readdata));
 	} else return mem_unalignedreadd_checked(address, ((Bit32u*)(&core_dynrec.readdata)));
 }
 
@@ -735,7 +743,7 @@ bool DRC_CALL_CONV mem_writew_checked_drc(PhysPt address,Bit16u val) {
 		if (tlb_addr) {
 			host_writew(tlb_addr+address,val);
 			return false;
-		} else return get_tlb_writehandler(address)->writew_checked(address,val);
+		} else return PAGING_WriteW_Checked(address,val);
 	} else return mem_unalignedwritew_checked(address,val);
 }
 
@@ -746,7 +754,7 @@ bool DRC_CALL_CONV mem_writed_checked_drc(PhysPt address,Bit32u val) {
 		if (tlb_addr) {
 			host_writed(tlb_addr+address,val);
 			return false;
-		} else return get_tlb_writehandler(address)->writed_checked(address,val);
+		} else return PAGING_WriteD_Checked(address,val);
 	} else return mem_unalignedwrited_checked(address,val);
 }
 
@@ -1204,8 +1212,15 @@ static struct {
 	Bitu ftype;
 } mf_functions[64];
 
+// what the current block does first with the flags it is entered with,
+// blocks linked to it don't need to generate flags it overwrites
+static enum {
+	MF_ENTRY_UNTOUCHED,MF_ENTRY_OVERWRITTEN,MF_ENTRY_USED
+} mf_entry;
+
 static void InitFlagsOptimization(void) {
 	mf_functions_num=0;
+	mf_entry=MF_ENTRY_UNTOUCHED;
 }
 
 // replace all queued functions with their simpler variants
@@ -1217,6 +1232,10 @@ static void InvalidateFlags(void) {
 		gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
 	}
 	mf_functions_num=0;
+	if (mf_entry==MF_ENTRY_UNTOUCHED) {
+		mf_entry=MF_ENTRY_OVERWRITTEN;
+		decode.block->exit.flags_dead=true;
+	}
 #endif
 }
 
@@ -1232,6 +1251,10 @@ static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
 	mf_functions[0].pos=cache.pos;
 	mf_functions[0].fct_ptr=current_simple_function;
 	mf_functions[0].ftype=flags_type;
+	if (mf_entry==MF_ENTRY_UNTOUCHED) {
+		mf_entry=MF_ENTRY_OVERWRITTEN;
+		decode.block->exit.flags_dead=true;
+	}
 #endif
 }
 
@@ -1244,6 +1267,7 @@ static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_ty
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
 	mf_functions_num++;
+	if (mf_entry==MF_ENTRY_UNTOUCHED) mf_entry=MF_ENTRY_USED;
 #endif
 }
 
@@ -1256,6 +1280,7 @@ static void InvalidateFlagsPartially(void* current_simple_function,DRC_PTR_SIZE_
 	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
 	mf_functions[mf_functions_num].ftype=flags_type;
 	mf_functions_num++;
+	if (mf_entry==MF_ENTRY_UNTOUCHED) mf_entry=MF_ENTRY_USED;
 #endif
 }
 
@@ -1263,5 +1288,39 @@ static void InvalidateFlagsPartially(void* current_simple_function,DRC_PTR_SIZE_
 static void AcquireFlags(Bitu flags_mask) {
 #ifdef DRC_FLAGS_INVALIDATION
 	mf_functions_num=0;
+	if (mf_entry==MF_ENTRY_UNTOUCHED) mf_entry=MF_ENTRY_USED;
+#endif
+}
+
+// the block leaves through link[0] only, keep the queued functions so
+// they can still be replaced when the block gets linked (see LinkFlags)
+static void SaveFlagsForLink(void) {
+#ifdef DRC_FLAGS_INVALIDATION
+	if (!mf_functions_num || (mf_functions_num>4)) return;
+	CacheFlagsPatch * patch=(CacheFlagsPatch*)malloc(sizeof(CacheFlagsPatch));
+	if (!patch) return;
+	patch->num=mf_functions_num;
+	for (Bitu ct=0; ct<mf_functions_num; ct++) {
+		patch->fct[ct].pos=mf_functions[ct].pos;
+		patch->fct[ct].fct_ptr=mf_functions[ct].fct_ptr;
+		patch->fct[ct].ftype=mf_functions[ct].ftype;
+	}
+	decode.block->exit.flags_patch=patch;
+#endif
+}
+
+// the block is linked to a block that overwrites the flags before using
+// them, so the flags generated at its end are never needed
+static void LinkFlags(CacheBlockDynRec * block) {
+#ifdef DRC_FLAGS_INVALIDATION
+	CacheFlagsPatch * patch=block->exit.flags_patch;
+	for (Bitu ct=0; ct<patch->num; ct++) {
+		gen_fill_function_ptr(patch->fct[ct].pos,patch->fct[ct].fct_ptr,patch->fct[ct].ftype);
+	}
+	cache_block_closing(block->cache.start,block->cache.size);
+	free(patch);
+	block->exit.flags_patch=NULL;
+	block->exit.flags_linked=true;
+	cache_stats.flags_links++;
 #endif
 }
@@ -848,10 +848,10 @@ static Bitu dyn_grp4_ev(void) {
 
 		gen_restore_addr_reg();
 		gen_mov_word_from_reg(FC_ADDR,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),decode.big_op);
-		return 1;
+		return 3;
 	case 0x4:	// JMP Ev
 		gen_mov_word_from_reg(FC_OP1,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),decode.big_op);
-		return 1;
+		return 3;
 	case 0x3:	// CALL Ep
 	case 0x5:	// JMP Ep
 		if (!decode.big_op) gen_extend_word(false,FC_OP1);
@@ -1090,26 +1090,77 @@ static void dyn_exit_link(Bits eip_change) {
 	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
+	SaveFlagsForLink();
 	dyn_closeblock();
 }
 
 
-static void dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
+// continue a superblock on the hot side of a conditional branch,
+// the cold side leaves the block through the core
+static bool dyn_trace_branch(Bitu eip_base,Bit32s eip_add) {
+	Bitu dir=decode.trace.dir[decode.trace.pos++];
+	if (dir) {
+		// only short forward jumps within the current page are followed
+		if ((eip_add<0) || (eip_add>DYN_TRACE_GAP) || (decode.page.index+eip_add>=4096)) return false;
+		if (!decode.big_op && (reg_eip+eip_base+eip_add>0xffff)) return false;
+	}
+	AcquireFlags(FMASK_TEST);
+
+	DRC_PTR_SIZE_IM data=dir ? gen_create_branch_on_nonzero(FC_RETOP,true) : gen_create_branch_on_zero(FC_RETOP,true);
+	gen_add_direct_word(&reg_eip,dir ? eip_base : eip_base+eip_add,decode.big_op);
+	dyn_return(BR_Normal);
+	gen_fill_branch(data);
+
+	if (dir) {
+		// the skipped bytes are no code of this block, mask them in the write map
+		for (Bits ct=0;ct<eip_add;ct++) {
+			decode_increase_wmapmask(1);
+			decode.page.index++;
+			decode.code++;
+		}
+	}
+	decode.cycles=0;
+	return true;
+}
+
+// returns true if the block has been closed
+static bool dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
 	Bitu eip_base=decode.code-decode.code_start;
 	dyn_reduce_cycles();
 
 	dyn_branchflag_to_reg(btype);
+	if (decode.trace.pos<decode.trace.count) {
+		if (dyn_trace_branch(eip_base,eip_add)) return false;
+	}
 	DRC_PTR_SIZE_IM data=gen_create_branch_on_nonzero(FC_RETOP,true);
 
  	// Branch not taken
+	if (!decode.block->exit.trace) gen_add_direct_word(&decode.block->exit.count[0],1,true);
 	gen_add_direct_word(&reg_eip,eip_base,decode.big_op);
  	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
  	gen_fill_branch(data);
 
  	// Branch taken
+	if (!decode.block->exit.trace) gen_add_direct_word(&decode.block->exit.count[1],1,true);
 	gen_add_direct_word(&reg_eip,eip_base+eip_add,decode.big_op);
  	gen_jmp_ptr(&decode.block->link[1].to,offsetof(CacheBlockDynRec,cache.start));
  	dyn_closeblock();
+	return true;
+}
+
+// leave the block after a near indirect jump (reg_eip already set), jump
+// directly to the linked block if the target matches the cached one.
+// The target is compared as linear address, cs may have changed since
+static void dyn_exit_indirect(void) {
+	decode.block->exit.indirect=true;
+	gen_mov_word_to_reg(FC_RETOP,&reg_eip,true);
+	ADD_SEG_PHYS_TO_HOST_REG(FC_RETOP,cs);
+	gen_add(FC_RETOP,&decode.block->exit.target);
+	DRC_PTR_SIZE_IM data=gen_create_branch_on_nonzero(FC_RETOP,true);
+	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
+	gen_fill_branch(data);
+	dyn_return(BR_Indirect);
+	dyn_closeblock();
 }
 
 /*
@@ -1185,8 +1236,7 @@ static void dyn_ret_near(Bitu bytes) {
 	gen_mov_word_from_reg(FC_RETOP,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),true);
 
 	if (bytes) gen_add_direct_word(&reg_esp,bytes,true);
-	dyn_return(BR_Normal);
-	dyn_closeblock();
+	dyn_exit_indirect();
 }
 
 static void dyn_call_near_imm(void) {
@@ -1202,6 +1252,7 @@ static void dyn_call_near_imm(void) {
 
 	dyn_reduce_cycles();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
+	SaveFlagsForLink();
 	dyn_closeblock();
 }
 
@@ -0,0 +1,948 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+
+/* ARMv8 AArch64 (little endian) backend */
+
+
+// some configuring defines that specify the capabilities of this architecture
+// or aspects of the recompiling
+
+// protect FC_ADDR over function calls if necessaray
+// #define DRC_PROTECT_ADDR_REG
+
+// try to use non-flags generating functions if possible
+#define DRC_FLAGS_INVALIDATION
+// try to replace _simple functions by code
+#define DRC_FLAGS_INVALIDATION_DCODE
+
+// type with the same size as a pointer
+#define DRC_PTR_SIZE_IM Bit64u
+
+// calling convention modifier
+#define DRC_CALL_CONV	/* nothing */
+#define DRC_FC			/* nothing */
+
+// use FC_REGS_ADDR to hold the address of "cpu_regs" and to access it using FC_REGS_ADDR
+#define DRC_USE_REGS_ADDR
+// use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
+#define DRC_USE_SEGS_ADDR
+
+// register mapping
+typedef Bit8u HostReg;
+
+// registers
+#define HOST_r0		 0
+#define HOST_r1		 1
+#define HOST_r2		 2
+#define HOST_r3		 3
+#define HOST_r4		 4
+#define HOST_r5		 5
+#define HOST_r6		 6
+#define HOST_r7		 7
+#define HOST_r8		 8
+#define HOST_r9		 9
+#define HOST_r10	10
+#define HOST_r11	11
+#define HOST_r12	12
+#define HOST_r13	13
+#define HOST_r14	14
+#define HOST_r15	15
+#define HOST_r16	16
+#define HOST_r17	17
+#define HOST_r18	18
+#define HOST_r19	19
+#define HOST_r20	20
+#define HOST_r21	21
+#define HOST_r22	22
+#define HOST_r23	23
+#define HOST_r24	24
+#define HOST_r25	25
+#define HOST_r26	26
+#define HOST_r27	27
+#define HOST_r28	28
+#define HOST_r29	29
+#define HOST_r30	30
+// register 31 is the stack pointer or the zero register, depending on the instruction
+#define HOST_r31	31
+
+// register aliases
+#define HOST_ip0 HOST_r16
+#define HOST_ip1 HOST_r17
+#define HOST_fp HOST_r29
+#define HOST_lr HOST_r30
+#define HOST_sp HOST_r31
+#define HOST_zr HOST_r31
+
+// temporary registers
+#define temp1 HOST_ip0
+#define temp2 HOST_ip1
+#define temp3 HOST_r15
+
+// register that holds function return values
+#define FC_RETOP HOST_r0
+
+// register used for address calculations,
+#define FC_ADDR HOST_r19			// callee saved, no need for DRC_PROTECT_ADDR_REG
+
+// register that holds the first parameter
+#define FC_OP1 HOST_r0
+
+// register that holds the second parameter
+#define FC_OP2 HOST_r1
+
+// special register that holds the third parameter for _R3 calls (byte accessible)
+#define FC_OP3 HOST_r2
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA1 HOST_r0
+
+// register that holds byte-accessible temporary values
+#define FC_TMP_BA2 HOST_r1
+
+// temporary register for LEA
+#define TEMP_REG_DRC HOST_r9
+
+#ifdef DRC_USE_REGS_ADDR
+// used to hold the address of "cpu_regs" - preferably filled in function gen_run_code
+#define FC_REGS_ADDR HOST_r20
+#endif
+
+#ifdef DRC_USE_SEGS_ADDR
+// used to hold the address of "Segs" - preferably filled in function gen_run_code
+#define FC_SEGS_ADDR HOST_r21
+#endif
+
+// used to hold the address of "core_dynrec.readdata" - filled in function gen_run_code
+#define readdata_addr HOST_r22
+
+
+// instruction encodings
+// unless noted otherwise the 32bit forms are used, they zero the upper half of the register
+
+// move
+// mov dst, src
+#define MOV_REG(dst, src) (0x2a0003e0 + (dst) + ((src) << 16) )
+// mov dst, src		@	64bit
+#define MOV64_REG(dst, src) (0xaa0003e0 + (dst) + ((src) << 16) )
+// movz dst, #(imm lsl simm)		@	0 <= imm <= 65535	&	simm = 0/16
+#define MOVZ(dst, imm, simm) (0x52800000 + (dst) + ((imm) << 5) + (((simm) >> 4) << 21) )
+// movn dst, #(imm lsl simm)		@	0 <= imm <= 65535	&	simm = 0/16
+#define MOVN(dst, imm, simm) (0x12800000 + (dst) + ((imm) << 5) + (((simm) >> 4) << 21) )
+// movk dst, #(imm lsl simm)		@	0 <= imm <= 65535	&	simm = 0/16
+#define MOVK(dst, imm, simm) (0x72800000 + (dst) + ((imm) << 5) + (((simm) >> 4) << 21) )
+// movz dst, #(imm lsl simm)		@	0 <= imm <= 65535	&	simm = 0/16/32/48	&	64bit
+#define MOVZ64(dst, imm, simm) (0xd2800000 + (dst) + ((imm) << 5) + (((simm) >> 4) << 21) )
+// movk dst, #(imm lsl simm)		@	0 <= imm <= 65535	&	simm = 0/16/32/48	&	64bit
+#define MOVK64(dst, imm, simm) (0xf2800000 + (dst) + ((imm) << 5) + (((simm) >> 4) << 21) )
+
+// arithmetic
+// add dst, src, #(imm lsl simm)		@	0 <= imm <= 4095	&	simm = 0/12
+#define ADD_IMM(dst, src, imm, simm) (0x11000000 + (dst) + ((src) << 5) + ((imm) << 10) + (((simm) / 12) << 22) )
+// sub dst, src, #(imm lsl simm)		@	0 <= imm <= 4095	&	simm = 0/12
+#define SUB_IMM(dst, src, imm, simm) (0x51000000 + (dst) + ((src) << 5) + ((imm) << 10) + (((simm) / 12) << 22) )
+// add dst, src1, src2, lsl #imm
+#define ADD_REG_LSL_IMM(dst, src1, src2, imm) (0x0b000000 + (dst) + ((src1) << 5) + ((imm) << 10) + ((src2) << 16) )
+// sub dst, src1, src2, lsl #imm
+#define SUB_REG_LSL_IMM(dst, src1, src2, imm) (0x4b000000 + (dst) + ((src1) << 5) + ((imm) << 10) + ((src2) << 16) )
+// neg dst, src
+#define NEG(dst, src) SUB_REG_LSL_IMM(dst, HOST_zr, src, 0)
+// cmp src, #imm		@	0 <= imm <= 4095
+#define CMP_IMM(src, imm) (0x7100001f + ((src) << 5) + ((imm) << 10) )
+// nop
+#define NOP (0xd503201f)
+
+// logical
+// and dst, src1, src2, lsl #imm
+#define AND_REG_LSL_IMM(dst, src1, src2, imm) (0x0a000000 + (dst) + ((src1) << 5) + ((imm) << 10) + ((src2) << 16) )
+// orr dst, src1, src2, lsl #imm
+#define ORR_REG_LSL_IMM(dst, src1, src2, imm) (0x2a000000 + (dst) + ((src1) << 5) + ((imm) << 10) + ((src2) << 16) )
+// eor dst, src1, src2, lsl #imm
+#define EOR_REG_LSL_IMM(dst, src1, src2, imm) (0x4a000000 + (dst) + ((src1) << 5) + ((imm) << 10) + ((src2) << 16) )
+// tst src, #0xff
+#define TST_0XFF(src) (0x72001c1f + ((src) << 5) )
+// tst src, #0xffff
+#define TST_0XFFFF(src) (0x72003c1f + ((src) << 5) )
+
+// shifts and bitfields
+// lsl dst, src, rreg
+#define LSLV(dst, src, rreg) (0x1ac02000 + (dst) + ((src) << 5) + ((rreg) << 16) )
+// lsr dst, src, rreg
+#define LSRV(dst, src, rreg) (0x1ac02400 + (dst) + ((src) << 5) + ((rreg) << 16) )
+// asr dst, src, rreg
+#define ASRV(dst, src, rreg) (0x1ac02800 + (dst) + ((src) << 5) + ((rreg) << 16) )
+// ror dst, src, rreg
+#define RORV(dst, src, rreg) (0x1ac02c00 + (dst) + ((src) << 5) + ((rreg) << 16) )
+// ubfm dst, src, #immr, #imms
+#define UBFM(dst, src, immr, imms) (0x53000000 + (dst) + ((src) << 5) + ((imms) << 10) + ((immr) << 16) )
+// sbfm dst, src, #immr, #imms
+#define SBFM(dst, src, immr, imms) (0x13000000 + (dst) + ((src) << 5) + ((imms) << 10) + ((immr) << 16) )
+// lsl dst, src, #imm		@	0 < imm < 32
+#define LSL_IMM(dst, src, imm) UBFM(dst, src, 32 - (imm), 31 - (imm))
+// uxtb dst, src
+#define UXTB(dst, src) UBFM(dst, src, 0, 7)
+// uxth dst, src
+#define UXTH(dst, src) UBFM(dst, src, 0, 15)
+// sxtb dst, src
+#define SXTB(dst, src) SBFM(dst, src, 0, 7)
+// sxth dst, src
+#define SXTH(dst, src) SBFM(dst, src, 0, 15)
+
+// load
+// ldr reg, [addr, #imm]		@	0 <= imm < 32768	&	imm mod 8 = 0	&	64bit
+#define LDR64_IMM(reg, addr, imm) (0xf9400000 + (reg) + ((addr) << 5) + (((imm) >> 3) << 10) )
+// ldr reg, [addr, #imm]		@	0 <= imm < 16384	&	imm mod 4 = 0
+#define LDR_IMM(reg, addr, imm) (0xb9400000 + (reg) + ((addr) << 5) + (((imm) >> 2) << 10) )
+// ldrh reg, [addr, #imm]		@	0 <= imm < 8192	&	imm mod 2 = 0
+#define LDRH_IMM(reg, addr, imm) (0x79400000 + (reg) + ((addr) << 5) + (((imm) >> 1) << 10) )
+// ldrb reg, [addr, #imm]		@	0 <= imm < 4096
+#define LDRB_IMM(reg, addr, imm) (0x39400000 + (reg) + ((addr) << 5) + ((imm) << 10) )
+// ldur reg, [addr, #imm]		@	-256 <= imm < 256	&	64bit
+#define LDUR64_IMM(reg, addr, imm) (0xf8400000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// ldur reg, [addr, #imm]		@	-256 <= imm < 256
+#define LDUR_IMM(reg, addr, imm) (0xb8400000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// ldurh reg, [addr, #imm]		@	-256 <= imm < 256
+#define LDURH_IMM(reg, addr, imm) (0x78400000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// ldurb reg, [addr, #imm]		@	-256 <= imm < 256
+#define LDURB_IMM(reg, addr, imm) (0x38400000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// ldr reg, [pc, #imm]		@	-1M <= imm < 1M	&	imm mod 4 = 0	&	64bit
+#define LDR64_PC(reg, imm) (0x58000000 + (reg) + ((((imm) >> 2) & 0x7ffff) << 5) )
+// ldr reg, [addr], #imm		@	-256 <= imm < 256	&	64bit
+#define LDR64_POST(reg, addr, imm) (0xf8400400 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// ldp reg1, reg2, [addr, #imm]		@	-512 <= imm < 512	&	imm mod 8 = 0	&	64bit
+#define LDP64_IMM(reg1, reg2, addr, imm) (0xa9400000 + (reg1) + ((addr) << 5) + ((reg2) << 10) + ((((imm) >> 3) & 0x7f) << 15) )
+// ldp reg1, reg2, [addr], #imm		@	-512 <= imm < 512	&	imm mod 8 = 0	&	64bit
+#define LDP64_POST(reg1, reg2, addr, imm) (0xa8c00000 + (reg1) + ((addr) << 5) + ((reg2) << 10) + ((((imm) >> 3) & 0x7f) << 15) )
+
+// store
+// str reg, [addr, #imm]		@	0 <= imm < 32768	&	imm mod 8 = 0	&	64bit
+#define STR64_IMM(reg, addr, imm) (0xf9000000 + (reg) + ((addr) << 5) + (((imm) >> 3) << 10) )
+// str reg, [addr, #imm]		@	0 <= imm < 16384	&	imm mod 4 = 0
+#define STR_IMM(reg, addr, imm) (0xb9000000 + (reg) + ((addr) << 5) + (((imm) >> 2) << 10) )
+// strh reg, [addr, #imm]		@	0 <= imm < 8192	&	imm mod 2 = 0
+#define STRH_IMM(reg, addr, imm) (0x79000000 + (reg) + ((addr) << 5) + (((imm) >> 1) << 10) )
+// strb reg, [addr, #imm]		@	0 <= imm < 4096
+#define STRB_IMM(reg, addr, imm) (0x39000000 + (reg) + ((addr) << 5) + ((imm) << 10) )
+// stur reg, [addr, #imm]		@	-256 <= imm < 256	&	64bit
+#define STUR64_IMM(reg, addr, imm) (0xf8000000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// stur reg, [addr, #imm]		@	-256 <= imm < 256
+#define STUR_IMM(reg, addr, imm) (0xb8000000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// sturh reg, [addr, #imm]		@	-256 <= imm < 256
+#define STURH_IMM(reg, addr, imm) (0x78000000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// sturb reg, [addr, #imm]		@	-256 <= imm < 256
+#define STURB_IMM(reg, addr, imm) (0x38000000 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// str reg, [addr, #imm]!		@	-256 <= imm < 256	&	64bit
+#define STR64_PRE(reg, addr, imm) (0xf8000c00 + (reg) + ((addr) << 5) + (((imm) & 0x1ff) << 12) )
+// stp reg1, reg2, [addr, #imm]		@	-512 <= imm < 512	&	imm mod 8 = 0	&	64bit
+#define STP64_IMM(reg1, reg2, addr, imm) (0xa9000000 + (reg1) + ((addr) << 5) + ((reg2) << 10) + ((((imm) >> 3) & 0x7f) << 15) )
+// stp reg1, reg2, [addr, #imm]!		@	-512 <= imm < 512	&	imm mod 8 = 0	&	64bit
+#define STP64_PRE(reg1, reg2, addr, imm) (0xa9800000 + (reg1) + ((addr) << 5) + ((reg2) << 10) + ((((imm) >> 3) & 0x7f) << 15) )
+
+// branch
+// condition codes
+#define COND_EQ 0x0
+#define COND_NE 0x1
+#define COND_GT 0xc
+#define COND_LE 0xd
+// b pc+imm		@	0 <= imm < 128M	&	imm mod 4 = 0
+#define B_FWD(imm) (0x14000000 + ((imm) >> 2) )
+// b.cond pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
+#define BCOND_FWD(cond, imm) (0x54000000 + (cond) + (((imm) >> 2) << 5) )
+// cbz reg, pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
+#define CBZ_FWD(reg, imm) (0x34000000 + (reg) + (((imm) >> 2) << 5) )
+// cbnz reg, pc+imm		@	0 <= imm < 1M	&	imm mod 4 = 0
+#define CBNZ_FWD(reg, imm) (0x35000000 + (reg) + (((imm) >> 2) << 5) )
+// br reg
+#define BR(reg) (0xd61f0000 + ((reg) << 5) )
+// blr reg
+#define BLR(reg) (0xd63f0000 + ((reg) << 5) )
+// ret
+#define RET (0xd65f03c0)
+// adr reg, pc+imm		@	0 <= imm < 1M
+#define ADR(reg, imm) (0x10000000 + (reg) + (((imm) & 3) << 29) + (((imm) >> 2) << 5) )
+
+
+// move a full register from reg_src to reg_dst
+static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
+	if(reg_src == reg_dst) return;
+	cache_addd( MOV_REG(reg_dst, reg_src) );      // mov reg_dst, reg_src
+}
+
+// move a 32bit constant value into dest_reg
+static void gen_mov_dword_to_reg_imm(HostReg dest_reg,Bit32u imm) {
+	if ((imm & 0xffff0000) == 0) {
+		cache_addd( MOVZ(dest_reg, imm, 0) );      // movz dest_reg, #imm
+	} else if ((imm & 0x0000ffff) == 0) {
+		cache_addd( MOVZ(dest_reg, imm >> 16, 16) );      // movz dest_reg, #(imm >> 16), lsl #16
+	} else if (((~imm) & 0xffff0000) == 0) {
+		cache_addd( MOVN(dest_reg, (~imm) & 0xffff, 0) );      // movn dest_reg, #(~imm)
+	} else if (((~imm) & 0x0000ffff) == 0) {
+		cache_addd( MOVN(dest_reg, (~imm) >> 16, 16) );      // movn dest_reg, #(~imm >> 16), lsl #16
+	} else {
+		cache_addd( MOVZ(dest_reg, imm & 0xffff, 0) );      // movz dest_reg, #(imm & 0xffff)
+		cache_addd( MOVK(dest_reg, imm >> 16, 16) );      // movk dest_reg, #(imm >> 16), lsl #16
+	}
+}
+
+// move a 64bit constant value into dest_reg
+static void gen_mov_qword_to_reg_imm(HostReg dest_reg,Bit64u imm) {
+	bool first=true;
+	for (Bitu shift=0; shift<64; shift+=16) {
+		Bit32u part=(Bit32u)(imm >> shift) & 0xffff;
+		if (!part) continue;
+		if (first) {
+			cache_addd( MOVZ64(dest_reg, part, shift) );      // movz dest_reg, #part, lsl #shift
+			first=false;
+		} else {
+			cache_addd( MOVK64(dest_reg, part, shift) );      // movk dest_reg, #part, lsl #shift
+		}
+	}
+	if (first) cache_addd( MOVZ64(dest_reg, 0, 0) );      // movz dest_reg, #0
+}
+
+// helper function, true if [base + offset] can be encoded in a single load/store of size bytes
+static bool gen_offset_ok(Bit64s offset,Bitu size) {
+	if ((offset >= 0) && (offset < (Bit64s)(4096*size)) && ((offset & (size-1)) == 0)) return true;
+	return (offset >= -256) && (offset < 256);
+}
+
+// helper function, find a register and an offset that can be used to access data
+// the addresses of cpu_regs, Segs and core_dynrec are kept in registers,
+// everything else gets its address loaded into temp1
+static HostReg gen_memaddr(void* data,Bitu size,Bit64s & offset) {
+	offset=(Bit64s)((Bit64u)data - (Bit64u)&cpu_regs);
+	if (gen_offset_ok(offset, size)) return FC_REGS_ADDR;
+	offset=(Bit64s)((Bit64u)data - (Bit64u)&Segs);
+	if (gen_offset_ok(offset, size)) return FC_SEGS_ADDR;
+	offset=(Bit64s)((Bit64u)data - (Bit64u)&core_dynrec.readdata);
+	if (gen_offset_ok(offset, size)) return readdata_addr;
+	gen_mov_qword_to_reg_imm(temp1, (Bit64u)data);
+	offset=0;
+	return temp1;
+}
+
+// load size bytes from [addr_reg + offset] into dest_reg
+static void gen_mov_memval_to_reg(HostReg dest_reg,HostReg addr_reg,Bit64s offset,Bitu size) {
+	bool scaled=(offset >= 0) && ((offset & (size-1)) == 0) && (offset < (Bit64s)(4096*size));
+	Bit32u imm=(Bit32u)offset;
+	switch (size) {
+		case 8:
+			cache_addd( scaled ? LDR64_IMM(dest_reg, addr_reg, imm) : LDUR64_IMM(dest_reg, addr_reg, imm) );      // ldr dest_reg, [addr_reg, #offset]
+			break;
+		case 4:
+			cache_addd( scaled ? LDR_IMM(dest_reg, addr_reg, imm) : LDUR_IMM(dest_reg, addr_reg, imm) );      // ldr dest_reg, [addr_reg, #offset]
+			break;
+		case 2:
+			cache_addd( scaled ? LDRH_IMM(dest_reg, addr_reg, imm) : LDURH_IMM(dest_reg, addr_reg, imm) );      // ldrh dest_reg, [addr_reg, #offset]
+			break;
+		default:
+			cache_addd( scaled ? LDRB_IMM(dest_reg, addr_reg, imm) : LDURB_IMM(dest_reg, addr_reg, imm) );      // ldrb dest_reg, [addr_reg, #offset]
+			break;
+	}
+}
+
+// store the lower size bytes of src_reg into [addr_reg + offset]
+static void gen_mov_memval_from_reg(HostReg src_reg,HostReg addr_reg,Bit64s offset,Bitu size) {
+	bool scaled=(offset >= 0) && ((offset & (size-1)) == 0) && (offset < (Bit64s)(4096*size));
+	Bit32u imm=(Bit32u)offset;
+	switch (size) {
+		case 8:
+			cache_addd( scaled ? STR64_IMM(src_reg, addr_reg, imm) : STUR64_IMM(src_reg, addr_reg, imm) );      // str src_reg, [addr_reg, #offset]
+			break;
+		case 4:
+			cache_addd( scaled ? STR_IMM(src_reg, addr_reg, imm) : STUR_IMM(src_reg, addr_reg, imm) );      // str src_reg, [addr_reg, #offset]
+			break;
+		case 2:
+			cache_addd( scaled ? STRH_IMM(src_reg, addr_reg, imm) : STURH_IMM(src_reg, addr_reg, imm) );      // strh src_reg, [addr_reg, #offset]
+			break;
+		default:
+			cache_addd( scaled ? STRB_IMM(src_reg, addr_reg, imm) : STURB_IMM(src_reg, addr_reg, imm) );      // strb src_reg, [addr_reg, #offset]
+			break;
+	}
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from memory into dest_reg
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_word_to_reg(HostReg dest_reg,void* data,bool dword) {
+	Bit64s offset;
+	HostReg addr_reg=gen_memaddr(data, dword ? 4 : 2, offset);
+	gen_mov_memval_to_reg(dest_reg, addr_reg, offset, dword ? 4 : 2);
+}
+
+// move a 16bit constant value into dest_reg
+// the upper 16bit of the destination register may be destroyed
+static void INLINE gen_mov_word_to_reg_imm(HostReg dest_reg,Bit16u imm) {
+	cache_addd( MOVZ(dest_reg, imm, 0) );      // movz dest_reg, #imm
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into memory
+static void gen_mov_word_from_reg(HostReg src_reg,void* dest,bool dword) {
+	Bit64s offset;
+	HostReg addr_reg=gen_memaddr(dest, dword ? 4 : 2, offset);
+	gen_mov_memval_from_reg(src_reg, addr_reg, offset, dword ? 4 : 2);
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_byte_to_reg_low(HostReg dest_reg,void* data) {
+	Bit64s offset;
+	HostReg addr_reg=gen_memaddr(data, 1, offset);
+	gen_mov_memval_to_reg(dest_reg, addr_reg, offset, 1);
+}
+
+// move an 8bit value from memory into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_byte_to_reg_low_canuseword(HostReg dest_reg,void* data) {
+	gen_mov_byte_to_reg_low(dest_reg, data);
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_byte_to_reg_low_imm(HostReg dest_reg,Bit8u imm) {
+	cache_addd( MOVZ(dest_reg, imm, 0) );      // movz dest_reg, #imm
+}
+
+// move an 8bit constant value into dest_reg
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_byte_to_reg_low_imm_canuseword(HostReg dest_reg,Bit8u imm) {
+	gen_mov_byte_to_reg_low_imm(dest_reg, imm);
+}
+
+// move the lowest 8bit of a register into memory
+static void gen_mov_byte_from_reg_low(HostReg src_reg,void* dest) {
+	Bit64s offset;
+	HostReg addr_reg=gen_memaddr(dest, 1, offset);
+	gen_mov_memval_from_reg(src_reg, addr_reg, offset, 1);
+}
+
+
+
+// convert an 8bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_byte(bool sign,HostReg reg) {
+	if (sign) {
+		cache_addd( SXTB(reg, reg) );      // sxtb reg, reg
+	} else {
+		cache_addd( UXTB(reg, reg) );      // uxtb reg, reg
+	}
+}
+
+// convert a 16bit word to a 32bit dword
+// the register is zero-extended (sign==false) or sign-extended (sign==true)
+static void gen_extend_word(bool sign,HostReg reg) {
+	if (sign) {
+		cache_addd( SXTH(reg, reg) );      // sxth reg, reg
+	} else {
+		cache_addd( UXTH(reg, reg) );      // uxth reg, reg
+	}
+}
+
+// add a 32bit value from memory to a full register
+static void gen_add(HostReg reg,void* op) {
+	gen_mov_word_to_reg(temp3, op, 1);
+	cache_addd( ADD_REG_LSL_IMM(reg, reg, temp3, 0) );      // add reg, reg, temp3
+}
+
+// add a 32bit constant value to a full register
+static void gen_add_imm(HostReg reg,Bit32u imm) {
+	Bit32u neg;
+	if(!imm) return;
+	neg = (Bit32u)(-((Bit32s)imm));
+	if (imm < 0x1000) {
+		cache_addd( ADD_IMM(reg, reg, imm, 0) );      // add reg, reg, #imm
+	} else if (neg < 0x1000) {
+		cache_addd( SUB_IMM(reg, reg, neg, 0) );      // sub reg, reg, #(-imm)
+	} else if (imm < 0x1000000) {
+		if (imm & 0xfff) cache_addd( ADD_IMM(reg, reg, imm & 0xfff, 0) );      // add reg, reg, #(imm & 0xfff)
+		cache_addd( ADD_IMM(reg, reg, imm >> 12, 12) );      // add reg, reg, #(imm >> 12), lsl #12
+	} else if (neg < 0x1000000) {
+		if (neg & 0xfff) cache_addd( SUB_IMM(reg, reg, neg & 0xfff, 0) );      // sub reg, reg, #(-imm & 0xfff)
+		cache_addd( SUB_IMM(reg, reg, neg >> 12, 12) );      // sub reg, reg, #(-imm >> 12), lsl #12
+	} else {
+		gen_mov_dword_to_reg_imm(temp2, imm);
+		cache_addd( ADD_REG_LSL_IMM(reg, reg, temp2, 0) );      // add reg, reg, temp2
+	}
+}
+
+// and a 32bit constant value with a full register
+static void gen_and_imm(HostReg reg,Bit32u imm) {
+	if (imm == 0xffffffff) return;
+	if (!imm) {
+		cache_addd( MOVZ(reg, 0, 0) );      // movz reg, #0
+	} else if (imm == 0xff) {
+		cache_addd( UXTB(reg, reg) );      // uxtb reg, reg
+	} else if (imm == 0xffff) {
+		cache_addd( UXTH(reg, reg) );      // uxth reg, reg
+	} else {
+		gen_mov_dword_to_reg_imm(temp2, imm);
+		cache_addd( AND_REG_LSL_IMM(reg, reg, temp2, 0) );      // and reg, reg, temp2
+	}
+}
+
+
+// move a 32bit constant value into memory
+static void gen_mov_direct_dword(void* dest,Bit32u imm) {
+	gen_mov_dword_to_reg_imm(temp3, imm);
+	gen_mov_word_from_reg(temp3, dest, 1);
+}
+
+// move an address into memory
+static void INLINE gen_mov_direct_ptr(void* dest,DRC_PTR_SIZE_IM imm) {
+	Bit64s offset;
+	gen_mov_qword_to_reg_imm(temp3, imm);
+	HostReg addr_reg=gen_memaddr(dest, 8, offset);
+	gen_mov_memval_from_reg(temp3, addr_reg, offset, 8);
+}
+
+// add a 32bit (dword==true) or 16bit (dword==false) constant value to a memory value
+static void gen_add_direct_word(void* dest,Bit32u imm,bool dword) {
+	Bit64s offset;
+	if(!imm) return;
+	HostReg addr_reg=gen_memaddr(dest, dword ? 4 : 2, offset);
+	gen_mov_memval_to_reg(temp3, addr_reg, offset, dword ? 4 : 2);
+	gen_add_imm(temp3, imm);
+	gen_mov_memval_from_reg(temp3, addr_reg, offset, dword ? 4 : 2);
+}
+
+// subtract a 32bit (dword==true) or 16bit (dword==false) constant value from a memory value
+static void gen_sub_direct_word(void* dest,Bit32u imm,bool dword) {
+	if(!imm) return;
+	gen_add_direct_word(dest, (Bit32u)(-((Bit32s)imm)), dword);
+}
+
+// effective address calculation, destination is dest_reg
+// scale_reg is scaled by scale (scale_reg*(2^scale)) and
+// added to dest_reg, then the immediate value is added
+static INLINE void gen_lea(HostReg dest_reg,HostReg scale_reg,Bitu scale,Bits imm) {
+	cache_addd( ADD_REG_LSL_IMM(dest_reg, dest_reg, scale_reg, scale) );      // add dest_reg, dest_reg, scale_reg, lsl #(scale)
+	gen_add_imm(dest_reg, (Bit32u)imm);
+}
+
+// effective address calculation, destination is dest_reg
+// dest_reg is scaled by scale (dest_reg*(2^scale)),
+// then the immediate value is added
+static INLINE void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
+	if (scale) {
+		cache_addd( LSL_IMM(dest_reg, dest_reg, scale) );      // lsl dest_reg, dest_reg, #(scale)
+	}
+	gen_add_imm(dest_reg, (Bit32u)imm);
+}
+
+// helper function, align the literal of the following call sequence to 8 bytes
+static void INLINE gen_call_function_align(void) {
+	if (((Bit64u)cache.pos + 12) & 7) cache_addd( NOP );      // nop
+}
+
+// helper function, the call sequence is 20 bytes long, gen_fill_function_ptr relies on that layout
+static void INLINE gen_call_function_helper(void * func) {
+	cache_addd( LDR64_PC(temp1, 12) );      // ldr temp1, [pc, #12]
+	cache_addd( BLR(temp1) );      // blr temp1
+	cache_addd( B_FWD(12) );      // b (pc+12)
+	cache_addq((Bit64u)func);      // .quad func
+}
+
+// generate a call to a parameterless function
+static void INLINE gen_call_function_raw(void * func) {
+	gen_call_function_align();
+	gen_call_function_helper(func);
+}
+
+// generate a call to a function with paramcount parameters
+// note: the parameters are loaded in the architecture specific way
+// using the gen_load_param_ functions below
+static Bit64u INLINE gen_call_function_setup(void * func,Bitu paramcount,bool fastcall=false) {
+	gen_call_function_align();
+	Bit64u proc_addr = (Bit64u)cache.pos;
+	gen_call_function_helper(func);
+	return proc_addr;
+}
+
+// max of 8 parameters in x0-x7
+
+// load an immediate value as param'th function parameter
+static void INLINE gen_load_param_imm(Bitu imm,Bitu param) {
+	gen_mov_dword_to_reg_imm(param, (Bit32u)imm);
+}
+
+// load an address as param'th function parameter
+static void INLINE gen_load_param_addr(DRC_PTR_SIZE_IM addr,Bitu param) {
+	gen_mov_qword_to_reg_imm(param, addr);
+}
+
+// load a host-register as param'th function parameter
+static void INLINE gen_load_param_reg(Bitu reg,Bitu param) {
+	gen_mov_regs(param, reg);
+}
+
+// load a value from memory as param'th function parameter
+static void INLINE gen_load_param_mem(Bitu mem,Bitu param) {
+	gen_mov_word_to_reg(param, (void *)mem, 1);
+}
+
+// jump to an address pointed at by ptr, offset is in imm
+static void gen_jmp_ptr(void * ptr,Bits imm=0) {
+	Bit64s offset;
+	HostReg addr_reg=gen_memaddr(ptr, 8, offset);
+	gen_mov_memval_to_reg(temp3, addr_reg, offset, 8);
+
+	if (gen_offset_ok(imm, 8)) {
+		gen_mov_memval_to_reg(temp1, temp3, imm, 8);
+	} else {
+		gen_mov_qword_to_reg_imm(temp2, (Bit64u)imm);
+		cache_addd( 0x8b000000 + temp3 + (temp3 << 5) + (temp2 << 16) );      // add temp3, temp3, temp2 (64bit)
+		gen_mov_memval_to_reg(temp1, temp3, 0, 8);
+	}
+
+	cache_addd( BR(temp1) );      // br temp1
+}
+
+// short conditional jump (+-127 bytes) if register is zero
+// the destination is set by gen_fill_branch() later
+static Bit64u gen_create_branch_on_zero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( CBZ_FWD(reg, 0) );      // cbz reg, j
+	} else {
+		cache_addd( TST_0XFFFF(reg) );      // tst reg, #0xffff
+		cache_addd( BCOND_FWD(COND_EQ, 0) );      // b.eq j
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// short conditional jump (+-127 bytes) if register is nonzero
+// the destination is set by gen_fill_branch() later
+static Bit64u gen_create_branch_on_nonzero(HostReg reg,bool dword) {
+	if (dword) {
+		cache_addd( CBNZ_FWD(reg, 0) );      // cbnz reg, j
+	} else {
+		cache_addd( TST_0XFFFF(reg) );      // tst reg, #0xffff
+		cache_addd( BCOND_FWD(COND_NE, 0) );      // b.ne j
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// calculate relative offset and fill it into the location pointed to by data
+// cbz, cbnz and b.cond all keep their 19bit offset in bits 5-23
+static void INLINE gen_fill_branch(DRC_PTR_SIZE_IM data) {
+#if C_DEBUG
+	Bit64s len=(Bit64u)cache.pos-data;
+	if (len<0) len=-len;
+	if (len>=0x00100000) LOG_MSG("Big jump %d",len);
+#endif
+	*(Bit32u*)data=( (*(Bit32u*)data) & 0xff00001f ) | ( ( ((Bit32u)((Bit64u)cache.pos - data)) << 3 ) & 0x00ffffe0 );
+}
+
+// conditional jump if register is nonzero
+// for isdword==true the 32bit of the register are tested
+// for isdword==false the lowest 8bit of the register are tested
+static Bit64u gen_create_branch_long_nonzero(HostReg reg,bool isdword) {
+	if (isdword) {
+		cache_addd( CBNZ_FWD(reg, 0) );      // cbnz reg, j
+	} else {
+		cache_addd( TST_0XFF(reg) );      // tst reg, #0xff
+		cache_addd( BCOND_FWD(COND_NE, 0) );      // b.ne j
+	}
+	return ((Bit64u)cache.pos-4);
+}
+
+// compare 32bit-register against zero and jump if value less/equal than zero
+static Bit64u gen_create_branch_long_leqzero(HostReg reg) {
+	cache_addd( CMP_IMM(reg, 0) );      // cmp reg, #0
+	cache_addd( BCOND_FWD(COND_LE, 0) );      // b.le j
+	return ((Bit64u)cache.pos-4);
+}
+
+// calculate long relative offset and fill it into the location pointed to by data
+// the targets are always inside the current block so the 19bit offset (+-1MB) is enough
+static void INLINE gen_fill_branch_long(Bit64u data) {
+	gen_fill_branch(data);
+}
+
+static void gen_run_code(void) {
+	Bit8u * pos = cache.pos;
+
+	cache_addd( STP64_PRE(HOST_fp, HOST_lr, HOST_sp, -64) );      // stp fp, lr, [sp, #-64]!
+	cache_addd( STP64_IMM(FC_ADDR, FC_REGS_ADDR, HOST_sp, 16) );      // stp FC_ADDR, FC_REGS_ADDR, [sp, #16]
+	cache_addd( STP64_IMM(FC_SEGS_ADDR, readdata_addr, HOST_sp, 32) );      // stp FC_SEGS_ADDR, readdata_addr, [sp, #32]
+
+	// adr: 12
+	cache_addd( LDR64_PC(FC_REGS_ADDR, 64 - 12) );      // ldr FC_REGS_ADDR, [pc, #(&cpu_regs)]
+	// adr: 16
+	cache_addd( LDR64_PC(FC_SEGS_ADDR, 72 - 16) );      // ldr FC_SEGS_ADDR, [pc, #(&Segs)]
+	// adr: 20
+	cache_addd( LDR64_PC(readdata_addr, 80 - 20) );      // ldr readdata_addr, [pc, #(&core_dynrec.readdata)]
+
+	// adr: 24
+	cache_addd( ADR(HOST_lr, 36 - 24) );      // adr lr, (pc+12)
+	cache_addd( STR64_PRE(HOST_lr, HOST_sp, -16) );      // str lr, [sp, #-16]!
+	cache_addd( BR(HOST_r0) );      // br x0
+
+	// adr: 36, the blocks return here through gen_return_function
+	cache_addd( LDP64_IMM(FC_SEGS_ADDR, readdata_addr, HOST_sp, 32) );      // ldp FC_SEGS_ADDR, readdata_addr, [sp, #32]
+	cache_addd( LDP64_IMM(FC_ADDR, FC_REGS_ADDR, HOST_sp, 16) );      // ldp FC_ADDR, FC_REGS_ADDR, [sp, #16]
+	cache_addd( LDP64_POST(HOST_fp, HOST_lr, HOST_sp, 64) );      // ldp fp, lr, [sp], #64
+	cache_addd( RET );      // ret
+
+	// fill up to 64 bytes
+	while (cache.pos < pos + 64) cache_addd( NOP );      // nop
+
+	// adr: 64
+	cache_addq((Bit64u)&cpu_regs);      // address of "cpu_regs"
+	// adr: 72
+	cache_addq((Bit64u)&Segs);      // address of "Segs"
+	// adr: 80
+	cache_addq((Bit64u)&core_dynrec.readdata);      // address of "core_dynrec.readdata"
+}
+
+// return from a function
+static void gen_return_function(void) {
+	cache_addd( LDR64_POST(HOST_lr, HOST_sp, 16) );      // ldr lr, [sp], #16
+	cache_addd( RET );      // ret
+}
+
+#ifdef DRC_FLAGS_INVALIDATION
+
+// called when a call to a function can be replaced by a
+// call to a simpler function
+// pos points to the 20 bytes call sequence of gen_call_function_setup
+static void gen_fill_function_ptr(Bit8u * pos,void* fct_ptr,Bitu flags_type) {
+#ifdef DRC_FLAGS_INVALIDATION_DCODE
+	// try to avoid function calls but rather directly fill in code
+	switch (flags_type) {
+		case t_ADDb:
+		case t_ADDw:
+		case t_ADDd:
+			*(Bit32u*)pos=ADD_REG_LSL_IMM(FC_RETOP, HOST_r0, HOST_r1, 0);	// add FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_ORb:
+		case t_ORw:
+		case t_ORd:
+			*(Bit32u*)pos=ORR_REG_LSL_IMM(FC_RETOP, HOST_r0, HOST_r1, 0);	// orr FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_ANDb:
+		case t_ANDw:
+		case t_ANDd:
+			*(Bit32u*)pos=AND_REG_LSL_IMM(FC_RETOP, HOST_r0, HOST_r1, 0);	// and FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_SUBb:
+		case t_SUBw:
+		case t_SUBd:
+			*(Bit32u*)pos=SUB_REG_LSL_IMM(FC_RETOP, HOST_r0, HOST_r1, 0);	// sub FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_XORb:
+		case t_XORw:
+		case t_XORd:
+			*(Bit32u*)pos=EOR_REG_LSL_IMM(FC_RETOP, HOST_r0, HOST_r1, 0);	// eor FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_CMPb:
+		case t_CMPw:
+		case t_CMPd:
+		case t_TESTb:
+		case t_TESTw:
+		case t_TESTd:
+			*(Bit32u*)pos=B_FWD(20);				// b (pc+20)
+			break;
+		case t_INCb:
+		case t_INCw:
+		case t_INCd:
+			*(Bit32u*)pos=ADD_IMM(FC_RETOP, HOST_r0, 1, 0);	// add FC_RETOP, x0, #1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_DECb:
+		case t_DECw:
+		case t_DECd:
+			*(Bit32u*)pos=SUB_IMM(FC_RETOP, HOST_r0, 1, 0);	// sub FC_RETOP, x0, #1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_SHLb:
+		case t_SHLw:
+		case t_SHLd:
+			*(Bit32u*)pos=LSLV(FC_RETOP, HOST_r0, HOST_r1);	// lsl FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_SHRb:
+			*(Bit32u*)pos=UXTB(FC_RETOP, HOST_r0);				// uxtb FC_RETOP, x0
+			*(Bit32u*)(pos+4)=LSRV(FC_RETOP, FC_RETOP, HOST_r1);	// lsr FC_RETOP, FC_RETOP, x1
+			// the branch at pos+8 skips the literal
+			break;
+		case t_SHRw:
+			*(Bit32u*)pos=UXTH(FC_RETOP, HOST_r0);				// uxth FC_RETOP, x0
+			*(Bit32u*)(pos+4)=LSRV(FC_RETOP, FC_RETOP, HOST_r1);	// lsr FC_RETOP, FC_RETOP, x1
+			break;
+		case t_SHRd:
+			*(Bit32u*)pos=LSRV(FC_RETOP, HOST_r0, HOST_r1);	// lsr FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_SARb:
+			*(Bit32u*)pos=SXTB(FC_RETOP, HOST_r0);				// sxtb FC_RETOP, x0
+			*(Bit32u*)(pos+4)=ASRV(FC_RETOP, FC_RETOP, HOST_r1);	// asr FC_RETOP, FC_RETOP, x1
+			break;
+		case t_SARw:
+			*(Bit32u*)pos=SXTH(FC_RETOP, HOST_r0);				// sxth FC_RETOP, x0
+			*(Bit32u*)(pos+4)=ASRV(FC_RETOP, FC_RETOP, HOST_r1);	// asr FC_RETOP, FC_RETOP, x1
+			break;
+		case t_SARd:
+			*(Bit32u*)pos=ASRV(FC_RETOP, HOST_r0, HOST_r1);	// asr FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_RORd:
+			*(Bit32u*)pos=RORV(FC_RETOP, HOST_r0, HOST_r1);	// ror FC_RETOP, x0, x1
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		case t_ROLd:
+			*(Bit32u*)pos=NEG(HOST_r1, HOST_r1);				// neg x1, x1
+			*(Bit32u*)(pos+4)=RORV(FC_RETOP, HOST_r0, HOST_r1);	// ror FC_RETOP, x0, x1
+			break;
+		case t_NEGb:
+		case t_NEGw:
+		case t_NEGd:
+			*(Bit32u*)pos=NEG(FC_RETOP, HOST_r0);	// neg FC_RETOP, x0
+			*(Bit32u*)(pos+4)=B_FWD(16);				// b (pc+16)
+			break;
+		default:
+			*(Bit64u*)(pos+12)=(Bit64u)fct_ptr;		// simple_func
+			break;
+
+	}
+#else
+	*(Bit64u*)(pos+12)=(Bit64u)fct_ptr;		// simple_func
+#endif
+}
+#endif
+
+static void cache_block_before_close(void) { }
+
+#ifdef IPHONEOS
+/* This is implemented in libc, but no prototype */
+extern "C" void sys_icache_invalidate(const void* Addr, size_t len);
+
+static void cache_block_closing(Bit8u* block_start,Bitu block_size) {
+	sys_icache_invalidate(block_start, block_size);
+}
+#else
+static void cache_block_closing(Bit8u* block_start,Bitu block_size) {
+	__builtin___clear_cache((char *)block_start, (char *)(block_start+block_size));
+}
+#endif
+
+#ifdef DRC_USE_SEGS_ADDR
+
+// mov 16bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_seg16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRH_IMM(dest_reg, FC_SEGS_ADDR, index) );      // ldrh dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// mov 32bit value from Segs[index] into dest_reg using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_seg32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDR_IMM(dest_reg, FC_SEGS_ADDR, index) );      // ldr dest_reg, [FC_SEGS_ADDR, #index]
+}
+
+// add a 32bit value from Segs[index] to a full register using FC_SEGS_ADDR (index modulo 4 must be zero)
+static void gen_add_seg32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LDR_IMM(temp1, FC_SEGS_ADDR, index) );      // ldr temp1, [FC_SEGS_ADDR, #index]
+	cache_addd( ADD_REG_LSL_IMM(reg, reg, temp1, 0) );      // add reg, reg, temp1
+}
+
+#endif
+
+#ifdef DRC_USE_REGS_ADDR
+
+// mov 16bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regval16_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRH_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldrh dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// mov 32bit value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_to_reg(HostReg dest_reg,Bitu index) {
+	cache_addd( LDR_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldr dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move a 32bit (dword==true) or 16bit (dword==false) value from cpu_regs[index] into dest_reg using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+// 16bit moves may destroy the upper 16bit of the destination register
+static void gen_mov_regword_to_reg(HostReg dest_reg,Bitu index,bool dword) {
+	if (dword) {
+		cache_addd( LDR_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldr dest_reg, [FC_REGS_ADDR, #index]
+	} else {
+		cache_addd( LDRH_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldrh dest_reg, [FC_REGS_ADDR, #index]
+	}
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function does not use FC_OP1/FC_OP2 as dest_reg as these
+// registers might not be directly byte-accessible on some architectures
+static void gen_mov_regbyte_to_reg_low(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRB_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldrb dest_reg, [FC_REGS_ADDR, #index]
+}
+
+// move an 8bit value from cpu_regs[index]  into dest_reg using FC_REGS_ADDR
+// the upper 24bit of the destination register can be destroyed
+// this function can use FC_OP1/FC_OP2 as dest_reg which are
+// not directly byte-accessible on some architectures
+static void INLINE gen_mov_regbyte_to_reg_low_canuseword(HostReg dest_reg,Bitu index) {
+	cache_addd( LDRB_IMM(dest_reg, FC_REGS_ADDR, index) );      // ldrb dest_reg, [FC_REGS_ADDR, #index]
+}
+
+
+// add a 32bit value from cpu_regs[index] to a full register using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_add_regval32_to_reg(HostReg reg,Bitu index) {
+	cache_addd( LDR_IMM(temp2, FC_REGS_ADDR, index) );      // ldr temp2, [FC_REGS_ADDR, #index]
+	cache_addd( ADD_REG_LSL_IMM(reg, reg, temp2, 0) );      // add reg, reg, temp2
+}
+
+
+// move 16bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 2 must be zero)
+static void gen_mov_regval16_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( STRH_IMM(src_reg, FC_REGS_ADDR, index) );      // strh src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit of register into cpu_regs[index] using FC_REGS_ADDR (index modulo 4 must be zero)
+static void gen_mov_regval32_from_reg(HostReg src_reg,Bitu index) {
+	cache_addd( STR_IMM(src_reg, FC_REGS_ADDR, index) );      // str src_reg, [FC_REGS_ADDR, #index]
+}
+
+// move 32bit (dword==true) or 16bit (dword==false) of a register into cpu_regs[index] using FC_REGS_ADDR (if dword==true index modulo 4 must be zero) (if dword==false index modulo 2 must be zero)
+static void gen_mov_regword_from_reg(HostReg src_reg,Bitu index,bool dword) {
+	if (dword) {
+		cache_addd( STR_IMM(src_reg, FC_REGS_ADDR, index) );      // str src_reg, [FC_REGS_ADDR, #index]
+	} else {
+		cache_addd( STRH_IMM(src_reg, FC_REGS_ADDR, index) );      // strh src_reg, [FC_REGS_ADDR, #index]
+	}
+}
+
+// move the lowest 8bit of a register into cpu_regs[index] using FC_REGS_ADDR
+static void gen_mov_regbyte_from_reg_low(HostReg src_reg,Bitu index) {
+	cache_addd( STRB_IMM(src_reg, FC_REGS_ADDR, index) );      // strb src_reg, [FC_REGS_ADDR, #index]
+}
+
+#endif
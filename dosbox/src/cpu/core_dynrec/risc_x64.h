@@ -84,8 +84,10 @@ static void gen_mov_regs(HostReg reg_dst,HostReg reg_src) {
 }
 
 
-static INLINE void gen_memaddr(HostReg reg,void* data) {
-	Bit64s diff = (Bit64s)data-((Bit64s)cache.pos+5);
+// off is the size of an immediate that follows the address, as
+// RIP-relative addressing counts from the end of the instruction
+static INLINE void gen_memaddr(HostReg reg,void* data,Bitu off=0) {
+	Bit64s diff = (Bit64s)data-((Bit64s)cache.pos+5+(Bit64s)off);
 	if ((diff<0x80000000LL) && (diff>-0x80000000LL)) {
 		cache_addb(0x05+(reg<<3));
 		// RIP-relative addressing is offset after the instruction 
@@ -212,9 +214,8 @@ static void gen_and_imm(HostReg reg,Bit32u imm) {
 
 // move a 32bit constant value into memory
 static void gen_mov_direct_dword(void* dest,Bit32u imm) {
-	cache_addw(0x04c7);					// mov [data],imm
-	cache_addb(0x25);
-	cache_addd((Bit32u)(((Bit64u)dest)&0xffffffffLL));
+	cache_addb(0xc7);					// mov [data],imm
+	gen_memaddr(0,dest,4);
 	cache_addd(imm);
 }
 
@@ -235,9 +236,8 @@ static void INLINE gen_mov_direct_ptr(void* dest,DRC_PTR_SIZE_IM imm) {
 
 // add an 8bit constant value to a memory value
 static void gen_add_direct_byte(void* dest,Bit8s imm) {
-	cache_addw(0x0483);					// add [data],imm
-	cache_addb(0x25);
-	cache_addd((Bit32u)(((Bit64u)dest)&0xffffffffLL));
+	cache_addb(0x83);					// add [data],imm
+	gen_memaddr(0,dest,1);
 	cache_addb(imm);
 }
 
@@ -248,18 +248,16 @@ static void gen_add_direct_word(void* dest,Bit32u imm,bool dword) {
 		return;
 	}
 	if (!dword) cache_addb(0x66);
-	cache_addw(0x0481);					// add [data],imm
-	cache_addb(0x25);
-	cache_addd((Bit32u)(((Bit64u)dest)&0xffffffffLL));
+	cache_addb(0x81);					// add [data],imm
+	gen_memaddr(0,dest,dword ? 4 : 2);
 	if (dword) cache_addd((Bit32u)imm);
 	else cache_addw((Bit16u)imm);
 }
 
 // subtract an 8bit constant value from a memory value
 static void gen_sub_direct_byte(void* dest,Bit8s imm) {
-	cache_addw(0x2c83);					// sub [data],imm
-	cache_addb(0x25);
-	cache_addd((Bit32u)(((Bit64u)dest)&0xffffffffLL));
+	cache_addb(0x83);					// sub [data],imm
+	gen_memaddr(5,dest,1);				// /5 selects sub
 	cache_addb(imm);
 }
 
@@ -270,9 +268,8 @@ static void gen_sub_direct_word(void* dest,Bit32u imm,bool dword) {
 		return;
 	}
 	if (!dword) cache_addb(0x66);
-	cache_addw(0x2c81);					// sub [data],imm
-	cache_addb(0x25);
-	cache_addd((Bit32u)(((Bit64u)dest)&0xffffffffLL));
+	cache_addb(0x81);					// sub [data],imm
+	gen_memaddr(5,dest,dword ? 4 : 2);
 	if (dword) cache_addd((Bit32u)imm);
 	else cache_addw((Bit16u)imm);
 }
@@ -544,8 +544,10 @@
 		break;
 	CASE_D(0xe2)												/* LOOP */
 		if (TEST_PREFIX_ADDR) {	
+			SkipLoopSelf(reg_ecx);
 			JumpCond32_b(--reg_ecx);
 		} else {
+			SkipLoopSelf(reg_cx);
 			JumpCond32_b(--reg_cx);
 		}
 		break;
@@ -600,6 +602,7 @@
 			Bit32s addip=Fetchbs();
 			SAVEIP;
 			reg_eip+=addip;
+			if (GCC_UNLIKELY(addip==-2)) CPU_Idle();
 			continue;
 		}
 	CASE_D(0xed)												/* IN EAX,DX */
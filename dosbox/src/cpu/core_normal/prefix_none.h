@@ -860,8 +860,10 @@
 		break;
 	CASE_W(0xe2)												/* LOOP */
 		if (TEST_PREFIX_ADDR) {	
+			SkipLoopSelf(reg_ecx);
 			JumpCond16_b(--reg_ecx);
 		} else {
+			SkipLoopSelf(reg_cx);
 			JumpCond16_b(--reg_cx);
 		}
 		break;
@@ -930,6 +932,8 @@
 			Bit16s addip=Fetchbs();
 			SAVEIP;
 			reg_eip=(Bit16u)(reg_eip+addip);
+			/* jmp $ just waits for an interrupt */
+			if (GCC_UNLIKELY(addip==-2)) CPU_Idle();
 			continue;
 		}
 	CASE_B(0xec)												/* IN AL,DX */
@@ -52,6 +52,20 @@ static INLINE Bit32s Fetchds() {
 		continue;											\
 	}
 
+/* LOOP $ only counts down (e)cx, do as many rounds as the cycles allow at once */
+#define SkipLoopSelf(COUNT) {						\
+	Bit8s disp=Fetchbs();core.cseip-=1;				\
+	if (GCC_UNLIKELY(disp==-2) && COUNT>1) {		\
+		Bits skip=(Bits)COUNT-1;					\
+		if (skip>CPU_Cycles) skip=CPU_Cycles;		\
+		if (skip>0) {								\
+			COUNT-=skip;							\
+			CPU_Cycles-=skip;						\
+			CPU_IODelayRemoved+=skip;				\
+		}											\
+	}												\
+}
+
 //TODO Could probably make all byte operands fast?
 #define JumpCond16_b(COND) {						\
 	SAVEIP;											\
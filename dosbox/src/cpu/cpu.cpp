@@ -30,6 +30,9 @@
 #include "paging.h"
 #include "lazyflags.h"
 #include "support.h"
+#include "savestate.h"
+#include "timer.h"
+#include "benchmark.h"
 
 Bitu DEBUG_EnableDebugger(void);
 extern void GFX_SetTitle(Bit32s cycles ,Bits frameskip,bool paused);
@@ -79,6 +82,7 @@ void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_Cache_Configure(Bitu size,bool adaptive);
 void CPU_Core_Dynrec_Cache_Close(void);
 #endif
 
@@ -2043,19 +2047,27 @@ bool CPU_CPUID(void) {
 	return true;
 }
 
+void CPU_Idle(void) {
+	if (CPU_Cycles>0) {
+		BENCH_Count(BENCH_COUNT_IDLE,CPU_Cycles);
+		CPU_IODelayRemoved+=CPU_Cycles;
+		CPU_Cycles=0;
+	}
+}
+
 static Bits HLT_Decode(void) {
 	/* Once an interrupt occurs, it should change cpu core */
 	if (reg_eip!=cpu.hlt.eip || SegValue(cs) != cpu.hlt.cs) {
 		cpudecoder=cpu.hlt.old_decoder;
 	} else {
-		CPU_Cycles=0;
+		CPU_Idle();
 	}
 	return 0;
 }
 
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
-	CPU_Cycles=0;
+	CPU_Idle();
 	cpu.hlt.cs=SegValue(cs);
 	cpu.hlt.eip=reg_eip;
 	cpu.hlt.old_decoder=cpudecoder;
@@ -2166,6 +2178,78 @@ void CPU_Reset_AutoAdjust(void) {
 	ticksScheduled = 0;
 }
 
+/* With cycles=max the auto adjustment settles on what the host can run, so
+   the average of CPU_CycleMax over time is a usable speed figure for the
+   selected core. It gets reported on core changes and at shutdown. */
+static struct {
+	std::string core;
+	Bit64u cycles;
+	Bitu ticks;
+} cpu_speed;
+
+static void CPU_SpeedTick(void) {
+	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust) return;
+	cpu_speed.cycles+=CPU_CycleMax;
+	cpu_speed.ticks++;
+}
+
+static void CPU_SpeedReport(void) {
+	if (cpu_speed.ticks>=1000) {
+		LOG_MSG("CPU: core=%s averaged %d cycles/ms over %d seconds of cycles=max",
+			cpu_speed.core.c_str(),(int)(cpu_speed.cycles/cpu_speed.ticks),(int)(cpu_speed.ticks/1000));
+	}
+	cpu_speed.cycles=0;
+	cpu_speed.ticks=0;
+}
+
+#if (C_DYNREC)
+static void CPU_DynrecStats(bool pressed) {
+	if (!pressed) return;
+	CPU_DynrecCacheStats stats;
+	CPU_Core_Dynrec_Cache_Stats(stats);
+	LOG_MSG("DYNREC: %d blocks compiled, %d invalidated by code writes, %d evicted",
+		stats.blocks_compiled,stats.blocks_invalidated,stats.blocks_evicted);
+	LOG_MSG("DYNREC: %d pages evicted, %d cache wraps, %d flushes, links %d hit %d miss",
+		stats.pages_evicted,stats.cache_wraps,stats.flushes,stats.link_hits,stats.link_misses);
+	LOG_MSG("DYNREC: %d superblocks, %d indirect jump target misses, %d flag-free links",
+		stats.superblocks,stats.indirect_misses,stats.flags_links);
+	LOG_MSG("DYNREC: %d KB code cache, %d cache blocks",
+		(int)(stats.code_size/1024),(int)stats.blocks_total);
+}
+#endif
+
+static void CPU_SaveState(void) {
+	FillFlags();
+	SAVESTATE_WriteVar(cpu_regs);
+	SAVESTATE_WriteVar(Segs);
+	SAVESTATE_WriteVar(cpu);
+	SAVESTATE_WriteCode((void *)cpu.hlt.old_decoder);
+	SAVESTATE_WriteVar(cpu_tss);
+	SAVESTATE_WriteVar(lflags);
+	SAVESTATE_WriteVar(lastint);
+	SAVESTATE_WriteVar(CPU_Cycles);
+	SAVESTATE_WriteVar(CPU_CycleLeft);
+	SAVESTATE_WriteVar(CPU_CycleMax);
+	SAVESTATE_WriteVar(CPU_AutoDetermineMode);
+	SAVESTATE_WriteCode((void *)cpudecoder);
+}
+
+static void CPU_LoadState(void) {
+	SAVESTATE_ReadVar(cpu_regs);
+	SAVESTATE_ReadVar(Segs);
+	SAVESTATE_ReadVar(cpu);
+	cpu.hlt.old_decoder=(CPU_Decoder *)SAVESTATE_ReadCode();
+	SAVESTATE_ReadVar(cpu_tss);
+	SAVESTATE_ReadVar(lflags);
+	SAVESTATE_ReadVar(lastint);
+	SAVESTATE_ReadVar(CPU_Cycles);
+	SAVESTATE_ReadVar(CPU_CycleLeft);
+	SAVESTATE_ReadVar(CPU_CycleMax);
+	SAVESTATE_ReadVar(CPU_AutoDetermineMode);
+	cpudecoder=(CPU_Decoder *)SAVESTATE_ReadCode();
+	CPU_Reset_AutoAdjust();
+}
+
 class CPU: public Module_base {
 private:
 	static bool inited;
@@ -2226,6 +2310,11 @@ public:
 #endif
 		MAPPER_AddHandler(CPU_CycleDecrease,MK_f11,MMOD1,"cycledown","Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease,MK_f12,MMOD1,"cycleup"  ,"Inc Cycles");
+#if (C_DYNREC)
+		MAPPER_AddHandler(CPU_DynrecStats,MK_f10,MMOD1|MMOD2,"dynstats","Dyn Stats");
+#endif
+		SAVESTATE_AddHandler("CPU",CPU_SaveState,CPU_LoadState);
+		TIMER_AddTickHandler(&CPU_SpeedTick);
 		Change_Config(configuration);	
 		CPU_JMP(false,0,0,0);					//Setup the first cpu core
 	}
@@ -2315,6 +2404,8 @@ public:
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
 		std::string core(section->Get_string("core"));
+		CPU_SpeedReport();
+		cpu_speed.core=core;
 		cpudecoder=&CPU_Core_Normal_Run;
 		if (core == "normal") {
 			cpudecoder=&CPU_Core_Normal_Run;
@@ -2346,6 +2437,8 @@ public:
 #if (C_DYNAMIC_X86)
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
 #elif (C_DYNREC)
+		CPU_Core_Dynrec_Cache_Configure(section->Get_int("dynamic_cachesize")*1024*1024,
+			std::string(section->Get_string("dynamic_cache"))=="adaptive");
 		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
 #endif
 
@@ -2404,6 +2497,8 @@ public:
 static CPU * test;
 
 void CPU_ShutDown(Section* sec) {
+	TIMER_DelTickHandler(&CPU_SpeedTick);
+	CPU_SpeedReport();
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
 #elif (C_DYNREC)
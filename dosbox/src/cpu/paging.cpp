@@ -19,8 +19,10 @@
 /* $Id: paging.cpp,v 1.36 2009-05-27 09:15:41 qbix79 Exp $ */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 #include "dosbox.h"
 #include "mem.h"
@@ -30,6 +32,8 @@
 #include "cpu.h"
 #include "debug.h"
 #include "setup.h"
+#include "savestate.h"
+#include "profiler.h"
 
 #define LINK_TOTAL		(64*1024)
 
@@ -99,6 +103,86 @@ bool PageHandler::writed_checked(PhysPt addr,Bitu val) {
 }
 
 
+Bit8u PAGING_ReadB(PhysPt address) {
+	PROF_Enter(PROF_PAGING);
+	Bit8u val=(Bit8u)get_tlb_readhandler(address)->readb(address);
+	PROF_Leave();
+	return val;
+}
+
+Bit16u PAGING_ReadW(PhysPt address) {
+	PROF_Enter(PROF_PAGING);
+	Bit16u val=(Bit16u)get_tlb_readhandler(address)->readw(address);
+	PROF_Leave();
+	return val;
+}
+
+Bit32u PAGING_ReadD(PhysPt address) {
+	PROF_Enter(PROF_PAGING);
+	Bit32u val=(Bit32u)get_tlb_readhandler(address)->readd(address);
+	PROF_Leave();
+	return val;
+}
+
+void PAGING_WriteB(PhysPt address,Bit8u val) {
+	PROF_Enter(PROF_PAGING);
+	get_tlb_writehandler(address)->writeb(address,val);
+	PROF_Leave();
+}
+
+void PAGING_WriteW(PhysPt address,Bit16u val) {
+	PROF_Enter(PROF_PAGING);
+	get_tlb_writehandler(address)->writew(address,val);
+	PROF_Leave();
+}
+
+void PAGING_WriteD(PhysPt address,Bit32u val) {
+	PROF_Enter(PROF_PAGING);
+	get_tlb_writehandler(address)->writed(address,val);
+	PROF_Leave();
+}
+
+bool PAGING_ReadB_Checked(PhysPt address,Bit8u * val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_readhandler(address)->readb_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
+
+bool PAGING_ReadW_Checked(PhysPt address,Bit16u * val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_readhandler(address)->readw_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
+
+bool PAGING_ReadD_Checked(PhysPt address,Bit32u * val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_readhandler(address)->readd_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
+
+bool PAGING_WriteB_Checked(PhysPt address,Bit8u val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_writehandler(address)->writeb_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
+
+bool PAGING_WriteW_Checked(PhysPt address,Bit16u val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_writehandler(address)->writew_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
+
+bool PAGING_WriteD_Checked(PhysPt address,Bit32u val) {
+	PROF_Enter(PROF_PAGING);
+	bool fault=get_tlb_writehandler(address)->writed_checked(address,val);
+	PROF_Leave();
+	return fault;
+}
 
 struct PF_Entry {
 	Bitu cs;
@@ -734,46 +818,56 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 
 #else
 
+static INLINE void ResetTLBEntry(tlb_entry *entry) {
+	entry->read=0;
+	entry->write=0;
+	entry->readhandler=&init_page_handler;
+	entry->writehandler=&init_page_handler;
+	entry->gen=paging.tlbh_gen;
+}
+
 static INLINE void InitTLBInt(tlb_entry *bank) {
- 	for (Bitu i=0;i<TLB_SIZE;i++) {
-		bank[i].read=0;
-		bank[i].write=0;
-		bank[i].readhandler=&init_page_handler;
-		bank[i].writehandler=&init_page_handler;
- 	}
+ 	for (Bitu i=0;i<TLB_BANK_SIZE;i++) ResetTLBEntry(&bank[i]);
+}
+
+/* Entries get revalidated on their first use after a flush */
+void PAGING_ResetTLBEntry(tlb_entry *entry) {
+	ResetTLBEntry(entry);
 }
 
-void PAGING_InitTLBBank(tlb_entry **bank) {
-	*bank = (tlb_entry *)malloc(sizeof(tlb_entry)*TLB_SIZE);
-	if(!*bank) E_Exit("Out of Memory");
-	InitTLBInt(*bank);
+/* Banks get allocated on first access and are kept until shutdown */
+tlb_entry * PAGING_InitTLBBank(Bitu bank) {
+	tlb_entry * entries=(tlb_entry *)malloc(sizeof(tlb_entry)*TLB_BANK_SIZE);
+	if (!entries) E_Exit("Out of Memory");
+	InitTLBInt(entries);
+	paging.tlbh_banks[bank]=entries;
+	return entries;
 }
 
 void PAGING_InitTLB(void) {
-	InitTLBInt(paging.tlbh);
+	for (Bitu i=0;i<TLB_BANKS;i++) {
+		if (paging.tlbh_banks[i]) InitTLBInt(paging.tlbh_banks[i]);
+	}
  	paging.links.used=0;
 }
 
-void PAGING_ClearTLB(void) {
-	Bit32u * entries=&paging.links.entries[0];
-	for (;paging.links.used>0;paging.links.used--) {
-		Bitu page=*entries++;
-		tlb_entry *entry = get_tlb_entry(page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
+static void PAGING_FreeTLB(void) {
+	for (Bitu i=0;i<TLB_BANKS;i++) {
+		free(paging.tlbh_banks[i]);
+		paging.tlbh_banks[i]=0;
 	}
+}
+
+void PAGING_ClearTLB(void) {
+	/* A new generation unlinks every entry at once, the links only matter
+	   for InitPageUpdateLink from here on */
 	paging.links.used=0;
+	if (GCC_UNLIKELY(++paging.tlbh_gen==0)) PAGING_InitTLB();
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 	for (;pages>0;pages--) {
-		tlb_entry *entry = get_tlb_entry(lin_page<<12);
-		entry->read=0;
-		entry->write=0;
-		entry->readhandler=&init_page_handler;
-		entry->writehandler=&init_page_handler;
+		ResetTLBEntry(get_tlb_entry(lin_page<<12));
 		lin_page++;
 	}
 }
@@ -781,10 +875,7 @@ void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
 void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page<LINK_START) {
 		paging.firstmb[lin_page]=phys_page;
-		paging.tlbh[lin_page].read=0;
-		paging.tlbh[lin_page].write=0;
-		paging.tlbh[lin_page].readhandler=&init_page_handler;
-		paging.tlbh[lin_page].writehandler=&init_page_handler;
+		ResetTLBEntry(get_tlb_entry(lin_page<<12));
 	} else {
 		PAGING_LinkPage(lin_page,phys_page);
 	}
@@ -793,7 +884,7 @@ void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
 void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
 	PageHandler * handler=MEM_GetPageHandler(phys_page);
 	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
+	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
 
 	if (paging.links.used>=PAGING_LINKS) {
@@ -816,7 +907,7 @@ void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
 void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	PageHandler * handler=MEM_GetPageHandler(phys_page);
 	Bitu lin_base=lin_page << 12;
-	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
+	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
 
 	if (paging.links.used>=PAGING_LINKS) {
@@ -835,6 +926,113 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	entry->writehandler=&init_page_handler_userro;
 }
 
+#if C_BENCHMARKS
+/* The flush as it was done before the generations, for the benchmark */
+static void PAGING_BenchmarkWalkClear(void) {
+	Bit32u * entries=&paging.links.entries[0];
+	for (;paging.links.used>0;paging.links.used--) {
+		Bitu page=*entries++;
+		ResetTLBEntry(get_tlb_entry(page<<12));
+	}
+}
+
+/* The lookup as it was done before the generations, for the benchmark */
+static INLINE tlb_entry * PAGING_BenchmarkEntry(PhysPt address) {
+	Bitu index=(address>>12);
+	tlb_entry * bank=paging.tlbh_banks[index >> TLB_BANK_SHIFT];
+	if (GCC_UNLIKELY(!bank)) bank=PAGING_InitTLBBank(index >> TLB_BANK_SHIFT);
+	return &bank[index & TLB_BANK_MASK];
+}
+
+/* Keeps the compiler from dropping the lookups of the benchmark */
+static volatile Bitu paging_bench_sink;
+
+static void PAGING_BenchmarkLink(tlb_entry * entry,Bitu lin_page,Bit8u * page) {
+	entry->read=page-(lin_page<<12);
+	entry->write=entry->read;
+	entry->phys_page=(Bit32u)lin_page;
+	if (paging.links.used<PAGING_LINKS) paging.links.entries[paging.links.used++]=lin_page;
+}
+
+/* Links pages like a guest with a few processes would and reloads cr3
+   between them, each address space touching all of its pages once */
+static double PAGING_BenchmarkRun(Bitu pages,Bitu reloads,bool walk) {
+	static Bit8u page[4096];
+	PAGING_InitTLB();
+	clock_t start=clock();
+	Bitu sum=0;
+	for (Bitu r=0;r<reloads;r++) {
+		Bitu base=LINK_START+(r & 3)*0x10000;
+		for (Bitu i=0;i<pages;i++) {
+			Bitu lin_page=base+i*3;
+			tlb_entry * entry=get_tlb_entry(lin_page<<12);
+			if (!entry->read) PAGING_BenchmarkLink(entry,lin_page,page);
+			sum+=entry->phys_page;
+		}
+		if (walk) PAGING_BenchmarkWalkClear();
+		else PAGING_ClearTLB();
+	}
+	double ms=(double)(clock()-start)*1000.0/CLOCKS_PER_SEC;
+	PAGING_InitTLB();
+	paging_bench_sink=sum;
+	return ms;
+}
+
+/* Reads memory like a paged guest does, mostly a few bytes in a page before
+   moving to another one of its working set, with a cr3 reload every
+   reload accesses. The walk run looks up entries without the generation
+   compare, so this shows what the compare costs on every access. */
+static double PAGING_BenchmarkAccess(Bitu pages,Bitu accesses,Bitu reload,bool walk) {
+	static Bit8u page[4096];
+	PAGING_InitTLB();
+	clock_t start=clock();
+	Bit32u seed=1;
+	Bitu sum=0;
+	Bitu lin_page=LINK_START;
+	for (Bitu a=0;a<accesses;a++) {
+		seed=seed*1664525+1013904223;
+		if ((seed>>28)==0) lin_page=LINK_START+((seed>>8)%pages)*3;
+		PhysPt address=(PhysPt)((lin_page<<12)+((seed>>4)&0xfff));
+		tlb_entry * entry=walk ? PAGING_BenchmarkEntry(address) : get_tlb_entry(address);
+		if (!entry->read) PAGING_BenchmarkLink(entry,lin_page,page);
+		sum+=host_readb(entry->read+address);
+		if ((a % reload)==reload-1) {
+			if (walk) PAGING_BenchmarkWalkClear();
+			else PAGING_ClearTLB();
+		}
+	}
+	double ms=(double)(clock()-start)*1000.0/CLOCKS_PER_SEC;
+	PAGING_InitTLB();
+	paging_bench_sink=sum;
+	return ms;
+}
+
+void PAGING_BenchmarkTLB(void) {
+	static const Bitu sizes[]={ 16, 256, 2048, 16384 };
+	const Bitu reloads=20000;
+	printf("Pages   walk ms    gen ms   (%d cr3 reloads)\n",(int)reloads);
+	for (Bitu i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++) {
+		double walk=PAGING_BenchmarkRun(sizes[i],reloads,true);
+		double gen=PAGING_BenchmarkRun(sizes[i],reloads,false);
+		printf("%6d %9.1f %9.1f\n",(int)sizes[i],walk,gen);
+	}
+	const Bitu accesses=50000000;
+	const Bitu reload=100000;
+	printf("\nPages   walk ms    gen ms   (%d accesses, a cr3 reload every %d)\n",(int)accesses,(int)reload);
+	for (Bitu i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++) {
+		double walk=PAGING_BenchmarkAccess(sizes[i],accesses,reload,true);
+		double gen=PAGING_BenchmarkAccess(sizes[i],accesses,reload,false);
+		printf("%6d %9.1f %9.1f\n",(int)sizes[i],walk,gen);
+	}
+}
+#endif
+
+#endif
+
+#if defined(USE_FULL_TLB) && C_BENCHMARKS
+void PAGING_BenchmarkTLB(void) {
+	printf("The cr3 reload benchmark needs the two level TLB, the full TLB is built in\n");
+}
 #endif
 
 
@@ -870,6 +1068,28 @@ bool PAGING_Enabled(void) {
 	return paging.enabled;
 }
 
+static void PAGING_SaveState(void) {
+	SAVESTATE_WriteVar(paging.cr3);
+	SAVESTATE_WriteVar(paging.cr2);
+	SAVESTATE_Write(&paging.base,sizeof(paging.base));
+	SAVESTATE_WriteVar(paging.firstmb);
+	SAVESTATE_WriteVar(paging.enabled);
+	SAVESTATE_WriteVar(pf_queue.used);
+	SAVESTATE_WriteVar(pf_queue.entries);
+}
+
+static void PAGING_LoadState(void) {
+	SAVESTATE_ReadVar(paging.cr3);
+	SAVESTATE_ReadVar(paging.cr2);
+	SAVESTATE_Read(&paging.base,sizeof(paging.base));
+	SAVESTATE_ReadVar(paging.firstmb);
+	SAVESTATE_ReadVar(paging.enabled);
+	SAVESTATE_ReadVar(pf_queue.used);
+	SAVESTATE_ReadVar(pf_queue.entries);
+	/* Every link could point to something else now */
+	PAGING_InitTLB();
+}
+
 class PAGING:public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
@@ -881,8 +1101,13 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SAVESTATE_AddHandler("PAGING",PAGING_SaveState,PAGING_LoadState);
+	}
+	~PAGING(){
+#if !defined(USE_FULL_TLB)
+		PAGING_FreeTLB();
+#endif
 	}
-	~PAGING(){}
 };
 
 static PAGING* test;
@@ -31,6 +31,7 @@
 #include "setup.h"
 #include "support.h"
 #include "serialport.h"
+#include "savestate.h"
 
 DOS_Block dos;
 DOS_InfoBlock dos_infoblock;
@@ -1118,6 +1119,17 @@ static Bitu DOS_26Handler(void) {
 }
 
 
+/* Open files and drives live on the host, only the kernel variables are saved */
+static void DOS_SaveState(void) {
+	SAVESTATE_WriteVar(dos);
+}
+
+static void DOS_LoadState(void) {
+	Bit8u * country=dos.tables.country;
+	SAVESTATE_ReadVar(dos);
+	dos.tables.country=country;
+}
+
 class DOS:public Module_base{
 private:
 	CALLBACK_HandlerObject callback[7];
@@ -1176,6 +1188,7 @@ public:
 		dos.date.year=(Bit16u)loctime->tm_year+1900;
 		Bit32u ticks=(Bit32u)((loctime->tm_hour*3600+loctime->tm_min*60+loctime->tm_sec)*(float)PIT_TICK_RATE/65536.0);
 		mem_writed(BIOS_TIMER,ticks);
+		SAVESTATE_AddHandler("DOS",DOS_SaveState,DOS_LoadState);
 	}
 	~DOS(){
 		for (Bit16u i=0;i<DOS_DRIVES;i++) delete Drives[i];
@@ -36,6 +36,15 @@
 #include "bios.h"
 #include "setup.h"
 #include "control.h"
+#include "benchmark.h"
+#include "savestate.h"
+#include "render.h"
+#include "profiler.h"
+#include "hardware.h"
+#if !defined (WIN32) && !defined (IPHONEOS)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 
 #if defined(OS2)
@@ -931,6 +940,63 @@ static void RESCAN_ProgramStart(Program * * make) {
 	*make=new RESCAN;
 }
 
+/* Forks the whole emulator, so guest memory, vga memory and the drive
+ * caches of the copies are shared with this one until either side writes
+ * them. Host windows and audio devices don't survive a fork, so this only
+ * works for headless sessions. */
+class CLONE : public Program {
+public:
+	void Run(void);
+};
+
+void CLONE::Run(void) {
+#if defined (WIN32) || defined (IPHONEOS)
+	WriteOut(MSG_Get("PROGRAM_CLONE_UNSUPPORTED"));
+#else
+	if (!cmd->FindCommand(1,temp_line)) {
+		WriteOut(MSG_Get("PROGRAM_CLONE_USAGE"));
+		return;
+	}
+	int count=atoi(temp_line.c_str());
+	if (count<1 || count>254) {
+		WriteOut(MSG_Get("PROGRAM_CLONE_USAGE"));
+		return;
+	}
+	if (!BENCH_Headless()) {
+		WriteOut(MSG_Get("PROGRAM_CLONE_HEADLESS"));
+		return;
+	}
+	/* Only the forking thread exists in a copy, the others would never answer */
+	if (RENDER_ThreadRunning() || PROF_Active || OPL_ThreadRunning()) {
+		WriteOut(MSG_Get("PROGRAM_CLONE_THREADS"));
+		return;
+	}
+	/* Don't let the copies write buffered output twice */
+	fflush(0);
+	int started=0;
+	for (int i=1;i<=count;i++) {
+		pid_t pid=fork();
+		if (pid<0) break;
+		if (pid==0) {
+			/* Fork again and leave, init takes care of the copy when it exits */
+			pid_t copy=fork();
+			if (copy!=0) _exit(copy<0 ? 1 : 0);
+			BENCH_Clone(i);
+			SAVESTATE_Clone(i);
+			exitcode=(Bit8u)i;
+			return;
+		}
+		int status;
+		if (waitpid(pid,&status,0)==pid && WIFEXITED(status) && !WEXITSTATUS(status)) started++;
+	}
+	WriteOut(MSG_Get("PROGRAM_CLONE_STARTED"),started);
+#endif
+}
+
+static void CLONE_ProgramStart(Program * * make) {
+	*make=new CLONE;
+}
+
 class INTRO : public Program {
 public:
 	void DisplayMount(void) {
@@ -1395,6 +1461,15 @@ void DOS_SetupPrograms(void) {
 	MSG_Add("MSCDEX_UNKNOWN_ERROR","MSCDEX: Failure: Unknown error.\n");
 
 	MSG_Add("PROGRAM_RESCAN_SUCCESS","Drive cache cleared.\n");
+	MSG_Add("PROGRAM_CLONE_USAGE","Starts copies of this machine that continue from here.\n"
+		"\033[32;1mCLONE\033[0m count\n"
+		"The copies return their number as errorlevel, this one returns 0.\n"
+		"Copy n writes its output to clone<n>.txt, its input script and save states\n"
+		"to the configured names with .n appended.\n");
+	MSG_Add("PROGRAM_CLONE_HEADLESS","Cloning only works in headless -benchmark runs.\n");
+	MSG_Add("PROGRAM_CLONE_THREADS","Cloning doesn't work with the render thread, the profiler or the OPL thread running.\n");
+	MSG_Add("PROGRAM_CLONE_UNSUPPORTED","Cloning is not supported on this platform.\n");
+	MSG_Add("PROGRAM_CLONE_STARTED","Started %d copies.\n");
 
 	MSG_Add("PROGRAM_INTRO",
 		"\033[2J\033[32;1mWelcome to DOSBox\033[0m, an x86 emulator with sound and graphics.\n"
@@ -1555,6 +1630,7 @@ void DOS_SetupPrograms(void) {
 	PROGRAMS_MakeFile("MEM.COM",MEM_ProgramStart);
 	PROGRAMS_MakeFile("LOADFIX.COM",LOADFIX_ProgramStart);
 	PROGRAMS_MakeFile("RESCAN.COM",RESCAN_ProgramStart);
+	PROGRAMS_MakeFile("CLONE.COM",CLONE_ProgramStart);
 	PROGRAMS_MakeFile("INTRO.COM",INTRO_ProgramStart);
 	PROGRAMS_MakeFile("BOOT.COM",BOOT_ProgramStart);
 #if C_DEBUG
@@ -38,10 +38,13 @@
 #include "control.h"
 #include "cross.h"
 #include "programs.h"
+#include "benchmark.h"
+#include "profiler.h"
 #include "support.h"
 #include "mapper.h"
 #include "ints/int10.h"
 #include "render.h"
+#include "savestate.h"
 
 Config * control;
 MachineType machine;
@@ -98,6 +101,9 @@ void TIMER_Init(Section*);
 void BIOS_Init(Section*);
 void DEBUG_Init(Section*);
 void CMOS_Init(Section*);
+void SAVESTATE_Init(Section*);
+void BENCH_Init(Section*);
+void PROF_Init(Section*);
 
 void MSCDEX_Init(Section*);
 void DRIVES_Init(Section*);
@@ -139,14 +145,28 @@ static Bitu Normal_Loop(void) {
 			if (DEBUG_ExitLoop()) return 0;
 #endif
 		} else {
+			if (GCC_UNLIKELY(SAVESTATE_Pending)) SAVESTATE_Service();
+			Bit64u bench=BENCH_Begin();
+			PROF_Enter(PROF_EVENTS);
 			GFX_Events();
+			PROF_Leave();
+			BENCH_End(BENCH_TIMER_EVENTS,bench);
 			if (ticksRemain>0) {
+				bench=BENCH_Begin();
+				PROF_Enter(PROF_TIMER);
 				TIMER_AddTick();
+				PROF_Leave();
+				BENCH_End(BENCH_TIMER_TICK,bench);
 				ticksRemain--;
 			} else goto increaseticks;
 		}
 	}
 increaseticks:
+	if (GCC_UNLIKELY(BENCH_Active)) {
+		/* No throttling, emulated time runs as fast as the host allows */
+		ticksRemain=20;
+		return 0;
+	}
 	if (GCC_UNLIKELY(ticksLocked)) {
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
@@ -238,11 +258,19 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+static Bitu run_depth=0;
+
 void DOSBOX_RunMachine(void){
 	Bitu ret;
+	run_depth++;
 	do {
 		ret=(*loop)();
 	} while (!ret);
+	run_depth--;
+}
+
+Bitu DOSBOX_RunDepth(void) {
+	return run_depth;
 }
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
@@ -360,11 +388,23 @@ void DOSBOX_Init(void) {
 		"  This value is best left at its default to avoid problems with some games,\n"
 		"  though few games might require a higher value.\n"
 		"  There is generally no speed advantage when raising this value.");
+	Pbool = secprop->Add_bool("pollskip",Property::Changeable::WhenIdle,false);
+	Pbool->Set_help("Skip emulated time ahead when a game keeps polling a status port (retrace, adlib timers,\n"
+		"  keyboard and soundblaster status) instead of running the loop. Saves host cpu time.\n"
+		"  Off by default, games that measure their speed by counting those reads run differently.");
 	secprop->AddInitFunction(&CALLBACK_Init);
 	secprop->AddInitFunction(&PIC_Init);//done
 	secprop->AddInitFunction(&PROGRAMS_Init);
 	secprop->AddInitFunction(&TIMER_Init);//done
 	secprop->AddInitFunction(&CMOS_Init);//done
+	secprop->AddInitFunction(&SAVESTATE_Init);
+	secprop->AddInitFunction(&BENCH_Init);
+	secprop->AddInitFunction(&PROF_Init);
+	Pbool = secprop->Add_bool("profiler",Property::Changeable::Always,false);
+	Pbool->Set_help("Start the sampling profiler right away, otherwise toggle it with the mapper (ctrl-alt-F9).\n"
+		"  Stopping it writes a report and a folded stack file to the capture directory.");
+	Pstring = secprop->Add_path("savestate",Property::Changeable::Always,"dosbox.sav");
+	Pstring->Set_help("File used by the save and load state hotkeys.");
 
 	secprop=control->AddSection_prop("render",&RENDER_Init,true);
 	Pint = secprop->Add_int("frameskip",Property::Changeable::Always,0);
@@ -374,6 +414,14 @@ void DOSBOX_Init(void) {
 	Pbool = secprop->Add_bool("aspect",Property::Changeable::Always,false);
 	Pbool->Set_help("Do aspect correction, if your output method doesn't support scaling this can slow things down!.");
 
+	Pbool = secprop->Add_bool("simd",Property::Changeable::Always,true);
+	Pbool->Set_help("Use the SSE2 or NEON versions of the scalers if DOSBox was compiled with them.");
+
+	Pbool = secprop->Add_bool("threaded",Property::Changeable::Always,false);
+	Pbool->Set_help("Run the scaler in a separate thread, the emulation only copies the scanlines of a frame.\n"
+	                "  The emulation thread copies the scaled frames to the screen. Frames are dropped when\n"
+	                "  the scaler can't keep up.");
+
 	Pmulti = secprop->Add_multi("scaler",Property::Changeable::Always," ");
 	Pmulti->SetValue("normal2x");
 	Pmulti->Set_help("Scaler used to enlarge/enhance low resolution modes.\n"
@@ -429,6 +477,20 @@ void DOSBOX_Init(void) {
 
 	Pstring = Pmulti_remain->GetSection()->Add_string("parameters",Property::Changeable::Always,"");
 	
+#if (C_DYNREC)
+	const char* dyncaches[] = { "fixed", "adaptive", 0 };
+	Pstring = secprop->Add_string("dynamic_cache",Property::Changeable::OnlyAtStart,"fixed");
+	Pstring->Set_values(dyncaches);
+	Pstring->Set_help("How the dynamic core manages its code cache.\n"
+		"  fixed:    translated code is overwritten oldest first once the cache is full.\n"
+		"  adaptive: the cache grows up to four times dynamic_cachesize, then the oldest\n"
+		"            code is overwritten first like with fixed.");
+
+	Pint = secprop->Add_int("dynamic_cachesize",Property::Changeable::OnlyAtStart,8);
+	Pint->SetMinMax(1,64);
+	Pint->Set_help("Size of the dynamic core code cache in MB.");
+#endif
+
 	Pint = secprop->Add_int("cycleup",Property::Changeable::Always,10);
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Amount of cycles to decrease/increase with keycombo.(CTRL-F11/CTRL-F12)");
@@ -462,6 +524,9 @@ void DOSBOX_Init(void) {
 	Pint->SetMinMax(0,100);
 	Pint->Set_help("How many milliseconds of data to keep on top of the blocksize.");
 
+	Pbool = secprop->Add_bool("simd",Property::Changeable::OnlyAtStart,true);
+	Pbool->Set_help("Use the SSE2 or NEON versions of the mixing loops if DOSBox was compiled with them.");
+
 	secprop=control->AddSection_prop("midi",&MIDI_Init,true);//done
 	secprop->AddInitFunction(&MPU401_Init,true);//done
 	
@@ -524,6 +589,9 @@ void DOSBOX_Init(void) {
 	Pint->Set_values(oplrates);
 	Pint->Set_help("Sample rate of OPL music emulation. Use 49716 for highest quality (set the mixer rate accordingly).");
 
+	Pbool = secprop->Add_bool("oplthread",Property::Changeable::WhenIdle,false);
+	Pbool->Set_help("Render the OPL music on a separate thread, delays it by 2ms. Not used with oplemu=compat.");
+
 
 	secprop=control->AddSection_prop("gus",&GUS_Init,true); //done
 	Pbool = secprop->Add_bool("gus",Property::Changeable::WhenIdle,false); 	
@@ -27,6 +27,7 @@
 #include "mem.h"
 #include "fpu.h"
 #include "cpu.h"
+#include "savestate.h"
 
 FPU_rec fpu;
 
@@ -624,8 +625,17 @@ void FPU_ESC7_Normal(Bitu rm) {
 }
 
 
+static void FPU_SaveState(void) {
+	SAVESTATE_WriteVar(fpu);
+}
+
+static void FPU_LoadState(void) {
+	SAVESTATE_ReadVar(fpu);
+}
+
 void FPU_Init(Section*) {
 	FPU_FINIT();
+	SAVESTATE_AddHandler("FPU",FPU_SaveState,FPU_LoadState);
 }
 
 #endif
@@ -21,6 +21,9 @@
 #include <sys/types.h>
 #include <assert.h>
 #include <math.h>
+#include <time.h>
+#include "SDL.h"
+#include "SDL_thread.h"
 
 #include "dosbox.h"
 #include "video.h"
@@ -31,33 +34,82 @@
 #include "cross.h"
 #include "hardware.h"
 #include "support.h"
+#include "benchmark.h"
 
 #include "render_scalers.h"
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
+#define RENDER_THREAD_FRAMES 2
+
+/* The scalers can run in a separate thread, the emulation then only copies
+   the scanlines of a frame into a buffer and hands it over at the end. The
+   thread scales into a buffer of its own, the screen is only touched by the
+   emulation thread which copies the changed lines of a finished frame. */
+static struct {
+	bool enabled;
+	bool async;						// current frame is rendered by the thread
+	bool quit;
+	SDL_Thread * thread;
+	SDL_mutex * lock;
+	SDL_cond * cond;				// signals new frames and finished frames
+	struct {
+		Bit8u * data;
+		Bitu lines;
+		Bitu palFirst, palLast;
+		GFX_PalEntry pal[256];
+	} frame[RENDER_THREAD_FRAMES];
+	Bitu size;						// allocated bytes of each frame
+	Bitu fill;						// frame the emulation is writing to
+	Bits queued;					// frame waiting for the thread, -1 if none
+	Bits busy;						// frame the thread is rendering, -1 if none
+	bool ready;						// out holds a frame that isn't shown yet
+	Bit8u * out;
+	Bitu outPitch, outHeight;
+	Bitu changedIndex;
+	Bit16u changed[SCALER_MAXHEIGHT];
+	Bitu palFirst, palLast;			// palette range to set for 8-bit screens
+	GFX_PalEntry pal[256];
+} render_thread;
+
+/* Handler of the scanlines of the frame that is being scaled, the same as
+   RENDER_DrawLine unless the frame is rendered by the thread */
+static ScalerLineHandler_t RENDER_ScaleLine;
+
+static inline void RENDER_SetLineHandler(ScalerLineHandler_t handler) {
+	RENDER_ScaleLine = handler;
+	if (!render_thread.async) RENDER_DrawLine = handler;
+}
+
 static void RENDER_CallBack( GFX_CallBackFunctions_t function );
 
-static void Check_Palette(void) {
+static void Check_Palette(GFX_PalEntry * rgb,Bitu first,Bitu last) {
 	/* Clean up any previous changed palette data */
 	if (render.pal.changed) {
 		memset(render.pal.modified, 0, sizeof(render.pal.modified));
 		render.pal.changed = false;
 	}
-	if (render.pal.first>render.pal.last) 
+	if (first>last) 
 		return;
 	Bitu i;
 	switch (render.scale.outMode) {
 	case scalerMode8:
-		GFX_SetPalette(render.pal.first,render.pal.last-render.pal.first+1,(GFX_PalEntry *)&render.pal.rgb[render.pal.first]);
+		if (render_thread.async) {
+			/* Set when the frame is shown */
+			memcpy(&render_thread.pal[first],&rgb[first],(last-first+1)*sizeof(GFX_PalEntry));
+			if (render_thread.palFirst>first) render_thread.palFirst=first;
+			if (render_thread.palLast<last) render_thread.palLast=last;
+		} else {
+			GFX_SetPalette(first,last-first+1,&rgb[first]);
+		}
 		break;
 	case scalerMode15:
 	case scalerMode16:
-		for (i=render.pal.first;i<=render.pal.last;i++) {
-			Bit8u r=render.pal.rgb[i].red;
-			Bit8u g=render.pal.rgb[i].green;
-			Bit8u b=render.pal.rgb[i].blue;
+		for (i=first;i<=last;i++) {
+			Bit8u r=rgb[i].r;
+			Bit8u g=rgb[i].g;
+			Bit8u b=rgb[i].b;
 			Bit16u newPal = GFX_GetRGB(r,g,b);
 			if (newPal != render.pal.lut.b16[i]) {
 				render.pal.changed = true;
@@ -68,10 +120,10 @@ static void Check_Palette(void) {
 		break;
 	case scalerMode32:
 	default:
-		for (i=render.pal.first;i<=render.pal.last;i++) {
-			Bit8u r=render.pal.rgb[i].red;
-			Bit8u g=render.pal.rgb[i].green;
-			Bit8u b=render.pal.rgb[i].blue;
+		for (i=first;i<=last;i++) {
+			Bit8u r=rgb[i].r;
+			Bit8u g=rgb[i].g;
+			Bit8u b=rgb[i].b;
 			Bit32u newPal = GFX_GetRGB(r,g,b);
 			if (newPal != render.pal.lut.b32[i]) {
 				render.pal.changed = true;
@@ -81,9 +133,6 @@ static void Check_Palette(void) {
 		}
 		break;
 	}
-	/* Setup pal index to startup values */
-	render.pal.first=256;
-	render.pal.last=0;
 }
 
 void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue) {
@@ -97,19 +146,30 @@ void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue) {
 static void RENDER_EmptyLineHandler(const void * src) {
 }
 
+static bool RENDER_StartOutput(void) {
+	if (render_thread.async) {
+		render.scale.outWrite = render_thread.out;
+		render.scale.outPitch = render_thread.outPitch;
+		return true;
+	}
+	return GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch );
+}
+
 static void RENDER_StartLineHandler(const void * s) {
 	if (s) {
 		const Bitu *src = (Bitu*)s;
 		Bitu *cache = (Bitu*)(render.scale.cacheRead);
 		for (Bits x=render.src.start;x>0;) {
 			if (GCC_UNLIKELY(src[0] != cache[0])) {
-				if (!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )) {
-					RENDER_DrawLine = RENDER_EmptyLineHandler;
+				if (!RENDER_StartOutput()) {
+					/* The lines of this frame never reach the screen, don't let the next one skip them */
+					render.scale.clearCache = true;
+					RENDER_SetLineHandler( RENDER_EmptyLineHandler );
 					return;
 				}
 				render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
-				RENDER_DrawLine = render.scale.lineHandler;
-				RENDER_DrawLine( s );
+				RENDER_SetLineHandler( render.scale.lineHandler );
+				RENDER_ScaleLine( s );
 				return;
 			}
 			x--; src++; cache++;
@@ -145,19 +205,7 @@ static void RENDER_ClearCacheHandler(const void * src) {
 	render.scale.lineHandler( src );
 }
 
-bool RENDER_StartUpdate(void) {
-	if (GCC_UNLIKELY(render.updating))
-		return false;
-	if (GCC_UNLIKELY(!render.active))
-		return false;
-	if (GCC_UNLIKELY(render.frameskip.count<render.frameskip.max)) {
-		render.frameskip.count++;
-		return false;
-	}
-	render.frameskip.count=0;
-	if (render.scale.inMode == scalerMode8) {
-		Check_Palette();
-	}
+static bool RENDER_BeginFrame(void) {
 	render.scale.inLine = 0;
 	render.scale.outLine = 0;
 	render.scale.cacheRead = (Bit8u*)&scalerSourceCache;
@@ -169,43 +217,32 @@ bool RENDER_StartUpdate(void) {
 	if (GCC_UNLIKELY( render.scale.clearCache) ) {
 //		LOG_MSG("Clearing cache");
 		//Will always have to update the screen with this one anyway, so let's update already
-		if (GCC_UNLIKELY(!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )))
+		if (GCC_UNLIKELY(!RENDER_StartOutput()))
 			return false;
 		render.fullFrame = true;
 		render.scale.clearCache = false;
-		RENDER_DrawLine = RENDER_ClearCacheHandler;
+		RENDER_SetLineHandler( RENDER_ClearCacheHandler );
 	} else {
 		if (render.pal.changed) {
 			/* Assume pal changes always do a full screen update anyway */
-			if (GCC_UNLIKELY(!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )))
+			if (GCC_UNLIKELY(!RENDER_StartOutput()))
 				return false;
-			RENDER_DrawLine = render.scale.linePalHandler;
+			RENDER_SetLineHandler( render.scale.linePalHandler );
 			render.fullFrame = true;
 		} else {
-			RENDER_DrawLine = RENDER_StartLineHandler;
+			RENDER_SetLineHandler( RENDER_StartLineHandler );
 			if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) 
 				render.fullFrame = true;
 			else
 				render.fullFrame = false;
 		}
 	}
-	render.updating = true;
 	return true;
 }
 
-static void RENDER_Halt( void ) {
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
-	GFX_EndUpdate( 0 );
-	render.updating=false;
-	render.active=false;
-}
-
-extern Bitu PIC_Ticks;
-void RENDER_EndUpdate( bool abort ) {
-	if (GCC_UNLIKELY(!render.updating))
-		return;
-	RENDER_DrawLine = RENDER_EmptyLineHandler;
-	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
+static bool RENDER_FinishFrame( bool abort, bool capture ) {
+	RENDER_SetLineHandler( RENDER_EmptyLineHandler );
+	if (GCC_UNLIKELY(capture)) {
 		Bitu pitch, flags;
 		flags = 0;
 		if (render.src.dblw != render.src.dblh) {
@@ -220,7 +257,224 @@ void RENDER_EndUpdate( bool abort ) {
 			flags, fps, (Bit8u *)&scalerSourceCache, (Bit8u*)&render.pal.rgb );
 	}
 	if ( render.scale.outWrite ) {
-		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+		if (render_thread.async) {
+			render_thread.changedIndex = Scaler_ChangedLineIndex;
+			memcpy(render_thread.changed,Scaler_ChangedLines,(Scaler_ChangedLineIndex+1)*sizeof(Bit16u));
+		} else {
+			GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+		}
+		return true;
+	}
+	return false;
+}
+
+static bool RENDER_ThreadFrame(Bitu index) {
+	if (render.scale.inMode == scalerMode8)
+		Check_Palette(render_thread.frame[index].pal,render_thread.frame[index].palFirst,render_thread.frame[index].palLast);
+	if (!RENDER_BeginFrame())
+		return false;
+	Bit8u * line = render_thread.frame[index].data;
+	for (Bitu i=render_thread.frame[index].lines;i>0;i--) {
+		RENDER_ScaleLine( line );
+		line += render.scale.cachePitch;
+	}
+	return RENDER_FinishFrame( false, false );
+}
+
+static int RENDER_ThreadMain(void * /*data*/) {
+	SDL_mutexP(render_thread.lock);
+	for (;;) {
+		/* The output buffer is reused once the last frame was shown */
+		while ((render_thread.queued<0 || render_thread.ready) && !render_thread.quit)
+			SDL_CondWait(render_thread.cond,render_thread.lock);
+		if (render_thread.quit)
+			break;
+		render_thread.busy = render_thread.queued;
+		render_thread.queued = -1;
+		SDL_mutexV(render_thread.lock);
+		bool done = RENDER_ThreadFrame(render_thread.busy);
+		SDL_mutexP(render_thread.lock);
+		render_thread.busy = -1;
+		render_thread.ready = done;
+		SDL_CondBroadcast(render_thread.cond);
+	}
+	SDL_mutexV(render_thread.lock);
+	return 0;
+}
+
+bool RENDER_ThreadRunning(void) {
+	return render_thread.thread!=0;
+}
+
+/* The scaled frames that aren't shown get dropped, the next frame is drawn completely */
+static void RENDER_ThreadDrop(void) {
+	render_thread.ready = false;
+	render.scale.clearCache = true;
+	if (render.pal.first>render_thread.palFirst) render.pal.first=render_thread.palFirst;
+	if (render.pal.last<render_thread.palLast) render.pal.last=render_thread.palLast;
+	render_thread.palFirst = 256;
+	render_thread.palLast = 0;
+	SDL_CondBroadcast(render_thread.cond);
+}
+
+/* Wait till the render thread is done with all frames handed to it */
+void RENDER_Sync(void) {
+	if (!render_thread.thread)
+		return;
+	SDL_mutexP(render_thread.lock);
+	while (render_thread.queued>=0 || render_thread.busy>=0) {
+		if (render_thread.ready)
+			RENDER_ThreadDrop();
+		else
+			SDL_CondWait(render_thread.cond,render_thread.lock);
+	}
+	if (render_thread.ready)
+		RENDER_ThreadDrop();
+	SDL_mutexV(render_thread.lock);
+}
+
+/* Copy the changed lines of the frame the thread scaled to the screen */
+static void RENDER_ThreadShow(void) {
+	SDL_mutexP(render_thread.lock);
+	bool ready = render_thread.ready;
+	SDL_mutexV(render_thread.lock);
+	if (!ready)
+		return;
+	if (render_thread.palFirst<=render_thread.palLast) {
+		GFX_SetPalette(render_thread.palFirst,render_thread.palLast-render_thread.palFirst+1,
+			&render_thread.pal[render_thread.palFirst]);
+		render_thread.palFirst = 256;
+		render_thread.palLast = 0;
+	}
+	Bit8u * pixels;
+	Bitu pitch;
+	if (GFX_StartUpdate( pixels, pitch )) {
+		Bitu line = 0;
+		Bitu width = render_thread.outPitch;
+		for (Bitu index=0;index<=render_thread.changedIndex && line<render_thread.outHeight;index++) {
+			Bitu height = render_thread.changed[index];
+			if (line+height>render_thread.outHeight)
+				height = render_thread.outHeight-line;
+			if (index & 1) {
+				for (Bitu y=line;y<line+height;y++)
+					memcpy(pixels+y*pitch,render_thread.out+y*width,width);
+			}
+			line += height;
+		}
+		GFX_EndUpdate( render_thread.changed );
+	} else {
+		render.scale.clearCache = true;
+	}
+	SDL_mutexP(render_thread.lock);
+	render_thread.ready = false;
+	SDL_CondBroadcast(render_thread.cond);
+	SDL_mutexV(render_thread.lock);
+}
+
+static void RENDER_QueueLineHandler(const void * s) {
+	if (render_thread.frame[render_thread.fill].lines >= render.src.height)
+		return;
+	Bit8u * line = render_thread.frame[render_thread.fill].data +
+		render_thread.frame[render_thread.fill].lines * render.scale.cachePitch;
+	memcpy(line, s, render.scale.cachePitch);
+	render_thread.frame[render_thread.fill].lines++;
+}
+
+static bool RENDER_ThreadStart(void) {
+	/* Drop the frame if the thread hasn't picked up the previous one yet */
+	SDL_mutexP(render_thread.lock);
+	bool full = render_thread.queued>=0;
+	render_thread.fill = (render_thread.busy == 0) ? 1 : 0;
+	SDL_mutexV(render_thread.lock);
+	if (full)
+		return false;
+	/* The thread checks the palette as it was at the start of the frame */
+	Bitu index = render_thread.fill;
+	render_thread.frame[index].lines = 0;
+	render_thread.frame[index].palFirst = 256;
+	render_thread.frame[index].palLast = 0;
+	if (render.scale.inMode == scalerMode8 && render.pal.first<=render.pal.last) {
+		memcpy(render_thread.frame[index].pal,render.pal.rgb,sizeof(render_thread.frame[index].pal));
+		render_thread.frame[index].palFirst = render.pal.first;
+		render_thread.frame[index].palLast = render.pal.last;
+		render.pal.first=256;
+		render.pal.last=0;
+	}
+	RENDER_DrawLine = RENDER_QueueLineHandler;
+	return true;
+}
+
+static void RENDER_ThreadQueue(bool abort) {
+	Bitu index = render_thread.fill;
+	if (abort || !render_thread.frame[index].lines) {
+		/* Keep the palette changes for the next frame */
+		if (render.pal.first>render_thread.frame[index].palFirst) render.pal.first=render_thread.frame[index].palFirst;
+		if (render.pal.last<render_thread.frame[index].palLast) render.pal.last=render_thread.frame[index].palLast;
+		return;
+	}
+	SDL_mutexP(render_thread.lock);
+	render_thread.queued = index;
+	SDL_CondBroadcast(render_thread.cond);
+	SDL_mutexV(render_thread.lock);
+}
+
+bool RENDER_StartUpdate(void) {
+	if (GCC_UNLIKELY(render.updating))
+		return false;
+	if (GCC_UNLIKELY(!render.active))
+		return false;
+	if (GCC_UNLIKELY(render.frameskip.count<render.frameskip.max)) {
+		render.frameskip.count++;
+		return false;
+	}
+	render.frameskip.count=0;
+	if (render_thread.enabled && !(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
+		RENDER_ThreadShow();
+		if (!RENDER_ThreadStart())
+			return false;
+		/* The thread reads it while scaling, it's only set while the thread is idle */
+		if (!render_thread.async) render_thread.async = true;
+		/* The thread gets a copy of every line */
+		render.nullInput = false;
+		render.updating = true;
+		return true;
+	}
+	/* Capturing needs the scaler cache of this frame, render it here */
+	if (render_thread.async) {
+		RENDER_Sync();
+		render_thread.async = false;
+	}
+	if (render.scale.inMode == scalerMode8) {
+		Check_Palette((GFX_PalEntry *)render.pal.rgb,render.pal.first,render.pal.last);
+		render.pal.first=256;
+		render.pal.last=0;
+	}
+	if (!RENDER_BeginFrame())
+		return false;
+	/* Complex scalers read the neighbouring lines from their own buffer */
+	render.nullInput = !render.fullFrame && !render.scale.complexHandler;
+	render.updating = true;
+	return true;
+}
+
+static void RENDER_Halt( void ) {
+	RENDER_Sync();
+	render_thread.async = false;
+	RENDER_SetLineHandler( RENDER_EmptyLineHandler );
+	GFX_EndUpdate( 0 );
+	render.updating=false;
+	render.active=false;
+}
+
+extern Bitu PIC_Ticks;
+void RENDER_EndUpdate( bool abort ) {
+	if (GCC_UNLIKELY(!render.updating))
+		return;
+	if (!abort) BENCH_Count(BENCH_COUNT_FRAMES,1);
+	if (render_thread.async) {
+		RENDER_DrawLine = RENDER_EmptyLineHandler;
+		RENDER_ThreadQueue( abort );
+	} else if (RENDER_FinishFrame( abort, (CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO)) != 0 )) {
 		render.frameskip.hadSkip[render.frameskip.index] = 0;
 	} else {
 #if 0
@@ -259,6 +513,7 @@ static Bitu MakeAspectTable(Bitu skip,Bitu height,double scaley,Bitu miny) {
 
 
 static void RENDER_Reset( void ) {
+	RENDER_Sync();
 	Bitu width=render.src.width;
 	Bitu height=render.src.height;
 	bool dblw=render.src.dblw;
@@ -491,8 +746,26 @@ forcenormal:
 	render.pal.last = 255;
 	render.pal.changed = false;
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
-	//Finish this frame using a copy only handler
-	RENDER_DrawLine = RENDER_FinishLineHandler;
+	if (render_thread.thread) {
+		Bitu size = render.scale.cachePitch * render.src.height;
+		for (Bitu i=0;i<RENDER_THREAD_FRAMES && size>render_thread.size;i++) {
+			render_thread.frame[i].data = (Bit8u *)realloc(render_thread.frame[i].data,size);
+			if (!render_thread.frame[i].data) E_Exit("RENDER:Can't allocate frame buffers");
+		}
+		if (size>render_thread.size) render_thread.size = size;
+		/* The thread scales into a buffer laid out like the screen */
+		Bitu bytes = (render.scale.outMode == scalerMode8) ? 1 :
+			(render.scale.outMode == scalerMode32) ? 4 : 2;
+		render_thread.outPitch = width * bytes;
+		render_thread.outHeight = height;
+		render_thread.out = (Bit8u *)realloc(render_thread.out,render_thread.outPitch * height);
+		if (!render_thread.out) E_Exit("RENDER:Can't allocate frame buffers");
+		render_thread.palFirst = 256;
+		render_thread.palLast = 0;
+	}
+	//Finish this frame using a copy only handler, a frame that is queued for the thread gets rendered with the new settings
+	RENDER_ScaleLine = RENDER_FinishLineHandler;
+	if (!render_thread.async) RENDER_DrawLine = RENDER_FinishLineHandler;
 	render.scale.outWrite = 0;
 	/* Signal the next frame to first reinit the cache */
 	render.scale.clearCache = true;
@@ -500,6 +773,7 @@ forcenormal:
 }
 
 static void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
+	RENDER_Sync();
 	if (function == GFX_CallBackStop) {
 		RENDER_Halt( );	
 		return;
@@ -535,6 +809,109 @@ void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool
 	RENDER_Reset( );
 }
 
+#if C_BENCHMARKS
+/* Time the scalers on frames that change completely, without output */
+static double RENDER_BenchmarkRun(ScalerLineHandler_t lineHandler,ScalerComplexHandler_t complexHandler,
+	Bitu xscale,Bitu yscale,Bitu width,Bitu height,Bitu bytes,bool simd) {
+	Bitu frames = 40;
+	render.src.width = width;
+	render.src.height = height;
+	render.src.start = (width * bytes) / sizeof(Bitu);
+	render.scale.cachePitch = width * bytes;
+	render.scale.blocks = width / SCALER_BLOCKSIZE;
+	render.scale.lastBlock = width % SCALER_BLOCKSIZE;
+	render.scale.inHeight = height;
+	render.scale.complexHandler = complexHandler;
+	render.scale.outPitch = width * xscale * bytes;
+	render.scale.simd = simd;
+	MakeAspectTable( complexHandler ? 1 : 0, height, yscale, yscale );
+	Bit8u * src = (Bit8u *)malloc(render.scale.cachePitch * height * 2);
+	Bit8u * out = (Bit8u *)malloc(render.scale.outPitch * (height + 2) * yscale);
+	if (!src || !out) E_Exit("RENDER:Can't allocate benchmark buffers");
+	/* Two frames that differ in every pixel */
+	for (Bitu i = 0;i < render.scale.cachePitch * height;i++) {
+		src[i] = (Bit8u)((i * 7) ^ (i >> 9));
+		src[i + render.scale.cachePitch * height] = ~src[i];
+	}
+	clock_t start = clock();
+	for (Bitu f = 0;f < frames;f++) {
+		const Bit8u * line = src + (f & 1) * render.scale.cachePitch * height;
+		render.scale.inLine = 0;
+		render.scale.outLine = 0;
+		render.scale.cacheRead = (Bit8u*)&scalerSourceCache;
+		render.scale.outWrite = out;
+		Scaler_ChangedLines[0] = 0;
+		Scaler_ChangedLineIndex = 0;
+		for (Bitu y = 0;y < height;y++) {
+			lineHandler( line );
+			line += render.scale.cachePitch;
+		}
+	}
+	double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC / frames;
+	free(src);
+	free(out);
+	return ms;
+}
+
+void RENDER_BenchmarkScalers(void) {
+	static const struct {
+		ScalerSimpleBlock_t * simple;
+		ScalerComplexBlock_t * complex;
+	} scalers[] = {
+		{ &ScaleNormal1x, 0 }, { &ScaleNormalDw, 0 }, { &ScaleNormalDh, 0 },
+		{ &ScaleNormal2x, 0 }, { &ScaleNormal3x, 0 },
+#if RENDER_USE_ADVANCED_SCALERS>0
+		{ &ScaleTV2x, 0 }, { &ScaleTV3x, 0 }, { &ScaleScan2x, 0 }, { &ScaleScan3x, 0 },
+		{ &ScaleRGB2x, 0 }, { &ScaleRGB3x, 0 },
+#endif
+#if RENDER_USE_ADVANCED_SCALERS>2
+		{ 0, &ScaleAdvMame2x }, { 0, &ScaleAdvMame3x }, { 0, &ScaleAdvInterp2x }, { 0, &ScaleAdvInterp3x },
+		{ 0, &ScaleHQ2x }, { 0, &ScaleHQ3x }, { 0, &Scale2xSaI }, { 0, &ScaleSuper2xSaI }, { 0, &ScaleSuperEagle },
+#endif
+	};
+	static const struct { Bitu width, height; } sizes[] = { { 320, 200 }, { 640, 480 } };
+	static const struct { Bitu bpp, bytes, index; scalerMode_t mode; } depths[] = {
+		{ 8, 1, 0, scalerMode8 }, { 16, 2, 2, scalerMode16 }, { 32, 4, 3, scalerMode32 }
+	};
+	Render_t saved = render;
+	printf("Scaler             Size     Bpp   plain ms/frame   simd ms/frame\n");
+	for (Bitu s = 0;s < sizeof(scalers)/sizeof(scalers[0]);s++) {
+		for (Bitu z = 0;z < sizeof(sizes)/sizeof(sizes[0]);z++) {
+			for (Bitu d = 0;d < sizeof(depths)/sizeof(depths[0]);d++) {
+				ScalerLineHandler_t lineHandler;
+				ScalerComplexHandler_t complexHandler = 0;
+				Bitu xscale, yscale;
+				const char * name;
+				if (scalers[s].simple) {
+					lineHandler = scalers[s].simple->Random[depths[d].index][depths[d].mode];
+					xscale = scalers[s].simple->xscale;
+					yscale = scalers[s].simple->yscale;
+					name = scalers[s].simple->name;
+				} else {
+#if RENDER_USE_ADVANCED_SCALERS>1
+					lineHandler = ScalerCache[depths[d].index][depths[d].mode];
+					complexHandler = scalers[s].complex->Random[depths[d].mode];
+					xscale = scalers[s].complex->xscale;
+					yscale = scalers[s].complex->yscale;
+					name = scalers[s].complex->name;
+#endif
+					if (!complexHandler) continue;
+				}
+				if (!lineHandler) continue;
+				render.scale.inMode = render.scale.outMode = depths[d].mode;
+				double plain = RENDER_BenchmarkRun( lineHandler, complexHandler, xscale, yscale,
+					sizes[z].width, sizes[z].height, depths[d].bytes, false );
+				double simd = RENDER_BenchmarkRun( lineHandler, complexHandler, xscale, yscale,
+					sizes[z].width, sizes[z].height, depths[d].bytes, true );
+				printf("%-12s %dx%d %4dx%-4d %3d   %14.3f  %14.3f\n", name, (int)xscale, (int)yscale,
+					(int)sizes[z].width, (int)sizes[z].height, (int)depths[d].bpp, plain, simd);
+			}
+		}
+	}
+	render = saved;
+}
+#endif
+
 extern void GFX_SetTitle(Bit32s cycles, Bits frameskip,bool paused);
 static void IncreaseFrameSkip(bool pressed) {
 	if (!pressed)
@@ -564,6 +941,27 @@ static void ChangeScaler(bool pressed) {
 	RENDER_CallBack( GFX_CallBackReset );
 } */
 
+static void RENDER_ShutDown(Section * /*sec*/) {
+	if (!render_thread.thread)
+		return;
+	SDL_mutexP(render_thread.lock);
+	render_thread.quit = true;
+	SDL_CondBroadcast(render_thread.cond);
+	SDL_mutexV(render_thread.lock);
+	SDL_WaitThread(render_thread.thread,NULL);
+	render_thread.thread = 0;
+	render_thread.enabled = false;
+	render_thread.async = false;
+	for (Bitu i=0;i<RENDER_THREAD_FRAMES;i++) {
+		free(render_thread.frame[i].data);
+		render_thread.frame[i].data = 0;
+	}
+	render_thread.size = 0;
+	free(render_thread.out);
+	render_thread.out = 0;
+	render_thread.ready = false;
+}
+
 void RENDER_Init(Section * sec) {
 	Section_prop * section=static_cast<Section_prop *>(sec);
 
@@ -579,6 +977,26 @@ void RENDER_Init(Section * sec) {
 	render.aspect=section->Get_bool("aspect");
 	render.frameskip.max=section->Get_int("frameskip");
 	render.frameskip.count=0;
+	render.scale.simd=section->Get_bool("simd");
+
+	/* Frames already handed to the thread are finished with the old settings */
+	RENDER_Sync();
+	render_thread.enabled=section->Get_bool("threaded");
+	if (render_thread.enabled && !render_thread.thread) {
+		render_thread.lock=SDL_CreateMutex();
+		render_thread.cond=SDL_CreateCond();
+		render_thread.queued=-1;
+		render_thread.busy=-1;
+		render_thread.quit=false;
+		render_thread.thread=SDL_CreateThread(&RENDER_ThreadMain,0);
+		if (!render_thread.thread) {
+			LOG_MSG("RENDER:Can't create render thread, scaling in the emulation thread");
+			render_thread.enabled=false;
+		} else if (running && render.src.bpp) {
+			/* Allocate the frame buffers */
+			RENDER_CallBack( GFX_CallBackReset );
+		}
+	}
 	std::string cline;
 	std::string scaler;
 	//Check for commandline paramters and parse them through the configclass so they get checked against allowed values
@@ -624,7 +1042,10 @@ void RENDER_Init(Section * sec) {
 				   render.scale.forced))
 		RENDER_CallBack( GFX_CallBackReset );
 
-	if(!running) render.updating=true;
+	if(!running) {
+		render.updating=true;
+		sec->AddDestroyFunction(&RENDER_ShutDown);
+	}
 	running = true;
 
 	MAPPER_AddHandler(DecreaseFrameSkip,MK_f7,MMOD1,"decfskip","Dec Fskip");
@@ -71,6 +71,101 @@ static INLINE void ScalerAddLines( Bitu changed, Bitu count ) {
 }
 
 
+/* SSE2/NEON versions of the pixel copying and cache checks, used when
+   render.scale.simd is set */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALER_SIMD 1
+typedef __m128i ScalerVec_t;
+
+static INLINE ScalerVec_t ScalerLoad( const void * src ) {
+	return _mm_loadu_si128( (const __m128i *)src );
+}
+static INLINE void ScalerStore( void * dst, ScalerVec_t v ) {
+	_mm_storeu_si128( (__m128i *)dst, v );
+}
+static INLINE ScalerVec_t ScalerZero( void ) {
+	return _mm_setzero_si128();
+}
+static INLINE bool ScalerSame( ScalerVec_t a, ScalerVec_t b ) {
+	return _mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) == 0xffff;
+}
+static INLINE void ScalerDouble8( void * dst, ScalerVec_t v ) {
+	ScalerStore( dst, _mm_unpacklo_epi8( v, v ) );
+	ScalerStore( (Bit8u *)dst + 16, _mm_unpackhi_epi8( v, v ) );
+}
+static INLINE void ScalerDouble16( void * dst, ScalerVec_t v ) {
+	ScalerStore( dst, _mm_unpacklo_epi16( v, v ) );
+	ScalerStore( (Bit8u *)dst + 16, _mm_unpackhi_epi16( v, v ) );
+}
+static INLINE void ScalerDouble32( void * dst, ScalerVec_t v ) {
+	ScalerStore( dst, _mm_unpacklo_epi32( v, v ) );
+	ScalerStore( (Bit8u *)dst + 16, _mm_unpackhi_epi32( v, v ) );
+}
+/* 5/8 of every color channel, the TV scaler halfpixel */
+static INLINE ScalerVec_t ScalerTV32( ScalerVec_t v ) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i five = _mm_set1_epi16( 5 );
+	__m128i lo = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( v, zero ), five ), 3 );
+	__m128i hi = _mm_srli_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( v, zero ), five ), 3 );
+	return _mm_and_si128( _mm_packus_epi16( lo, hi ), _mm_set1_epi32( 0x00ffffff ) );
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SCALER_SIMD 1
+typedef uint8x16_t ScalerVec_t;
+
+static INLINE ScalerVec_t ScalerLoad( const void * src ) {
+	return vld1q_u8( (const uint8_t *)src );
+}
+static INLINE void ScalerStore( void * dst, ScalerVec_t v ) {
+	vst1q_u8( (uint8_t *)dst, v );
+}
+static INLINE ScalerVec_t ScalerZero( void ) {
+	return vdupq_n_u8( 0 );
+}
+static INLINE bool ScalerSame( ScalerVec_t a, ScalerVec_t b ) {
+	uint64x2_t eq = vreinterpretq_u64_u8( vceqq_u8( a, b ) );
+	return ( vgetq_lane_u64( eq, 0 ) & vgetq_lane_u64( eq, 1 ) ) == ~(uint64_t)0;
+}
+static INLINE void ScalerDouble8( void * dst, ScalerVec_t v ) {
+	uint8x16x2_t z = vzipq_u8( v, v );
+	ScalerStore( dst, z.val[0] );
+	ScalerStore( (Bit8u *)dst + 16, z.val[1] );
+}
+static INLINE void ScalerDouble16( void * dst, ScalerVec_t v ) {
+	uint16x8x2_t z = vzipq_u16( vreinterpretq_u16_u8( v ), vreinterpretq_u16_u8( v ) );
+	ScalerStore( dst, vreinterpretq_u8_u16( z.val[0] ) );
+	ScalerStore( (Bit8u *)dst + 16, vreinterpretq_u8_u16( z.val[1] ) );
+}
+static INLINE void ScalerDouble32( void * dst, ScalerVec_t v ) {
+	uint32x4x2_t z = vzipq_u32( vreinterpretq_u32_u8( v ), vreinterpretq_u32_u8( v ) );
+	ScalerStore( dst, vreinterpretq_u8_u32( z.val[0] ) );
+	ScalerStore( (Bit8u *)dst + 16, vreinterpretq_u8_u32( z.val[1] ) );
+}
+/* 5/8 of every color channel, the TV scaler halfpixel */
+static INLINE ScalerVec_t ScalerTV32( ScalerVec_t v ) {
+	const uint8x8_t five = vdup_n_u8( 5 );
+	uint8x8_t lo = vshrn_n_u16( vmull_u8( vget_low_u8( v ), five ), 3 );
+	uint8x8_t hi = vshrn_n_u16( vmull_u8( vget_high_u8( v ), five ), 3 );
+	return vandq_u8( vcombine_u8( lo, hi ), vreinterpretq_u8_u32( vdupq_n_u32( 0x00ffffff ) ) );
+}
+#endif
+
+#if defined(SCALER_SIMD)
+/* Amount of leading bytes that are the same in both lines, multiple of 16 */
+static INLINE Bitu ScalerSameBytes( const void * _src, const void * _cache, Bitu size ) {
+	const Bit8u * src = (const Bit8u *)_src;
+	const Bit8u * cache = (const Bit8u *)_cache;
+	Bitu done;
+	for (done = 0; done + 16 <= size; done += 16) {
+		if (!ScalerSame( ScalerLoad( src + done ), ScalerLoad( cache + done ) ))
+			break;
+	}
+	return done;
+}
+#endif
+
 #define BituMove2(_DST,_SRC,_SIZE)			\
 {											\
 	Bitu bsize=(_SIZE)/sizeof(Bitu);		\
@@ -54,6 +54,19 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 			line0+=4*SCALERWIDTH;
 #else 
 	for (Bits x=render.src.width;x>0;) {
+#if defined(SCALER_SIMD)
+		if (render.scale.simd) {
+			/* Skip the unchanged part 16 bytes at a time */
+			Bitu same = ScalerSameBytes( src, cache, x * sizeof(SRCTYPE) ) / sizeof(SRCTYPE);
+			if (same) {
+				x -= same;
+				src += same;
+				cache += same;
+				line0 += same * SCALERWIDTH;
+				continue;
+			}
+		}
+#endif
 		if (*(Bitu const*)src == *(Bitu*)cache) {
 			x-=(sizeof(Bitu)/sizeof(SRCTYPE));
 			src+=(sizeof(Bitu)/sizeof(SRCTYPE));
@@ -77,7 +90,23 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #endif
 #endif //defined(SCALERLINEAR)
 			hadChange = 1;
-			for (Bitu i = x > 32 ? 32 : x;i>0;i--,x--) {
+			Bitu count = x > 32 ? 32 : x;
+#if defined(SCALER_SIMD) && defined(SCALERSIMD) && (SBPP == DBPP)
+			if (render.scale.simd) {
+				for (;count >= SCALERSIMDPIXELS;count -= SCALERSIMDPIXELS,x -= SCALERSIMDPIXELS) {
+					const ScalerVec_t V = ScalerLoad( src );
+					ScalerStore( cache, V );
+					src += SCALERSIMDPIXELS;
+					cache += SCALERSIMDPIXELS;
+					SCALERSIMD;
+					line0 += SCALERSIMDPIXELS * SCALERWIDTH;
+#if (SCALERHEIGHT > 1) 
+					line1 += SCALERSIMDPIXELS * SCALERWIDTH;
+#endif
+				}
+			}
+#endif
+			for (Bitu i = count;i>0;i--,x--) {
 				const SRCTYPE S = *src;
 				*cache = S;
 				src++;cache++;
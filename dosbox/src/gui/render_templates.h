@@ -77,6 +77,17 @@
 
 #define redblueMask (redMask | blueMask)
 
+#if defined(SCALER_SIMD)
+#define SCALERSIMDPIXELS (16/PSIZE)
+#if DBPP == 8
+#define ScalerDouble ScalerDouble8
+#elif DBPP == 15 || DBPP == 16
+#define ScalerDouble ScalerDouble16
+#elif DBPP == 32
+#define ScalerDouble ScalerDouble32
+#endif
+#endif
+
 
 #if SBPP == 8 || SBPP == 9
 #define SC scalerSourceCache.b8
@@ -170,6 +181,14 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	bool hadChange = false;
 	/* This should also copy the surrounding pixels but it looks nice enough without */
 	for (b=0;b<render.scale.blocks;b++) {
+#if defined(SCALER_SIMD) && (SBPP != 9)
+		if (render.scale.simd && ScalerSameBytes( src, sc, SCALER_BLOCKSIZE * sizeof(SRCTYPE) ) == SCALER_BLOCKSIZE * sizeof(SRCTYPE)) {
+			fc += SCALER_BLOCKSIZE;
+			sc += SCALER_BLOCKSIZE;
+			src += SCALER_BLOCKSIZE;
+			continue;
+		}
+#endif
 #if (SBPP == 9)
 		for (Bitu x=0;x<SCALER_BLOCKSIZE;x++) {
 			PTYPE pixel = PMAKE(src[x]);
@@ -218,11 +237,14 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERHEIGHT	1
 #define SCALERFUNC								\
 	line0[0] = P;
+#define SCALERSIMD								\
+	ScalerStore( line0, V );
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Normal2x
 #define SCALERWIDTH		2
@@ -232,11 +254,15 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1] = P;								\
 	line1[0] = P;								\
 	line1[1] = P;
+#define SCALERSIMD								\
+	ScalerDouble( line0, V );					\
+	ScalerDouble( line1, V );
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Normal3x
 #define SCALERWIDTH		3
@@ -263,11 +289,14 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line0[1] = P;
+#define SCALERSIMD								\
+	ScalerDouble( line0, V );
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		NormalDh
 #define SCALERWIDTH		1
@@ -275,11 +304,15 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line1[0] = P;
+#define SCALERSIMD								\
+	ScalerStore( line0, V );					\
+	ScalerStore( line1, V );
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #if (DBPP > 8)
 
@@ -297,11 +330,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line1[0]=halfpixel;						\
 	line1[1]=halfpixel;						\
 }
+#if DBPP == 32
+#define SCALERSIMD								\
+	ScalerDouble( line0, V );					\
+	ScalerDouble( line1, ScalerTV32( V ) );
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		TV3x
 #define SCALERWIDTH		3
@@ -369,11 +408,15 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1]=P;							\
 	line1[0]=0;							\
 	line1[1]=0;
+#define SCALERSIMD								\
+	ScalerDouble( line0, V );					\
+	ScalerDouble( line1, ScalerZero() );
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Scan3x
 #define SCALERWIDTH		3
@@ -560,6 +603,8 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 
 #endif // #if RENDER_USE_ADVANCED_SCALERS>2
 
+#undef SCALERSIMDPIXELS
+#undef ScalerDouble
 #undef PSIZE
 #undef PTYPE
 #undef PMAKE
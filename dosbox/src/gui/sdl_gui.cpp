@@ -92,6 +92,7 @@ static void getPixel(Bits x, Bits y, int &r, int &g, int &b, int shift)
 }
 
 static GUI::ScreenSDL *UI_Startup(GUI::ScreenSDL *screen) {
+	RENDER_Sync();
 	GFX_EndUpdate(0);
 	GFX_SetTitle(-1,-1,true);
 	if(!screen) { //Coming from DOSBox. Clean up the keyboard buffer.
@@ -32,6 +32,7 @@
 
 #include "dosbox.h"
 #include "video.h"
+#include "render.h"
 #include "keyboard.h"
 #include "joystick.h"
 #include "support.h"
@@ -2344,6 +2345,7 @@ void MAPPER_RunInternal() {
 	}
 
 	/* Be sure that there is no update in progress */
+	RENDER_Sync();
 	GFX_EndUpdate( 0 );
 	mapper.surface=SDL_SetVideoMode(640,480,8,0);
 	if (mapper.surface == NULL) E_Exit("Could not initialize video mode for mapper: %s",SDL_GetError());
@@ -25,6 +25,9 @@
 extern "C" {
     extern void SDL_init_keyboard();
     extern void dospad_should_pause();
+    void dospad_save_state(const char *path);
+    void dospad_load_state(const char *path);
+    void dospad_service_state();
 }
 #endif
 
@@ -44,18 +47,24 @@ extern "C" {
 
 #include "dosbox.h"
 #include "video.h"
+#include "render.h"
 #include "mouse.h"
 #include "pic.h"
+#include "paging.h"
 #include "timer.h"
 #include "setup.h"
 #include "support.h"
 #include "debug.h"
 #include "mapper.h"
 #include "vga.h"
+#include "mixer.h"
+#include "hardware.h"
 #include "keyboard.h"
 #include "cpu.h"
 #include "cross.h"
 #include "control.h"
+#include "savestate.h"
+#include "benchmark.h"
 
 #define MAPPERFILE "mapper-" VERSION ".map"
 //#define DISABLE_JOYSTICK
@@ -764,44 +773,75 @@ bool GFX_StartUpdate(Bit8u * & pixels,Bitu & pitch) {
 }
 
 
+/* Turn the run-length changedLines array of the scalers into dirty rectangles
+ * in sdl.updateRects, offset by x/y. Runs past the end of the array are merged
+ * into the last rectangle. Returns the amount of rectangles. */
+static Bitu GFX_DirtyRects( const Bit16u *changedLines, Bitu x, Bitu y ) {
+	const Bitu maxRects = sizeof(sdl.updateRects)/sizeof(sdl.updateRects[0]);
+	Bitu line = 0, index = 0, rectCount = 0;
+	while (line < sdl.draw.height) {
+		Bitu height = changedLines[index];
+		if (index & 1) {
+			if (rectCount < maxRects) {
+				SDL_Rect *rect = &sdl.updateRects[rectCount++];
+				rect->x = x;
+				rect->y = y + line;
+				rect->w = (Bit16u)sdl.draw.width;
+				rect->h = height;
+			} else {
+				SDL_Rect *rect = &sdl.updateRects[maxRects - 1];
+				rect->h = y + line + height - rect->y;
+			}
+		}
+		line += height;
+		index++;
+	}
+	return rectCount;
+}
+
 void GFX_EndUpdate( const Bit16u *changedLines ) {
 #if (HAVE_DDRAW_H) && defined(WIN32)
 	int ret;
 #endif
+	Bitu rectCount;
 	if (!sdl.updating)
 		return;
 	sdl.updating=false;
 	switch (sdl.desktop.type) {
 	case SCREEN_SURFACE:
 		if (SDL_MUSTLOCK(sdl.surface)) {
+			/* A double buffered surface has to be flipped as a whole,
+			 * otherwise only present the lines the scalers changed */
+			bool partial = changedLines && !(sdl.surface->flags & SDL_DOUBLEBUF);
+			rectCount = partial ? GFX_DirtyRects( changedLines, 0, 0 ) : 0;
 			if (sdl.blit.surface) {
 				SDL_UnlockSurface(sdl.blit.surface);
-				int Blit = SDL_BlitSurface( sdl.blit.surface, 0, sdl.surface, &sdl.clip );
-				LOG(LOG_MISC,LOG_WARN)("BlitSurface returned %d",Blit);
+				if (partial) {
+					for (Bitu i = 0; i < rectCount; i++) {
+						SDL_Rect src = sdl.updateRects[i];
+						SDL_Rect dst = src;
+						dst.x += sdl.clip.x;
+						dst.y += sdl.clip.y;
+						SDL_BlitSurface( sdl.blit.surface, &src, sdl.surface, &dst );
+					}
+				} else {
+					int Blit = SDL_BlitSurface( sdl.blit.surface, 0, sdl.surface, &sdl.clip );
+					LOG(LOG_MISC,LOG_WARN)("BlitSurface returned %d",Blit);
+				}
 			} else {
 				SDL_UnlockSurface(sdl.surface);
 			}
-			SDL_Flip(sdl.surface);
-		} else if (changedLines) {
-			Bitu y = 0, index = 0, rectCount = 0;
-			while (y < sdl.draw.height) {
-				if (!(index & 1)) {
-					y += changedLines[index];
-				} else {
-					SDL_Rect *rect = &sdl.updateRects[rectCount++];
-					rect->x = sdl.clip.x;
-					rect->y = sdl.clip.y + y;
-					rect->w = (Bit16u)sdl.draw.width;
-					rect->h = changedLines[index];
-#if 0
-					if (rect->h + rect->y > sdl.surface->h) {
-						LOG_MSG("WTF %d +  %d  >%d",rect->h,rect->y,sdl.surface->h);
-					}
-#endif
-					y += changedLines[index];
+			if (!partial) {
+				SDL_Flip(sdl.surface);
+			} else if (rectCount) {
+				for (Bitu i = 0; i < rectCount; i++) {
+					sdl.updateRects[i].x += sdl.clip.x;
+					sdl.updateRects[i].y += sdl.clip.y;
 				}
-				index++;
+				SDL_UpdateRects( sdl.surface, rectCount, sdl.updateRects );
 			}
+		} else if (changedLines) {
+			rectCount = GFX_DirtyRects( changedLines, sdl.clip.x, sdl.clip.y );
 			if (rectCount)
 				SDL_UpdateRects( sdl.surface, rectCount, sdl.updateRects );
 		}
@@ -832,31 +872,20 @@ void GFX_EndUpdate( const Bit16u *changedLines ) {
 		break;
 #if C_OPENGL
 	case SCREEN_OPENGL:
-#if defined(NVIDIA_PixelDataRange)
-		if (sdl.opengl.pixel_data_range) {
-            glBindTexture(GL_TEXTURE_2D, sdl.opengl.texture);
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
-					sdl.draw.width, sdl.draw.height, GL_BGRA_EXT,
-					GL_UNSIGNED_INT_8_8_8_8_REV, sdl.opengl.framebuf);
-			glCallList(sdl.opengl.displaylist);
-			SDL_GL_SwapBuffers();
-		} else
-#endif
+		/* Only upload the changed runs, the texture keeps the other lines.
+		 * With pixel data range the framebuffer lives in AGP memory and the
+		 * same partial uploads apply */
 		if (changedLines) {
-			Bitu y = 0, index = 0;
+			rectCount = GFX_DirtyRects( changedLines, 0, 0 );
+			if (!rectCount)
+				break;
             glBindTexture(GL_TEXTURE_2D, sdl.opengl.texture);
-			while (y < sdl.draw.height) {
-				if (!(index & 1)) {
-					y += changedLines[index];
-				} else {
-					Bit8u *pixels = (Bit8u *)sdl.opengl.framebuf + y * sdl.opengl.pitch;
-					Bitu height = changedLines[index];
-					glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y,
-						sdl.draw.width, height, GL_BGRA_EXT,
-						GL_UNSIGNED_INT_8_8_8_8_REV, pixels );
-					y += height;
-				}
-				index++;
+			for (Bitu i = 0; i < rectCount; i++) {
+				const SDL_Rect *rect = &sdl.updateRects[i];
+				Bit8u *pixels = (Bit8u *)sdl.opengl.framebuf + rect->y * sdl.opengl.pitch;
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rect->y,
+					sdl.draw.width, rect->h, GL_BGRA_EXT,
+					GL_UNSIGNED_INT_8_8_8_8_REV, pixels );
 			}
 			glCallList(sdl.opengl.displaylist);
 			SDL_GL_SwapBuffers();
@@ -907,6 +936,7 @@ Bitu GFX_GetRGB(Bit8u red,Bit8u green,Bit8u blue) {
 }
 
 void GFX_Stop() {
+	RENDER_Sync();
 	if (sdl.updating)
 		GFX_EndUpdate( 0 );
 	sdl.active=false;
@@ -1328,6 +1358,21 @@ static void HandleMouseButton(SDL_MouseButtonEvent * button) {
 	}
 }
 
+#ifdef IPHONEOS
+/* The app only posts requests, they run on the emulation thread between two ticks */
+void dospad_save_state(const char *path) {
+	SAVESTATE_RequestSave(path);
+}
+
+void dospad_load_state(const char *path) {
+	SAVESTATE_RequestLoad(path);
+}
+
+void dospad_service_state() {
+	if (SAVESTATE_Pending) SAVESTATE_Service();
+}
+#endif
+
 void GFX_LosingFocus(void) {
 	sdl.laltstate=SDL_KEYUP;
 	sdl.raltstate=SDL_KEYUP;
@@ -1755,6 +1800,9 @@ int main(int argc, char* argv[]) {
 			return 0;
 		}
 		if(control->cmdline->FindExist("-printconf")) printconfiglocation();
+#if C_BENCHMARKS
+		if(BENCH_RunMicro()) return 0;
+#endif
 
 #if C_DEBUG
 		DEBUG_SetupConsole();
@@ -1779,6 +1827,11 @@ int main(int argc, char* argv[]) {
 	LOG_MSG("---");
 
 	/* Init SDL */
+	if (BENCH_Headless()) {
+		/* Benchmark runs don't need a window or a sound card */
+		putenv(const_cast<char*>("SDL_VIDEODRIVER=dummy"));
+		putenv(const_cast<char*>("SDL_AUDIODRIVER=dummy"));
+	}
 #if SDL_VERSION_ATLEAST(1, 2, 14)
 	putenv(const_cast<char*>("SDL_DISABLE_LOCK_KEYS=1"));
 #endif
@@ -1913,6 +1966,11 @@ int main(int argc, char* argv[]) {
 //		if (control->cmdline->FindExist("-startui")) UI_Run(false);
 		/* Init all the sections */
 		control->Init();
+		/* Compare the recompiler with the normal core instead of starting the machine */
+		if (control->cmdline->FindExist("-checkdynrec")) {
+			CPU_Core_Dynrec_Check();
+			throw(0);
+		}
 		/* Some extra SDL Functions */
 		Section_prop * sdl_sec=static_cast<Section_prop *>(control->GetSection("sdl"));
 
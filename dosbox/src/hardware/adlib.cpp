@@ -22,12 +22,16 @@
 #include <string.h>
 #include <math.h>
 #include <sys/types.h>
+#include <vector>
+#include "SDL.h"
+#include "SDL_thread.h"
 #include "adlib.h"
 
 #include "setup.h"
 #include "mapper.h"
 #include "mem.h"
 #include "dbopl.h"
+#include "savestate.h"
 
 namespace OPL2 {
 	#include "opl.cpp"
@@ -86,6 +90,195 @@ namespace OPL3 {
 	};
 }
 
+namespace DBOPL {
+
+//Size of the buffer with samples the thread finished
+#define THREAD_BUFSIZE 4096
+
+/*
+	The chip is only touched by a separate thread, the register writes are queued
+	in order with the sample requests. Samples are handed out 2ms after they were
+	requested, in the meantime the thread renders them next to the emulation.
+*/
+struct ThreadedHandler : public Handler {
+	SDL_Thread* thread;
+	SDL_mutex* lock;
+	SDL_cond* cond;
+	bool quit;
+	//Copy of the opl3 enable for WriteAddr, the one in the chip belongs to the thread
+	Bit8s opl3Active;
+	//Writes since the last request, only used by the emulation
+	std::vector< Bit32u > pending;
+	//Writes and requests the thread hasn't taken yet
+	std::vector< Bit32u > queue;
+	//Stereo samples the thread finished
+	Bit32s output[ THREAD_BUFSIZE ][ 2 ];
+	Bitu outRead, outWrite;
+
+	void Flush();
+	int Run();
+	virtual Bit32u WriteAddr( Bit32u port, Bit8u val );
+	virtual void WriteReg( Bit32u addr, Bit8u val );
+	virtual void Generate( MixerChannel* chan, Bitu samples );
+	virtual void Init( Bitu rate );
+	ThreadedHandler();
+	~ThreadedHandler();
+};
+
+//Commands in the queue with this bit set ask for samples, the others are register writes
+#define THREAD_GENERATE 0x80000000
+
+static int ThreadMain( void* data ) {
+	return static_cast< ThreadedHandler* >( data )->Run();
+}
+
+ThreadedHandler::ThreadedHandler() {
+	thread = 0;
+	lock = 0;
+	cond = 0;
+	quit = false;
+	opl3Active = 0;
+	outRead = outWrite = 0;
+}
+
+ThreadedHandler::~ThreadedHandler() {
+	if ( thread ) {
+		SDL_mutexP( lock );
+		quit = true;
+		SDL_CondBroadcast( cond );
+		SDL_mutexV( lock );
+		SDL_WaitThread( thread, 0 );
+	}
+	if ( cond )
+		SDL_DestroyCond( cond );
+	if ( lock )
+		SDL_DestroyMutex( lock );
+}
+
+int ThreadedHandler::Run() {
+	std::vector< Bit32u > work;
+	Bit32s buffer[ 512 * 2 ];
+	SDL_mutexP( lock );
+	for ( ;; ) {
+		while ( queue.empty() && !quit )
+			SDL_CondWait( cond, lock );
+		if ( quit )
+			break;
+		work.swap( queue );
+		SDL_mutexV( lock );
+		for ( Bitu c = 0; c < work.size(); c++ ) {
+			Bit32u cmd = work[ c ];
+			if ( !(cmd & THREAD_GENERATE) ) {
+				chip.WriteReg( cmd >> 8, cmd & 0xff );
+				continue;
+			}
+			Bitu samples = cmd & ~THREAD_GENERATE;
+			if ( !chip.opl3Active ) {
+				chip.GenerateBlock2( samples, buffer );
+				//Spread the mono samples out to both sides, from the end to not overwrite any
+				for ( Bitu i = samples; i > 0; ) {
+					i--;
+					buffer[ i * 2 + 1 ] = buffer[ i ];
+					buffer[ i * 2 + 0 ] = buffer[ i ];
+				}
+			} else {
+				chip.GenerateBlock3( samples, buffer );
+			}
+			SDL_mutexP( lock );
+			for ( Bitu i = 0; i < samples; i++ ) {
+				Bit32s* out = output[ (outWrite + i) & (THREAD_BUFSIZE - 1) ];
+				out[0] = buffer[ i * 2 + 0 ];
+				out[1] = buffer[ i * 2 + 1 ];
+			}
+			outWrite += samples;
+			SDL_CondBroadcast( cond );
+			SDL_mutexV( lock );
+		}
+		work.clear();
+		SDL_mutexP( lock );
+	}
+	SDL_mutexV( lock );
+	return 0;
+}
+
+//Hand the pending writes to the thread, the lock has to be held
+void ThreadedHandler::Flush() {
+	queue.insert( queue.end(), pending.begin(), pending.end() );
+	pending.clear();
+	SDL_CondBroadcast( cond );
+}
+
+Bit32u ThreadedHandler::WriteAddr( Bit32u port, Bit8u val ) {
+	if ( !thread )
+		return chip.WriteAddr( port, val );
+	switch ( port & 3 ) {
+	case 0:
+		return val;
+	case 2:
+		if ( opl3Active || (val == 0x05) )
+			return 0x100 | val;
+		else 
+			return val;
+	}
+	return 0;
+}
+
+void ThreadedHandler::WriteReg( Bit32u addr, Bit8u val ) {
+	if ( !thread ) {
+		chip.WriteReg( addr, val );
+		return;
+	}
+	if ( addr == 0x105 )
+		opl3Active = ( val & 1 ) ? 0xff : 0;
+	pending.push_back( (addr << 8) | val );
+	//Don't collect too much while the channel is disabled
+	if ( GCC_UNLIKELY( pending.size() >= THREAD_BUFSIZE ) ) {
+		SDL_mutexP( lock );
+		Flush();
+		SDL_mutexV( lock );
+	}
+}
+
+void ThreadedHandler::Generate( MixerChannel* chan, Bitu samples ) {
+	if ( !thread ) {
+		Handler::Generate( chan, samples );
+		return;
+	}
+	Bit32s buffer[ 512 * 2 ];
+	if ( GCC_UNLIKELY(samples > 512) )
+		samples = 512;
+	pending.push_back( THREAD_GENERATE | samples );
+	SDL_mutexP( lock );
+	Flush();
+	//The thread renders the samples of earlier requests while the emulation runs, they're usually ready
+	while ( outWrite - outRead < samples )
+		SDL_CondWait( cond, lock );
+	for ( Bitu i = 0; i < samples; i++ ) {
+		const Bit32s* in = output[ (outRead + i) & (THREAD_BUFSIZE - 1) ];
+		buffer[ i * 2 + 0 ] = in[0];
+		buffer[ i * 2 + 1 ] = in[1];
+	}
+	outRead += samples;
+	SDL_mutexV( lock );
+	chan->AddSamples_s32( samples, buffer );
+}
+
+void ThreadedHandler::Init( Bitu rate ) {
+	Handler::Init( rate );
+	//Start 2ms behind, that's how long the thread has for a request
+	outRead = 0;
+	outWrite = rate / 500;
+	memset( output, 0, sizeof( output ) );
+	lock = SDL_CreateMutex();
+	cond = SDL_CreateCond();
+	if ( lock && cond )
+		thread = SDL_CreateThread( &ThreadMain, this );
+	if ( !thread )
+		LOG_MSG( "OPL:Can't create thread, rendering in the emulation thread" );
+}
+
+}
+
 #define RAW_SIZE 1024
 
 
@@ -97,38 +290,6 @@ namespace OPL3 {
 namespace Adlib {
 
 
-/* Raw DRO capture stuff */
-
-#ifdef _MSC_VER
-#pragma pack (1)
-#endif
-
-#define HW_OPL2 0
-#define HW_DUALOPL2 1
-#define HW_OPL3 2
-
-struct RawHeader {
-	Bit8u id[8];				/* 0x00, "DBRAWOPL" */
-	Bit16u versionHigh;			/* 0x08, size of the data following the m */
-	Bit16u versionLow;			/* 0x0a, size of the data following the m */
-	Bit32u commands;			/* 0x0c, Bit32u amount of command/data pairs */
-	Bit32u milliseconds;		/* 0x10, Bit32u Total milliseconds of data in this chunk */
-	Bit8u hardware;				/* 0x14, Bit8u Hardware Type 0=opl2,1=dual-opl2,2=opl3 */
-	Bit8u format;				/* 0x15, Bit8u Format 0=cmd/data interleaved, 1 maybe all cdms, followed by all data */
-	Bit8u compression;			/* 0x16, Bit8u Compression Type, 0 = No Compression */
-	Bit8u delay256;				/* 0x17, Bit8u Delay 1-256 msec command */
-	Bit8u delayShift8;			/* 0x18, Bit8u (delay + 1)*256 */			
-	Bit8u conversionTableSize;	/* 0x191, Bit8u Raw Conversion Table size */
-} GCC_ATTRIBUTE(packed);
-#ifdef _MSC_VER
-#pragma pack()
-#endif
-/*
-	The Raw Tables is < 128 and is used to convert raw commands into a full register index 
-	When the high bit of a raw command is set it indicates the cmd/data pair is to be sent to the 2nd port
-	After the conversion table the raw data follows immediatly till the end of the chunk
-*/
-
 //Table to map the opl register to one <127 for dro saving
 class Capture {
 	//127 entries to go from raw data to registers
@@ -409,6 +570,18 @@ Bit8u Chip::Read( ) {
 
 }
 
+double Chip::NextOverflow( ) const {
+	double next = -1;
+	for ( Bitu i = 0; i < 2; i++ ) {
+		const Timer& t = timer[i];
+		if ( !t.enabled || !t.delay || t.masked || t.overflow )
+			continue;
+		if ( next < 0 || t.start < next )
+			next = t.start;
+	}
+	return next;
+}
+
 void Module::CacheWrite( Bit32u reg, Bit8u val ) {
 	//capturing?
 	if ( capture ) {
@@ -523,6 +696,23 @@ Bitu Module::PortRead( Bitu port, Bitu iolen ) {
 	return 0;
 }
 
+double Module::PortPoll( Bitu port ) {
+	switch ( mode ) {
+	case MODE_OPL2:
+	case MODE_OPL3:
+		if ( !(port & 3 ) ) {
+			return chip[0].NextOverflow();
+		}
+		break;
+	case MODE_DUALOPL2:
+		if ( !(port & 1 ) ) {
+			return chip[ (port >> 1) & 1].NextOverflow();
+		}
+		break;
+	}
+	//The other ports never change
+	return -1;
+}
 
 void Module::Init( Mode m ) {
 	mode = m;
@@ -539,11 +729,43 @@ void Module::Init( Mode m ) {
 	}
 }
 
+void Module::SaveState( ) {
+	SAVESTATE_WriteVar( mode );
+	SAVESTATE_Write( &reg, sizeof( reg ) );
+	SAVESTATE_WriteVar( cache );
+	SAVESTATE_WriteVar( chip );
+	SAVESTATE_WriteVar( lastUsed );
+}
+
+void Module::LoadState( ) {
+	Mode savedMode;
+	SAVESTATE_ReadVar( savedMode );
+	if ( savedMode != mode ) 
+		E_Exit( "SAVESTATE:OPL mode doesn't match" );
+	SAVESTATE_Read( &reg, sizeof( reg ) );
+	SAVESTATE_ReadVar( cache );
+	SAVESTATE_ReadVar( chip );
+	SAVESTATE_ReadVar( lastUsed );
+	//The emulator state itself isn't saved, rebuild it from the registers
+	//Start with the opl3 enable and 4op selection, they change how the rest works
+	handler->WriteReg( 0x105, cache[ 0x105 ] );
+	handler->WriteReg( 0x104, cache[ 0x104 ] );
+	for ( Bit32u i = 0; i < 512; i++ ) {
+		Bit32u index = i & 0xff;
+		//Skip the timer registers and the ones done above
+		if ( index >= 0x02 && index <= 0x05 )
+			continue;
+		handler->WriteReg( i, cache[ i ] );
+	}
+}
+
 }; //namespace
 
 
 
 static Adlib::Module* module = 0;
+//Set when the module renders with a DBOPL thread
+static DBOPL::ThreadedHandler* threadedHandler = 0;
 
 static void OPL_CallBack(Bitu len) {
 	module->handler->Generate( module->mixerChan, len );
@@ -560,6 +782,12 @@ static Bitu OPL_Read(Bitu port,Bitu iolen) {
 	return module->PortRead( port, iolen );
 }
 
+static double OPL_Poll(Bitu port) {
+	if ( !module )
+		return -1;
+	return module->PortPoll( port );
+}
+
 void OPL_Write(Bitu port,Bitu val,Bitu iolen) {
 	module->PortWrite( port, val, iolen );
 }
@@ -622,6 +850,14 @@ static void OPL_SaveRawEvent(bool pressed) {
 	}
 }
 
+static void OPL_SaveState(void) {
+	module->SaveState();
+}
+
+static void OPL_LoadState(void) {
+	module->LoadState();
+}
+
 namespace Adlib {
 
 Module::Module( Section* configuration ) : Module_base(configuration) {
@@ -641,14 +877,16 @@ Module::Module( Section* configuration ) : Module_base(configuration) {
 
 	mixerChan = mixerObject.Install(OPL_CallBack,rate,"FM");
 	mixerChan->SetScale( 2.0 );
-	if (oplemu == "fast") {
-		handler = new DBOPL::Handler();
-	} else if (oplemu == "compat") {
+	bool threaded = section->Get_bool("oplthread");
+	if (oplemu == "compat") {
 		if ( oplmode == OPL_opl2 ) {
 			handler = new OPL2::Handler();
 		} else {
 			handler = new OPL3::Handler();
 		}
+	} else if ( threaded ) {
+		threadedHandler = new DBOPL::ThreadedHandler();
+		handler = threadedHandler;
 	} else {
 		handler = new DBOPL::Handler();
 	}
@@ -678,17 +916,25 @@ Module::Module( Section* configuration ) : Module_base(configuration) {
 	//0x228 range
 	WriteHandler[2].Install(base+8,OPL_Write,IO_MB, 2);
 	ReadHandler[2].Install(base+8,OPL_Read,IO_MB, 1);
+	PollHandler[0].Install(0x388,OPL_Poll,4);
+	if ( !single ) {
+		PollHandler[1].Install(base,OPL_Poll,4);
+	}
+	PollHandler[2].Install(base+8,OPL_Poll,1);
 
 	MAPPER_AddHandler(OPL_SaveRawEvent,MK_f7,MMOD1|MMOD2,"caprawopl","Cap OPL");
+	SAVESTATE_AddHandler("OPL",OPL_SaveState,OPL_LoadState);
 }
 
 Module::~Module() {
+	SAVESTATE_RemoveHandler("OPL");
 	if ( capture ) {
 		delete capture;
 	}
 	if ( handler ) {
 		delete handler;
 	}
+	threadedHandler = 0;
 }
 
 //Initialize static members
@@ -702,6 +948,10 @@ void OPL_Init(Section* sec,OPL_Mode oplmode) {
 	module = new Adlib::Module( sec );
 }
 
+bool OPL_ThreadRunning(void) {
+	return threadedHandler && threadedHandler->thread;
+}
+
 void OPL_ShutDown(Section* sec){
 	delete module;
 	module = 0;
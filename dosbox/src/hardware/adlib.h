@@ -85,6 +85,8 @@ struct Chip {
 	bool Write( Bit32u addr, Bit8u val );
 	//Read the current timer state, will use current double
 	Bit8u Read( );
+	//Time the next timer overflows, negative when none will
+	double NextOverflow( ) const;
 };
 
 //The type of handler this is
@@ -111,12 +113,45 @@ public:
 //The cache for 2 chips or an opl3
 typedef Bit8u RegisterCache[512];
 
+/* Raw DRO capture stuff */
+
+#ifdef _MSC_VER
+#pragma pack (1)
+#endif
+
+#define HW_OPL2 0
+#define HW_DUALOPL2 1
+#define HW_OPL3 2
+
+struct RawHeader {
+	Bit8u id[8];				/* 0x00, "DBRAWOPL" */
+	Bit16u versionHigh;			/* 0x08, size of the data following the m */
+	Bit16u versionLow;			/* 0x0a, size of the data following the m */
+	Bit32u commands;			/* 0x0c, Bit32u amount of command/data pairs */
+	Bit32u milliseconds;		/* 0x10, Bit32u Total milliseconds of data in this chunk */
+	Bit8u hardware;				/* 0x14, Bit8u Hardware Type 0=opl2,1=dual-opl2,2=opl3 */
+	Bit8u format;				/* 0x15, Bit8u Format 0=cmd/data interleaved, 1 maybe all cdms, followed by all data */
+	Bit8u compression;			/* 0x16, Bit8u Compression Type, 0 = No Compression */
+	Bit8u delay256;				/* 0x17, Bit8u Delay 1-256 msec command */
+	Bit8u delayShift8;			/* 0x18, Bit8u (delay + 1)*256 */			
+	Bit8u conversionTableSize;	/* 0x191, Bit8u Raw Conversion Table size */
+} GCC_ATTRIBUTE(packed);
+#ifdef _MSC_VER
+#pragma pack()
+#endif
+/*
+	The Raw Tables is < 128 and is used to convert raw commands into a full register index 
+	When the high bit of a raw command is set it indicates the cmd/data pair is to be sent to the 2nd port
+	After the conversion table the raw data follows immediatly till the end of the chunk
+*/
+
 //Internal class used for dro capturing
 class Capture;
 
 class Module: public Module_base {
 	IO_ReadHandleObject ReadHandler[3];
 	IO_WriteHandleObject WriteHandler[3];
+	IO_PollHandleObject PollHandler[3];
 	MixerObject mixerObject;
 
 	//Mode we're running in
@@ -141,7 +176,10 @@ public:
 	//Handle port writes
 	void PortWrite( Bitu port, Bitu val, Bitu iolen );
 	Bitu PortRead( Bitu port, Bitu iolen );
+	double PortPoll( Bitu port );
 	void Init( Mode m );
+	void SaveState( );
+	void LoadState( );
 
 	Module( Section* configuration); 
 	~Module();
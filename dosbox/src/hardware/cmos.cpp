@@ -29,6 +29,7 @@
 #include "bios_disk.h"
 #include "setup.h"
 #include "cross.h" //fmod on certain platforms
+#include "savestate.h"
 
 static struct {
 	Bit8u regs[0x40];
@@ -289,6 +290,14 @@ void CMOS_SetRegister(Bitu regNr, Bit8u val) {
 }
 
 
+static void CMOS_SaveState(void) {
+	SAVESTATE_Write(&cmos,sizeof(cmos));
+}
+
+static void CMOS_LoadState(void) {
+	SAVESTATE_Read(&cmos,sizeof(cmos));
+}
+
 class CMOS:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[2];
@@ -316,6 +325,7 @@ public:
 		cmos.regs[0x18]=(Bit8u)(exsize >> 8);
 		cmos.regs[0x30]=(Bit8u)exsize;
 		cmos.regs[0x31]=(Bit8u)(exsize >> 8);
+		SAVESTATE_AddHandler("CMOS",CMOS_SaveState,CMOS_LoadState);
 	}
 };
 
@@ -26,6 +26,7 @@
 #include "pic.h"
 #include "paging.h"
 #include "setup.h"
+#include "savestate.h"
 
 DmaController *DmaControllers[2];
 
@@ -337,6 +338,43 @@ again:
 	return done;
 }
 
+void DmaController::SaveState(void) {
+	SAVESTATE_WriteVar(flipflop);
+	for (Bit8u i=0;i<4;i++) {
+		SAVESTATE_Write(DmaChannels[i],sizeof(DmaChannel));
+		SAVESTATE_WriteCode((void *)DmaChannels[i]->callback);
+	}
+}
+
+void DmaController::LoadState(void) {
+	SAVESTATE_ReadVar(flipflop);
+	for (Bit8u i=0;i<4;i++) {
+		SAVESTATE_Read(DmaChannels[i],sizeof(DmaChannel));
+		DmaChannels[i]->callback=(DMA_CallBack)SAVESTATE_ReadCode();
+	}
+}
+
+static void DMA_SaveState(void) {
+	SAVESTATE_WriteVar(dma_wrapping);
+	SAVESTATE_WriteVar(ems_board_mapping);
+	for (Bitu i=0;i<2;i++) {
+		bool present=DmaControllers[i]!=NULL;
+		SAVESTATE_WriteVar(present);
+		if (present) DmaControllers[i]->SaveState();
+	}
+}
+
+static void DMA_LoadState(void) {
+	SAVESTATE_ReadVar(dma_wrapping);
+	SAVESTATE_ReadVar(ems_board_mapping);
+	for (Bitu i=0;i<2;i++) {
+		bool present;
+		SAVESTATE_ReadVar(present);
+		if (present!=(DmaControllers[i]!=NULL)) E_Exit("SAVESTATE:DMA controllers don't match");
+		if (present) DmaControllers[i]->LoadState();
+	}
+}
+
 class DMA:public Module_base{
 public:
 	DMA(Section* configuration):Module_base(configuration){
@@ -366,6 +404,7 @@ public:
 			DmaControllers[1]->DMA_WriteHandler[0x10].Install(0x89,DMA_Write_Port,IO_MB,3);
 			DmaControllers[1]->DMA_ReadHandler[0x10].Install(0x89,DMA_Read_Port,IO_MB,3);
 		}
+		SAVESTATE_AddHandler("DMA",DMA_SaveState,DMA_LoadState);
 	}
 	~DMA(){
 		if (DmaControllers[0]) {
@@ -30,6 +30,7 @@
 #include "shell.h"
 #include "math.h"
 #include "regs.h"
+#include "savestate.h"
 using namespace std;
 
 //Extra bits of precision over normal gus
@@ -776,6 +777,35 @@ static void MakeTables(void) {
 	}
 }
 
+static Bit64u GUSRamHashes[SAVESTATE_PAGES(sizeof(GUSRam))];
+
+static void GUS_SaveRam(void) {
+	SAVESTATE_WritePages(GUSRam,sizeof(GUSRam),GUSRamHashes);
+}
+
+static void GUS_LoadRam(void) {
+	SAVESTATE_ReadPages(GUSRam,sizeof(GUSRam),GUSRamHashes);
+}
+
+static void GUS_SaveState(void) {
+	SAVESTATE_WriteVar(myGUS);
+	SAVESTATE_WriteVar(adlib_commandreg);
+	SAVESTATE_WriteVar(AutoAmp);
+	for (Bitu i=0;i<32;i++) SAVESTATE_WriteVar(*guschan[i]);
+	Bit8u cur=curchan ? curchan->channum : 0xff;
+	SAVESTATE_WriteVar(cur);
+}
+
+static void GUS_LoadState(void) {
+	SAVESTATE_ReadVar(myGUS);
+	SAVESTATE_ReadVar(adlib_commandreg);
+	SAVESTATE_ReadVar(AutoAmp);
+	for (Bitu i=0;i<32;i++) SAVESTATE_ReadVar(*guschan[i]);
+	Bit8u cur;
+	SAVESTATE_ReadVar(cur);
+	curchan=(cur<32) ? guschan[cur] : 0;
+}
+
 class GUS:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[8];
@@ -843,6 +873,8 @@ public:
 		}
 		// Register the Mixer CallBack 
 		gus_chan=MixerChan.Install(GUS_CallBack,GUS_RATE,"GUS");
+		SAVESTATE_AddHandler("GUSMEM",GUS_SaveRam,GUS_LoadRam,true);
+		SAVESTATE_AddHandler("GUS",GUS_SaveState,GUS_LoadState);
 		myGUS.gRegData=0x1;
 		GUSReset();
 		myGUS.gRegData=0x0;
@@ -865,6 +897,8 @@ public:
 		Section_prop * section=static_cast<Section_prop *>(m_configuration);
 		if(!section->Get_bool("gus")) return;
 	
+		SAVESTATE_RemoveHandler("GUSMEM");
+		SAVESTATE_RemoveHandler("GUS");
 		myGUS.gRegData=0x1;
 		GUSReset();
 		myGUS.gRegData=0x0;
@@ -24,12 +24,15 @@
 #include "setup.h"
 #include "cpu.h"
 #include "../cpu/lazyflags.h"
+#include "profiler.h"
 #include "callback.h"
+#include "pic.h"
 
 //#define ENABLE_PORTLOG
 
 IO_WriteHandler * io_writehandlers[3][IO_MAX];
 IO_ReadHandler * io_readhandlers[3][IO_MAX];
+static IO_PollHandler * io_pollhandlers[IO_MAX];
 
 static Bitu IO_ReadBlocked(Bitu /*port*/,Bitu /*iolen*/) {
 	return ~0;
@@ -109,6 +112,14 @@ void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range) {
 	}
 }
 
+void IO_RegisterPollHandler(Bitu port,IO_PollHandler * handler,Bitu range) {
+	while (range--) io_pollhandlers[port++]=handler;
+}
+
+void IO_FreePollHandler(Bitu port,Bitu range) {
+	while (range--) io_pollhandlers[port++]=0;
+}
+
 void IO_ReadHandleObject::Install(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range) {
 	if(!installed) {
 		installed=true;
@@ -140,6 +151,20 @@ IO_WriteHandleObject::~IO_WriteHandleObject(){
 	//LOG_MSG("FreeWritehandler called with port %X",m_port);
 }
 
+void IO_PollHandleObject::Install(Bitu port,IO_PollHandler * handler,Bitu range) {
+	if(!installed) {
+		installed=true;
+		m_port=port;
+		m_range=range;
+		IO_RegisterPollHandler(port,handler,range);
+	} else E_Exit("IO_pollHandler allready installed port %x",port);
+}
+
+IO_PollHandleObject::~IO_PollHandleObject(){
+	if(!installed) return;
+	IO_FreePollHandler(m_port,m_range);
+}
+
 struct IOF_Entry {
 	Bitu cs;
 	Bitu eip;
@@ -197,20 +222,77 @@ inline void IO_USEC_write_delay_old() {
 #define IODELAY_READ_MICROSk (Bit32u)(1024/1.0)
 #define IODELAY_WRITE_MICROSk (Bit32u)(1024/0.75)
 
+/* The delays only get recalculated when CPU_CycleMax changes, saves two divisions per access */
+static struct {
+	Bit32s cyclemax;
+	Bits read;
+	Bits write;
+} io_delay;
+
+static INLINE void IO_USEC_update_delay() {
+	if (GCC_UNLIKELY(io_delay.cyclemax != CPU_CycleMax)) {
+		io_delay.cyclemax = CPU_CycleMax;
+		io_delay.read = CPU_CycleMax/IODELAY_READ_MICROSk;
+		io_delay.write = CPU_CycleMax/IODELAY_WRITE_MICROSk;
+	}
+}
+
 inline void IO_USEC_read_delay() {
-	Bits delaycyc = CPU_CycleMax/IODELAY_READ_MICROSk;
+	IO_USEC_update_delay();
+	Bits delaycyc = io_delay.read;
 	if(GCC_UNLIKELY(CPU_Cycles < 3*delaycyc)) delaycyc = 0; //Else port acces will set cycles to 0. which might trigger problem with games which read 16 bit values
 	CPU_Cycles -= delaycyc;
 	CPU_IODelayRemoved += delaycyc;
 }
 
 inline void IO_USEC_write_delay() {
-	Bits delaycyc = CPU_CycleMax/IODELAY_WRITE_MICROSk; 
+	IO_USEC_update_delay();
+	Bits delaycyc = io_delay.write;
 	if(GCC_UNLIKELY(CPU_Cycles < 3*delaycyc)) delaycyc=0;
 	CPU_Cycles -= delaycyc;
 	CPU_IODelayRemoved += delaycyc;
 }
 
+/* Spin loop detection. A guest that reads the same value from a status port
+ * over and over is waiting for something to happen, so instead of running
+ * the loop until it does, the cycles up to the next possible change are
+ * taken away in one go. The cores don't always keep reg_eip current, so the
+ * location mostly helps the dynamic cores, the port and value do the rest.
+ */
+
+#define IO_POLL_THRESHOLD 32
+
+static struct {
+	bool enabled;
+	Bitu port;
+	Bitu val;
+	Bitu cs;
+	Bitu eip;
+	Bitu count;
+} io_poll;
+
+static void IO_PollCheck(Bitu port,Bitu val) {
+	Bitu seg=SegValue(cs);
+	if (port!=io_poll.port || val!=io_poll.val || seg!=io_poll.cs || reg_eip!=io_poll.eip) {
+		io_poll.port=port;
+		io_poll.val=val;
+		io_poll.cs=seg;
+		io_poll.eip=reg_eip;
+		io_poll.count=1;
+		return;
+	}
+	if (++io_poll.count<IO_POLL_THRESHOLD) return;
+	double next=io_pollhandlers[port](port);
+	Bits skip;
+	if (next<0) skip=CPU_Cycles;
+	else skip=PIC_MakeCycles(next-PIC_FullIndex())+1;
+	if (skip>CPU_Cycles) skip=CPU_Cycles;
+	if (skip<=0) return;
+	CPU_Cycles-=skip;
+	CPU_IODelayRemoved+=skip;
+	io_poll.count=0;
+}
+
 #ifdef ENABLE_PORTLOG
 static Bit8u crtc_index = 0;
 const char* const len_type[] = {" 8","16","32"};
@@ -309,7 +391,10 @@ void IO_WriteB(Bitu port,Bitu val) {
 	}
 	else {
 		IO_USEC_write_delay();
+		io_poll.count=0;
+		PROF_Enter(PROF_IO);
 		io_writehandlers[0][port](port,val,1);
+		PROF_Leave();
 	}
 }
 
@@ -345,7 +430,10 @@ void IO_WriteW(Bitu port,Bitu val) {
 	}
 	else {
 		IO_USEC_write_delay();
+		io_poll.count=0;
+		PROF_Enter(PROF_IO);
 		io_writehandlers[1][port](port,val,2);
+		PROF_Leave();
 	}
 }
 
@@ -379,7 +467,12 @@ void IO_WriteD(Bitu port,Bitu val) {
 		memcpy(&lflags,&old_lflags,sizeof(LazyFlags));
 		cpudecoder=old_cpudecoder;
 	}
-	else io_writehandlers[2][port](port,val,4);
+	else {
+		io_poll.count=0;
+		PROF_Enter(PROF_IO);
+		io_writehandlers[2][port](port,val,4);
+		PROF_Leave();
+	}
 }
 
 Bitu IO_ReadB(Bitu port) {
@@ -413,7 +506,10 @@ Bitu IO_ReadB(Bitu port) {
 	}
 	else {
 		IO_USEC_read_delay();
+		PROF_Enter(PROF_IO);
 		retval = io_readhandlers[0][port](port,1);
+		PROF_Leave();
+		if (GCC_UNLIKELY(io_pollhandlers[port]!=0) && io_poll.enabled) IO_PollCheck(port,retval);
 	}
 	log_io(0, false, port, retval);
 	return retval;
@@ -449,7 +545,9 @@ Bitu IO_ReadW(Bitu port) {
 	}
 	else {
 		IO_USEC_read_delay();
+		PROF_Enter(PROF_IO);
 		retval = io_readhandlers[1][port](port,2);
+		PROF_Leave();
 	}
 	log_io(1, false, port, retval);
 	return retval;
@@ -483,7 +581,9 @@ Bitu IO_ReadD(Bitu port) {
 		memcpy(&lflags,&old_lflags,sizeof(LazyFlags));
 		cpudecoder=old_cpudecoder;
 	} else {
+		PROF_Enter(PROF_IO);
 		retval = io_readhandlers[2][port](port,4);
+		PROF_Leave();
 	}
 	log_io(2, false, port, retval);
 	return retval;
@@ -495,6 +595,10 @@ public:
 	iof_queue.used=0;
 	IO_FreeReadHandler(0,IO_MA,IO_MAX);
 	IO_FreeWriteHandler(0,IO_MA,IO_MAX);
+	IO_FreePollHandler(0,IO_MAX);
+	Section_prop * section=static_cast<Section_prop *>(configuration);
+	io_poll.enabled=section->Get_bool("pollskip");
+	io_poll.count=0;
 	}
 	~IO()
 	{
@@ -25,6 +25,8 @@
 #include "mem.h"
 #include "mixer.h"
 #include "timer.h"
+#include "savestate.h"
+#include "benchmark.h"
 
 #define KEYBUFSIZE 32
 #define KEYDELAY 0.300f			//Considering 20-30 khz serial clock and 11 bits/char
@@ -218,8 +220,14 @@ static Bitu read_p64(Bitu port,Bitu iolen) {
 	return status;
 }
 
+/* The status only changes through the transfer event and port accesses */
+static double poll_p64(Bitu /*port*/) {
+	return -1;
+}
+
 void KEYBOARD_AddKey(KBD_KEYS keytype,bool pressed) {
 	Bit8u ret=0;bool extend=false;
+	if (GCC_UNLIKELY(BENCH_Recording)) BENCH_RecordKey(keytype,pressed);
 	switch (keytype) {
 	case KBD_esc:ret=1;break;
 	case KBD_1:ret=2;break;
@@ -367,6 +375,16 @@ static void KEYBOARD_TickHandler(void) {
 	}
 }
 
+static void KEYBOARD_SaveState(void) {
+	SAVESTATE_Write(&keyb,sizeof(keyb));
+	SAVESTATE_WriteVar(port_61_data);
+}
+
+static void KEYBOARD_LoadState(void) {
+	SAVESTATE_Read(&keyb,sizeof(keyb));
+	SAVESTATE_ReadVar(port_61_data);
+}
+
 void KEYBOARD_Init(Section* sec) {
 	IO_RegisterWriteHandler(0x60,write_p60,IO_MB);
 	IO_RegisterReadHandler(0x60,read_p60,IO_MB);
@@ -374,6 +392,7 @@ void KEYBOARD_Init(Section* sec) {
 	IO_RegisterReadHandler(0x61,read_p61,IO_MB);
 	IO_RegisterWriteHandler(0x64,write_p64,IO_MB);
 	IO_RegisterReadHandler(0x64,read_p64,IO_MB);
+	IO_RegisterPollHandler(0x64,poll_p64);
 	TIMER_AddTickHandler(&KEYBOARD_TickHandler);
 	write_p61(0,0,0);
 	/* Init the keyb struct */
@@ -386,4 +405,5 @@ void KEYBOARD_Init(Section* sec) {
 	keyb.repeat.rate=33;
 	keyb.repeat.wait=0;
 	KEYBOARD_ClrBuffer();
+	SAVESTATE_AddHandler("KEYBOARD",KEYBOARD_SaveState,KEYBOARD_LoadState);
 }
@@ -24,8 +24,14 @@
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "savestate.h"
 
 #include <string.h>
+#if defined (WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 #define PAGES_IN_BLOCK	((1024*1024)/MEM_PAGE_SIZE)
 #define SAFE_MEMORY	32
@@ -58,6 +64,7 @@ static struct MemoryBlock {
 } memory;
 
 HostPt MemBase;
+Bit8u * MemDirty;
 
 class IllegalPageHandler : public PageHandler {
 public:
@@ -120,9 +127,46 @@ public:
 
 
 
+/* 
+	Dirty page tracking for incremental save states.
+	After a save all normal ram pages get this handler, it's not writeable so
+	the first write to a page ends up here. That marks the page and puts the
+	normal handler back so the following writes go at full speed again.
+*/
+class RAMTrackPageHandler : public RAMPageHandler {
+public:
+	RAMTrackPageHandler() {
+		flags=PFLAG_READABLE;
+	}
+	void writeb(PhysPt addr,Bitu val) {
+		host_writeb(Track(addr),(Bit8u)val);
+	}
+	void writew(PhysPt addr,Bitu val) {
+		host_writew(Track(addr),(Bit16u)val);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		host_writed(Track(addr),(Bit32u)val);
+	}
+private:
+	HostPt Track(PhysPt addr);
+};
+
 static IllegalPageHandler illegal_page_handler;
 static RAMPageHandler ram_page_handler;
 static ROMPageHandler rom_page_handler;
+static RAMTrackPageHandler ram_track_page_handler;
+
+/* Returns where the write goes, the handlers get the linear address */
+HostPt RAMTrackPageHandler::Track(PhysPt addr) {
+	PhysPt phys=PAGING_GetPhysicalAddress(addr);
+	Bitu phys_page=phys/MEM_PAGESIZE;
+	MemDirty[phys_page]=1;
+	memory.phandlers[phys_page]=&ram_page_handler;
+	/* Only the written page gets linked again, other linear pages mapping
+	   the same memory end up here once as well */
+	PAGING_UnlinkPages(addr/MEM_PAGESIZE,1);
+	return MemBase+phys;
+}
 
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler) {
 	memory.lfb.handler=handler;
@@ -147,6 +191,8 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 	for (;pages>0;pages--) {
+		/* The new handler might write to the page without telling us */
+		MemDirty[phys_page]=1;
 		memory.phandlers[phys_page]=handler;
 		phys_page++;
 	}
@@ -174,21 +220,66 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+/* Host pointer for the rest of the page at address, or 0 when it goes through a handler.
+ * Pages that haven't been touched yet only get their tlb entry on the first access,
+ * so that one byte is left to the caller to do the slow way. */
+static INLINE HostPt MEM_HostRead(PhysPt address) {
+	HostPt tlb_addr=get_tlb_read(address);
+	return tlb_addr ? tlb_addr+address : 0;
+}
+static INLINE HostPt MEM_HostWrite(PhysPt address) {
+	HostPt tlb_addr=get_tlb_write(address);
+	return tlb_addr ? tlb_addr+address : 0;
+}
+
+static INLINE Bitu MEM_PageLeft(PhysPt address,Bitu size) {
+	Bitu left=4096-(address & 4095);
+	return left<size ? left : size;
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		Bitu todo=MEM_PageLeft(dest,MEM_PageLeft(src,size));
+		HostPt read=MEM_HostRead(src);
+		HostPt write=MEM_HostWrite(dest);
+		/* Overlapping forward copies repeat the source, keep doing that byte by byte */
+		if (read && write && (write<=read || write>=read+todo)) {
+			memmove(write,read,todo);
+			dest+=todo;src+=todo;size-=todo;
+		} else {
+			mem_writeb_inline(dest++,mem_readb_inline(src++));
+			size--;
+		}
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		Bitu todo=MEM_PageLeft(pt,size);
+		HostPt read=MEM_HostRead(pt);
+		if (read) {
+			memcpy(write,read,todo);
+			write+=todo;pt+=todo;size-=todo;
+		} else {
+			*write++=mem_readb_inline(pt++);
+			size--;
+		}
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		Bitu todo=MEM_PageLeft(pt,size);
+		HostPt write=MEM_HostWrite(pt);
+		if (write) {
+			memcpy(write,read,todo);
+			read+=todo;pt+=todo;size-=todo;
+		} else {
+			mem_writeb_inline(pt++,*read++);
+			size--;
+		}
 	}
 }
 
@@ -534,8 +625,112 @@ void PreparePCJRCartRom(void) {
 	}
 }
 
+/* Guest ram comes straight from the system, which hands out zeroed pages and
+ * only commits them once they get touched. Most programs never touch the
+ * upper megabytes of a large memsize, so those cost nothing. */
+static HostPt MEM_AllocateRam(Bitu size) {
+#if defined (WIN32)
+	return (HostPt)VirtualAlloc(0,size,MEM_RESERVE|MEM_COMMIT,PAGE_READWRITE);
+#else
+	void * ram=mmap(0,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON,-1,0);
+	if (ram==MAP_FAILED) return 0;
+	return (HostPt)ram;
+#endif
+}
+
+/* Hand all pages back, they read as zero afterwards */
+static void MEM_ClearRam(HostPt ram,Bitu size) {
+#if defined (WIN32)
+	if (VirtualFree(ram,size,MEM_DECOMMIT) && VirtualAlloc(ram,size,MEM_COMMIT,PAGE_READWRITE)) return;
+#else
+	if (mmap(ram,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANON|MAP_FIXED,-1,0)!=MAP_FAILED) return;
+#endif
+	memset(ram,0,size);
+}
+
+static void MEM_FreeRam(HostPt ram,Bitu size) {
+#if defined (WIN32)
+	VirtualFree(ram,0,MEM_RELEASE);
+#else
+	munmap(ram,size);
+#endif
+}
+
 HostPt GetMemBase(void) { return MemBase; }
 
+#if C_DYNREC
+void CPU_Core_Dynrec_Cache_Flush(void);
+#endif
+
+/* Start a new interval for the dirty page tracking */
+static void MEM_TrackPages(void) {
+	for (Bitu i=0;i<memory.pages;i++) {
+		MemDirty[i]=0;
+		if (memory.phandlers[i]==&ram_page_handler) memory.phandlers[i]=&ram_track_page_handler;
+	}
+	PAGING_ClearTLB();
+}
+
+static bool MEM_PageChanged(Bitu phys_page) {
+	if (MemDirty[phys_page]) return true;
+	/* Tandy video memory is written by the vga handlers directly */
+	if (IS_TANDY_ARCH && phys_page>=0x80 && phys_page<0xa0) return true;
+	return memory.phandlers[phys_page]!=&ram_track_page_handler;
+}
+
+static bool MEM_PageEmpty(Bitu phys_page) {
+	const Bit32u * data=(const Bit32u *)(MemBase+phys_page*MEM_PAGESIZE);
+	for (Bitu i=0;i<MEM_PAGESIZE/4;i++) {
+		if (data[i]) return false;
+	}
+	return true;
+}
+
+/* A full save leaves out the empty pages, loading it starts from cleared ram
+ * so pages the guest never touched stay uncommitted */
+static bool MEM_SavePage(bool incremental,Bitu phys_page) {
+	if (incremental) return MEM_PageChanged(phys_page);
+	return !MEM_PageEmpty(phys_page);
+}
+
+static void MEM_SaveState(void) {
+	SAVESTATE_Write(&memory.a20,sizeof(memory.a20));
+	SAVESTATE_Write(memory.mhandles,memory.pages*sizeof(MemHandle));
+	bool incremental=SAVESTATE_Incremental();
+	Bit32u count=0;
+	for (Bitu i=0;i<memory.pages;i++) {
+		if (MEM_SavePage(incremental,i)) count++;
+	}
+	SAVESTATE_WriteVar(count);
+	for (Bitu i=0;i<memory.pages;i++) {
+		if (!MEM_SavePage(incremental,i)) continue;
+		Bit32u page=(Bit32u)i;
+		SAVESTATE_WriteVar(page);
+		SAVESTATE_Write(MemBase+i*MEM_PAGESIZE,MEM_PAGESIZE);
+	}
+	MEM_TrackPages();
+}
+
+static void MEM_LoadState(void) {
+#if C_DYNREC
+	/* Translated code would not match the restored memory */
+	CPU_Core_Dynrec_Cache_Flush();
+#endif
+	SAVESTATE_Read(&memory.a20,sizeof(memory.a20));
+	SAVESTATE_Read(memory.mhandles,memory.pages*sizeof(MemHandle));
+	Bit32u count;
+	SAVESTATE_ReadVar(count);
+	if (!SAVESTATE_Incremental()) MEM_ClearRam(MemBase,memory.pages*MEM_PAGESIZE);
+	for (;count>0;count--) {
+		Bit32u page;
+		SAVESTATE_ReadVar(page);
+		if (page>=memory.pages) E_Exit("SAVESTATE:Illegal memory page %d",page);
+		SAVESTATE_Read(MemBase+page*MEM_PAGESIZE,MEM_PAGESIZE);
+	}
+	MEM_A20_Enable(memory.a20.enabled);
+	MEM_TrackPages();
+}
+
 class MEMORY:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler;
@@ -558,15 +753,14 @@ public:
 			LOG_MSG("Memory sizes above %d MB are NOT recommended.",SAFE_MEMORY - 1);
 			LOG_MSG("Stick with the default values unless you are absolutely certain.");
 		}
-		MemBase = new Bit8u[memsize*1024*1024];
+		MemBase = MEM_AllocateRam(memsize*1024*1024);
 		if (!MemBase) E_Exit("Can't allocate main memory of %d MB",memsize);
-		/* Clear the memory, as new doesn't always give zeroed memory
-		 * (Visual C debug mode). We want zeroed memory though. */
-		memset((void*)MemBase,0,memsize*1024*1024);
 		memory.pages = (memsize*1024*1024)/4096;
 		/* Allocate the data for the different page information blocks */
 		memory.phandlers=new  PageHandler * [memory.pages];
 		memory.mhandles=new MemHandle [memory.pages];
+		MemDirty=new Bit8u [memory.pages];
+		memset(MemDirty,0,memory.pages);
 		for (i = 0;i < memory.pages;i++) {
 			memory.phandlers[i] = &ram_page_handler;
 			memory.mhandles[i] = 0;				//Set to 0 for memory allocation
@@ -591,11 +785,13 @@ public:
 		WriteHandler.Install(0x92,write_p92,IO_MB);
 		ReadHandler.Install(0x92,read_p92,IO_MB);
 		MEM_A20_Enable(false);
+		SAVESTATE_AddHandler("MEM",MEM_SaveState,MEM_LoadState,true);
 	}
 	~MEMORY(){
-		delete [] MemBase;
+		MEM_FreeRam(MemBase,memory.pages*4096);
 		delete [] memory.phandlers;
 		delete [] memory.mhandles;
+		delete [] MemDirty;
 	}
 };	
 
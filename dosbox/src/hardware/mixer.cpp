@@ -26,6 +26,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <math.h>
+#include <time.h>
 
 #if defined (WIN32)
 //Midi listing
@@ -48,6 +49,9 @@
 #include "mapper.h"
 #include "hardware.h"
 #include "programs.h"
+#include "savestate.h"
+#include "benchmark.h"
+#include "profiler.h"
 
 #define MIXER_SSIZE 4
 #define MIXER_SHIFT 14
@@ -62,6 +66,13 @@ static INLINE Bit16s MIXER_CLIP(Bits SAMP) {
 	} else return MAX_AUDIO;
 }
 
+/* The ring is only shared between the emulation thread writing and the audio callback reading */
+#if defined (_MSC_VER)
+#define MIXER_BARRIER() MemoryBarrier()
+#else
+#define MIXER_BARRIER() __sync_synchronize()
+#endif
+
 static struct {
 	Bit32s work[MIXER_BUFSIZE][2];
 	Bitu pos,done;
@@ -72,10 +83,127 @@ static struct {
 	bool nosound;
 	Bit32u freq;
 	Bit32u blocksize;
+	bool simd;
 } mixer;
 
+/* Finished samples waiting for the audio callback, the positions only ever grow */
+static struct {
+	Bit16s data[MIXER_BUFSIZE][2];
+	volatile Bitu write,read;
+	volatile Bitu underruns,overruns;
+} ring;
+
 Bit8u MixTemp[MIXER_BUFSIZE];
 
+/* Channels resample into blocks of this many samples before they get mixed */
+#define MIXER_BLOCKSIZE 256
+
+/* SSE2/NEON versions of the accumulate and clip loops, used when mixer.simd is set.
+   Both give exactly the same results as the plain loops. */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MIXER_SIMD 1
+
+/* work+=block*vol for all but the last odd sample, returns the amount done */
+static INLINE Bitu MIXER_AccumulateSIMD(Bit32s * work,const Bit32s * block,Bitu count,Bit32s vol0,Bit32s vol1) {
+	const __m128i vol=_mm_set_epi32(vol1,vol0,vol1,vol0);
+	const __m128i volodd=_mm_srli_epi64(vol,32);
+	Bitu i=0;
+	for (;i+2<=count;i+=2) {
+		__m128i in=_mm_loadu_si128((const __m128i *)&block[i*2]);
+		/* No 32 bit multiply in SSE2, do the even and odd lanes separately */
+		__m128i even=_mm_mul_epu32(in,vol);
+		__m128i odd=_mm_mul_epu32(_mm_srli_epi64(in,32),volodd);
+		__m128i mul=_mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+		__m128i * out=(__m128i *)&work[i*2];
+		_mm_storeu_si128(out,_mm_add_epi32(_mm_loadu_si128(out),mul));
+	}
+	return i;
+}
+
+/* Scale down to 16 bit with saturation, returns the amount done */
+static INLINE Bitu MIXER_ClipSIMD(Bit16s * out,const Bit32s * work,Bitu count) {
+	Bitu i=0;
+	for (;i+4<=count;i+=4) {
+		__m128i a=_mm_srai_epi32(_mm_loadu_si128((const __m128i *)&work[i*2+0]),MIXER_VOLSHIFT);
+		__m128i b=_mm_srai_epi32(_mm_loadu_si128((const __m128i *)&work[i*2+4]),MIXER_VOLSHIFT);
+		_mm_storeu_si128((__m128i *)&out[i*2],_mm_packs_epi32(a,b));
+	}
+	return i;
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_SIMD 1
+
+static INLINE Bitu MIXER_AccumulateSIMD(Bit32s * work,const Bit32s * block,Bitu count,Bit32s vol0,Bit32s vol1) {
+	const Bit32s vols[4]={vol0,vol1,vol0,vol1};
+	const int32x4_t vol=vld1q_s32(vols);
+	Bitu i=0;
+	for (;i+2<=count;i+=2) {
+		vst1q_s32(&work[i*2],vmlaq_s32(vld1q_s32(&work[i*2]),vld1q_s32(&block[i*2]),vol));
+	}
+	return i;
+}
+
+static INLINE Bitu MIXER_ClipSIMD(Bit16s * out,const Bit32s * work,Bitu count) {
+	Bitu i=0;
+	for (;i+4<=count;i+=4) {
+		int16x4_t a=vqmovn_s32(vshrq_n_s32(vld1q_s32(&work[i*2+0]),MIXER_VOLSHIFT));
+		int16x4_t b=vqmovn_s32(vshrq_n_s32(vld1q_s32(&work[i*2+4]),MIXER_VOLSHIFT));
+		vst1q_s16(&out[i*2],vcombine_s16(a,b));
+	}
+	return i;
+}
+#endif
+
+/* Add a block of stereo samples with volume to the work buffer, no wrapping */
+static INLINE void MIXER_Accumulate(Bit32s (*work)[2],const Bit32s (*block)[2],Bitu count,const Bit32s * vol) {
+	Bitu i=0;
+#if defined(MIXER_SIMD)
+	if (mixer.simd) i=MIXER_AccumulateSIMD(work[0],block[0],count,vol[0],vol[1]);
+#endif
+	for (;i<count;i++) {
+		work[i][0]+=(Bits)block[i][0]*vol[0];
+		work[i][1]+=(Bits)block[i][1]*vol[1];
+	}
+}
+
+static void MIXER_AddBlock(Bitu mixpos,const Bit32s (*block)[2],Bitu count,const Bit32s * vol) {
+	mixpos&=MIXER_BUFMASK;
+	Bitu first=MIXER_BUFSIZE-mixpos;
+	if (count<=first) {
+		MIXER_Accumulate(&mixer.work[mixpos],block,count,vol);
+	} else {
+		MIXER_Accumulate(&mixer.work[mixpos],block,first,vol);
+		MIXER_Accumulate(&mixer.work[0],&block[first],count-first,vol);
+	}
+}
+
+/* Convert count samples of the work buffer to 16 bit, no wrapping */
+static INLINE void MIXER_Clip(Bit16s (*out)[2],const Bit32s (*work)[2],Bitu count) {
+	Bitu i=0;
+#if defined(MIXER_SIMD)
+	if (mixer.simd) i=MIXER_ClipSIMD(out[0],work[0],count);
+#endif
+	for (;i<count;i++) {
+		out[i][0]=MIXER_CLIP(work[i][0] >> MIXER_VOLSHIFT);
+		out[i][1]=MIXER_CLIP(work[i][1] >> MIXER_VOLSHIFT);
+	}
+}
+
+/* Convert count samples starting at readpos in the work buffer, output is wrapped at outmask */
+static void MIXER_ClipWork(Bit16s (*out)[2],Bitu outpos,Bitu outmask,Bitu readpos,Bitu count) {
+	while (count) {
+		readpos&=MIXER_BUFMASK;
+		outpos&=outmask;
+		Bitu todo=count;
+		if (todo>MIXER_BUFSIZE-readpos) todo=MIXER_BUFSIZE-readpos;
+		if (todo>outmask+1-outpos) todo=outmask+1-outpos;
+		MIXER_Clip(&out[outpos],&mixer.work[readpos],todo);
+		readpos+=todo;outpos+=todo;count-=todo;
+	}
+}
+
 MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * name) {
 	MixerChannel * chan=new MixerChannel();
 	chan->scale = 1.0;
@@ -133,9 +261,7 @@ void MixerChannel::Enable(bool _yesno) {
 	enabled=_yesno;
 	if (enabled) {
 		freq_index=MIXER_REMAIN;
-		SDL_LockAudio();
 		if (done<mixer.done) done=mixer.done;
-		SDL_UnlockAudio();
 	}
 }
 
@@ -161,101 +287,90 @@ void MixerChannel::AddSilence(void) {
 	}
 }
 
+/* Read a sample as signed 16 bit data, index counts single samples */
+template<class Type,bool signeddata,bool nativeorder>
+static INLINE Bits MIXER_ReadSample(const Type * data,Bitu index) {
+	if ( sizeof( Type) == 1) {
+		if (!signeddata) return ((Bit8s)(data[index] ^ 0x80)) << 8;
+		else return data[index] << 8;
+	}
+	//16bit and 32bit both contain 16bit data internally
+	if (signeddata) {
+		if (nativeorder) return data[index];
+		if ( sizeof( Type) == 2) return (Bit16s)host_readw((HostPt)&data[index]);
+		return (Bit32s)host_readd((HostPt)&data[index]);
+	} else {
+		if (nativeorder) return (Bits)data[index]-32768;
+		if ( sizeof( Type) == 2) return (Bits)host_readw((HostPt)&data[index])-32768;
+		return (Bits)host_readd((HostPt)&data[index])-32768;
+	}
+}
+
 template<class Type,bool stereo,bool signeddata,bool nativeorder>
 inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
-	Bits diff[2];
+	Bit32s block[MIXER_BLOCKSIZE][2];
 	Bitu mixpos=mixer.pos+done;
 	freq_index&=MIXER_REMAIN;
-	Bitu pos=0;Bitu new_pos;
-
-	goto thestart;
-	for (;;) {
-		new_pos=freq_index >> MIXER_SHIFT;
-		if (pos<new_pos) {
-			last[0]+=diff[0];
-			if (stereo) last[1]+=diff[1];
-			pos=new_pos;
-thestart:
-			if (pos>=len) return;
-			if ( sizeof( Type) == 1) {
-				if (!signeddata) {
-					if (stereo) {
-						diff[0]=(((Bit8s)(data[pos*2+0] ^ 0x80)) << 8)-last[0];
-						diff[1]=(((Bit8s)(data[pos*2+1] ^ 0x80)) << 8)-last[1];
-					} else {
-						diff[0]=(((Bit8s)(data[pos] ^ 0x80)) << 8)-last[0];
-					}
+	Bitu pos=0;
+	if (!len) return;
+	if (freq_add==(1 << MIXER_SHIFT)) {
+		/* Same rate as the mixer, every sample is interpolated with the same fraction */
+		Bits diff_mul=freq_index;
+		freq_index+=len << MIXER_SHIFT;
+		while (pos<len) {
+			Bitu count=len-pos;
+			if (count>MIXER_BLOCKSIZE) count=MIXER_BLOCKSIZE;
+			for (Bitu i=0;i<count;i++,pos++) {
+				if (stereo) {
+					Bits left=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos*2+0);
+					Bits right=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos*2+1);
+					block[i][0]=last[0]+(((left-last[0])*diff_mul) >> MIXER_SHIFT);
+					block[i][1]=last[1]+(((right-last[1])*diff_mul) >> MIXER_SHIFT);
+					last[0]=left;
+					last[1]=right;
 				} else {
-					if (stereo) {
-						diff[0]=(data[pos*2+0] << 8)-last[0];
-						diff[1]=(data[pos*2+1] << 8)-last[1];
-					} else {
-						diff[0]=(data[pos] << 8)-last[0];
-					}
+					Bits sample=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos);
+					block[i][0]=block[i][1]=last[0]+(((sample-last[0])*diff_mul) >> MIXER_SHIFT);
+					last[0]=sample;
 				}
-			//16bit and 32bit both contain 16bit data internally
-			} else  {
-				if (signeddata) {
-					if (stereo) {
-						if (nativeorder) {
-							diff[0]=data[pos*2+0]-last[0];
-							diff[1]=data[pos*2+1]-last[1];
-						} else {
-							if ( sizeof( Type) == 2) {
-								diff[0]=(Bit16s)host_readw((HostPt)&data[pos*2+0])-last[0];
-								diff[1]=(Bit16s)host_readw((HostPt)&data[pos*2+1])-last[1];
-							} else {
-								diff[0]=(Bit32s)host_readd((HostPt)&data[pos*2+0])-last[0];
-								diff[1]=(Bit32s)host_readd((HostPt)&data[pos*2+1])-last[1];
-							}
-						}
-					} else {
-						if (nativeorder) {
-							diff[0]=data[pos]-last[0];
-						} else {
-							if ( sizeof( Type) == 2) {
-								diff[0]=(Bit16s)host_readw((HostPt)&data[pos])-last[0];
-							} else {
-								diff[0]=(Bit32s)host_readd((HostPt)&data[pos])-last[0];
-							}
-						}
-					}
+			}
+			MIXER_AddBlock(mixpos,block,count,volmul);
+			mixpos+=count;done+=count;
+		}
+		return;
+	}
+	Bits diff[2];
+	diff[0]=MIXER_ReadSample<Type,signeddata,nativeorder>(data,0)-last[0];
+	if (stereo) diff[1]=MIXER_ReadSample<Type,signeddata,nativeorder>(data,1)-last[1];
+	for (;;) {
+		Bitu count=0;
+		while (count<MIXER_BLOCKSIZE) {
+			Bitu new_pos=freq_index >> MIXER_SHIFT;
+			if (pos<new_pos) {
+				last[0]+=diff[0];
+				if (stereo) last[1]+=diff[1];
+				pos=new_pos;
+				if (pos>=len) {
+					MIXER_AddBlock(mixpos,block,count,volmul);
+					done+=count;
+					return;
+				}
+				if (stereo) {
+					diff[0]=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos*2+0)-last[0];
+					diff[1]=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos*2+1)-last[1];
 				} else {
-					if (stereo) {
-						if (nativeorder) {
-							diff[0]=(Bits)data[pos*2+0]-32768-last[0];
-							diff[1]=(Bits)data[pos*2+1]-32768-last[1];
-						} else {
-							if ( sizeof( Type) == 2) {
-								diff[0]=(Bits)host_readw((HostPt)&data[pos*2+0])-32768-last[0];
-								diff[1]=(Bits)host_readw((HostPt)&data[pos*2+1])-32768-last[1];
-							} else {
-								diff[0]=(Bits)host_readd((HostPt)&data[pos*2+0])-32768-last[0];
-								diff[1]=(Bits)host_readd((HostPt)&data[pos*2+1])-32768-last[1];
-							}
-						}
-					} else {
-						if (nativeorder) {
-							diff[0]=(Bits)data[pos]-32768-last[0];
-						} else {
-							if ( sizeof( Type) == 2) {
-								diff[0]=(Bits)host_readw((HostPt)&data[pos])-32768-last[0];
-							} else {
-								diff[0]=(Bits)host_readd((HostPt)&data[pos])-32768-last[0];
-							}
-						}
-					}
+					diff[0]=MIXER_ReadSample<Type,signeddata,nativeorder>(data,pos)-last[0];
 				}
 			}
+			Bits diff_mul=freq_index & MIXER_REMAIN;
+			freq_index+=freq_add;
+			block[count][0]=last[0]+((diff[0]*diff_mul) >> MIXER_SHIFT);
+			if (stereo) block[count][1]=last[1]+((diff[1]*diff_mul) >> MIXER_SHIFT);
+			else block[count][1]=block[count][0];
+			count++;
 		}
-		Bits diff_mul=freq_index & MIXER_REMAIN;
-		freq_index+=freq_add;
-		mixpos&=MIXER_BUFMASK;
-		Bits sample=last[0]+((diff[0]*diff_mul) >> MIXER_SHIFT);
-		mixer.work[mixpos][0]+=sample*volmul[0];
-		if (stereo) sample=last[1]+((diff[1]*diff_mul) >> MIXER_SHIFT);
-		mixer.work[mixpos][1]+=sample*volmul[1];
-		mixpos++;done++;
+		MIXER_AddBlock(mixpos,block,count,volmul);
+		mixpos+=count;done+=count;
 	}
 }
 
@@ -337,25 +452,16 @@ void MixerChannel::AddSamples_s32_nonnative(Bitu len,const Bit32s * data) {
 }
 
 void MixerChannel::FillUp(void) {
-	SDL_LockAudio();
-	if (!enabled || done<mixer.done) {
-		SDL_UnlockAudio();
-		return;
-	}
+	if (!enabled || done<mixer.done) return;
 	float index=PIC_TickIndex();
 	Mix((Bitu)(index*mixer.needed));
-	SDL_UnlockAudio();
-}
-
-extern bool ticksLocked;
-static inline bool Mixer_irq_important(void) {
-	/* In some states correct timing of the irqs is more important then 
-	 * non stuttering audo */
-	return (ticksLocked || (CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO)));
 }
 
 /* Mix a certain amount of new samples */
 static void MIXER_MixData(Bitu needed) {
+	Bit64u bench=BENCH_Begin();
+	BENCH_Count(BENCH_COUNT_SAMPLES,needed-mixer.done);
+	PROF_Enter(PROF_MIXER);
 	MixerChannel * chan=mixer.channels;
 	while (chan) {
 		chan->Mix(needed);
@@ -366,39 +472,25 @@ static void MIXER_MixData(Bitu needed) {
 		Bitu added=needed-mixer.done;
 		if (added>1024) 
 			added=1024;
-		Bitu readpos=(mixer.pos+mixer.done)&MIXER_BUFMASK;
-		for (Bitu i=0;i<added;i++) {
-			Bits sample=mixer.work[readpos][0] >> MIXER_VOLSHIFT;
-			convert[i][0]=MIXER_CLIP(sample);
-			sample=mixer.work[readpos][1] >> MIXER_VOLSHIFT;
-			convert[i][1]=MIXER_CLIP(sample);
-			readpos=(readpos+1)&MIXER_BUFMASK;
-		}
+		MIXER_ClipWork(convert,0,1023,mixer.pos+mixer.done,added);
 		CAPTURE_AddWave( mixer.freq, added, (Bit16s*)convert );
 	}
-	//Reset the the tick_add for constant speed
-	if( Mixer_irq_important() )
-		mixer.tick_add = ((mixer.freq) << MIXER_SHIFT)/1000;
 	mixer.done = needed;
+	PROF_Leave();
+	BENCH_End(BENCH_TIMER_MIXER,bench);
 }
 
-static void MIXER_Mix(void) {
-	SDL_LockAudio();
-	MIXER_MixData(mixer.needed);
-	mixer.tick_remain+=mixer.tick_add;
-	mixer.needed+=(mixer.tick_remain>>MIXER_SHIFT);
-	mixer.tick_remain&=MIXER_REMAIN;
-	SDL_UnlockAudio();
-}
-
-static void MIXER_Mix_NoSound(void) {
-	MIXER_MixData(mixer.needed);
+/* Start the next tick, the samples of this one have been handled */
+static void MIXER_NextTick(void) {
 	/* Clear piece we've just generated */
-	for (Bitu i=0;i<mixer.needed;i++) {
-		mixer.work[mixer.pos][0]=0;
-		mixer.work[mixer.pos][1]=0;
-		mixer.pos=(mixer.pos+1)&MIXER_BUFMASK;
+	Bitu first=MIXER_BUFSIZE-mixer.pos;
+	if (mixer.needed<=first) {
+		memset(&mixer.work[mixer.pos],0,mixer.needed*sizeof(mixer.work[0]));
+	} else {
+		memset(&mixer.work[mixer.pos],0,first*sizeof(mixer.work[0]));
+		memset(&mixer.work[0],0,(mixer.needed-first)*sizeof(mixer.work[0]));
 	}
+	mixer.pos=(mixer.pos+mixer.needed)&MIXER_BUFMASK;
 	/* Reduce count in channels */
 	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) {
 		if (chan->done>mixer.needed) chan->done-=mixer.needed;
@@ -411,109 +503,84 @@ static void MIXER_Mix_NoSound(void) {
 	mixer.done=0;
 }
 
+static void MIXER_Mix(void) {
+	MIXER_MixData(mixer.needed);
+	Bitu write=ring.write;
+	Bitu count=mixer.needed;
+	Bitu space=MIXER_BUFSIZE-(write-ring.read);
+	MIXER_BARRIER();
+	if (count>space) {
+		/* The callback stopped reading, drop what doesn't fit */
+		ring.overruns++;
+		count=space;
+	}
+	MIXER_ClipWork(ring.data,write,MIXER_BUFMASK,mixer.pos,count);
+	MIXER_BARRIER();
+	ring.write=write+count;
+	MIXER_NextTick();
+}
+
+static void MIXER_Mix_NoSound(void) {
+	MIXER_MixData(mixer.needed);
+	MIXER_NextTick();
+}
+
+/*
+	Runs on the audio thread and never waits for the emulation. The rate is
+	corrected here, by playing a little slower or faster until the amount
+	of buffered samples is between one and two times the prebuffer again.
+*/
 static void MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
 	Bitu need=(Bitu)len/MIXER_SSIZE;
 	Bit16s * output=(Bit16s *)stream;
+	Bitu read=ring.read;
+	Bitu avail=ring.write-read;
+	MIXER_BARRIER();
 	Bitu reduce;
-	Bitu pos, index, index_add;
-	Bits sample;
-	/* Enough room in the buffer ? */
-	if (mixer.done < need) {
-//		LOG_MSG("Full underrun need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
-		if((need - mixer.done) > (need >>7) ) //Max 1 procent stretch.
+	if (avail < need) {
+		/* Stretch by at most 1 procent, else wait for the buffer to fill up */
+		if ((need - avail) > (need >> 7)) {
+			ring.underruns++;
+			memset(stream,0,len);
 			return;
-		reduce = mixer.done;
-		index_add = (reduce << MIXER_SHIFT) / need;
-		mixer.tick_add = ((mixer.freq+mixer.min_needed) << MIXER_SHIFT)/1000;
-	} else if (mixer.done < mixer.max_needed) {
-		Bitu left = mixer.done - need;
-		if (left < mixer.min_needed) {
-			if( !Mixer_irq_important() ) {
-				Bitu needed = mixer.needed - need;
-				Bitu diff = (mixer.min_needed>needed?mixer.min_needed:needed) - left;
-				mixer.tick_add = ((mixer.freq+(diff*3)) << MIXER_SHIFT)/1000;
-				left = 0; //No stretching as we compensate with the tick_add value
-			} else {
-				left = (mixer.min_needed - left);
-				left = 1 + (2*left) / mixer.min_needed; //left=1,2,3
-			}
-//			LOG_MSG("needed underrun need %d, have %d, min %d, left %d", need, mixer.done, mixer.min_needed, left);
-			reduce = need - left;
-			index_add = (reduce << MIXER_SHIFT) / need;
-		} else {
-			reduce = need;
-			index_add = (1 << MIXER_SHIFT);
-//			LOG_MSG("regular run need %d, have %d, min %d, left %d", need, mixer.done, mixer.min_needed, left);
-
-			/* Mixer tick value being updated:
-			 * 3 cases:
-			 * 1) A lot too high. >division by 5. but maxed by 2* min to prevent too fast drops.
-			 * 2) A little too high > division by 8
-			 * 3) A little to nothing above the min_needed buffer > go to default value
-			 */
-			Bitu diff = left - mixer.min_needed;
-			if(diff > (mixer.min_needed<<1)) diff = mixer.min_needed<<1;
-			if(diff > (mixer.min_needed>>1))
-				mixer.tick_add = ((mixer.freq-(diff/5)) << MIXER_SHIFT)/1000;
-			else if (diff > (mixer.min_needed>>4))
-				mixer.tick_add = ((mixer.freq-(diff>>3)) << MIXER_SHIFT)/1000;
-			else
-				mixer.tick_add = (mixer.freq<< MIXER_SHIFT)/1000;
 		}
-	} else {
+		reduce = avail;
+	} else if (avail > mixer.max_needed) {
 		/* There is way too much data in the buffer */
-//		LOG_MSG("overflow run need %d, have %d, min %d", need, mixer.done, mixer.min_needed);
-		if (mixer.done > MIXER_BUFSIZE)
-			index_add = MIXER_BUFSIZE - 2*mixer.min_needed;
-		else 
-			index_add = mixer.done - 2*mixer.min_needed;
-		index_add = (index_add << MIXER_SHIFT) / need;
-		reduce = mixer.done - 2* mixer.min_needed;
-		mixer.tick_add = ((mixer.freq-(mixer.min_needed/5)) << MIXER_SHIFT)/1000;
-	}
-	/* Reduce done count in all channels */
-	for (MixerChannel * chan=mixer.channels;chan;chan=chan->next) {
-		if (chan->done>reduce) chan->done-=reduce;
-		else chan->done=0;
+		reduce = avail - 2*mixer.min_needed;
+	} else {
+		/* Correct by up to 1.5 procent, depending on how far off the buffer is */
+		Bitu left = avail - need;
+		Bitu most = need >> 6;
+		if (left < mixer.min_needed) {
+			Bitu less = 1 + (most * (mixer.min_needed - left)) / mixer.min_needed;
+			if (less > most) less = most;
+			reduce = need - less;
+		} else if (left > 2*mixer.min_needed) {
+			Bitu extra = 1 + (most * (left - 2*mixer.min_needed)) / (mixer.min_needed + 1);
+			if (extra > most) extra = most;
+			if (extra > left) extra = left;
+			reduce = need + extra;
+		} else reduce = need;
 	}
-   
-	// Reset mixer.tick_add when irqs are important
-	if( Mixer_irq_important() )
-		mixer.tick_add=(mixer.freq<< MIXER_SHIFT)/1000;
-
-	mixer.done -= reduce;
-	mixer.needed -= reduce;
-	pos = mixer.pos;
-	mixer.pos = (mixer.pos + reduce) & MIXER_BUFMASK;
-	index = 0;
-	if(need != reduce) {
-		while (need--) {
-			Bitu i = (pos + (index >> MIXER_SHIFT )) & MIXER_BUFMASK;
-			index += index_add;
-			sample=mixer.work[i][0]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			sample=mixer.work[i][1]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-		}
-		/* Clean the used buffer */
-		while (reduce--) {
-			pos &= MIXER_BUFMASK;
-			mixer.work[pos][0]=0;
-			mixer.work[pos][1]=0;
-			pos++;
+	if (reduce == need) {
+		for (Bitu i=0;i<need;i++) {
+			const Bit16s * in=ring.data[(read+i)&MIXER_BUFMASK];
+			*output++=in[0];
+			*output++=in[1];
 		}
 	} else {
-		while (reduce--) {
-			pos &= MIXER_BUFMASK;
-			sample=mixer.work[pos][0]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			sample=mixer.work[pos][1]>>MIXER_VOLSHIFT;
-			*output++=MIXER_CLIP(sample);
-			mixer.work[pos][0]=0;
-			mixer.work[pos][1]=0;
-			pos++;
+		Bitu index = 0;
+		Bitu index_add = (reduce << MIXER_SHIFT) / need;
+		for (Bitu i=0;i<need;i++) {
+			const Bit16s * in=ring.data[(read+(index >> MIXER_SHIFT))&MIXER_BUFMASK];
+			index += index_add;
+			*output++=in[0];
+			*output++=in[1];
 		}
 	}
+	MIXER_BARRIER();
+	ring.read=read+reduce;
 }
 
 static void MIXER_Stop(Section* sec) {
@@ -568,6 +635,11 @@ public:
 		ShowVolume("MASTER",mixer.mastervol[0],mixer.mastervol[1]);
 		for (chan=mixer.channels;chan;chan=chan->next) 
 			ShowVolume(chan->name,chan->volmain[0],chan->volmain[1]);
+		if (!mixer.nosound) {
+			Bitu latency,underruns,overruns;
+			MIXER_GetStats(latency,underruns,overruns);
+			WriteOut("\nLatency %d ms, %d underruns, %d overruns\n",latency,underruns,overruns);
+		}
 	}
 private:
 	void ShowVolume(const char * name,float vol0,float vol1) {
@@ -591,6 +663,141 @@ private:
 
 };
 
+void MIXER_GetStats(Bitu & latency,Bitu & underruns,Bitu & overruns) {
+	/* Buffered samples plus the block SDL is playing */
+	Bitu buffered=ring.write-ring.read+mixer.blocksize;
+	latency=mixer.freq ? (buffered*1000)/mixer.freq : 0;
+	underruns=ring.underruns;
+	overruns=ring.overruns;
+}
+
+#if C_BENCHMARKS
+/* Channels for the mixing benchmark, with the formats and rates the devices use */
+#define MIXER_BENCHDATA 4096
+static struct {
+	MixerChannel * chan;
+	Bitu pos;
+} bench_chan[6];
+static Bit16s bench_data16[MIXER_BENCHDATA*2];
+static Bit32s bench_data32[MIXER_BENCHDATA];
+
+template<int N> static void MIXER_BenchmarkHandler(Bitu len) {
+	MixerChannel * chan=bench_chan[N].chan;
+	Bitu pos=bench_chan[N].pos;
+	if (len>MIXER_BENCHDATA/2) len=MIXER_BENCHDATA/2;
+	bench_chan[N].pos=(pos+len)&(MIXER_BENCHDATA/2-1);
+	switch (N) {
+	case 0: chan->AddSamples_m8(len,(const Bit8u *)bench_data16+pos);break;
+	case 1: chan->AddSamples_s16(len,&bench_data16[pos*2]);break;
+	case 2: chan->AddSamples_m32(len,&bench_data32[pos]);break;
+	case 3: chan->AddSamples_s16(len,&bench_data16[MIXER_BENCHDATA-pos*2]);break;
+	case 4: chan->AddSamples_m16(len,&bench_data16[pos]);break;
+	case 5: chan->AddSamples_s16(len,&bench_data16[pos*2+1]);break;
+	}
+}
+
+/* Mix the benchmark channels for a number of ticks, returns the time and a checksum of the output */
+static double MIXER_BenchmarkRun(bool simd,Bitu ticks,Bit32u & sum) {
+	mixer.simd=simd;
+	mixer.pos=0;
+	mixer.done=0;
+	mixer.tick_remain=0;
+	mixer.needed=mixer.tick_add >> MIXER_SHIFT;
+	memset(mixer.work,0,sizeof(mixer.work));
+	ring.write=ring.read=0;
+	for (Bitu i=0;i<6;i++) {
+		MixerChannel * chan=bench_chan[i].chan;
+		chan->Enable(false);
+		chan->Enable(true);
+		chan->done=0;
+		chan->last[0]=chan->last[1]=0;
+		bench_chan[i].pos=0;
+	}
+	sum=0;
+	clock_t start=clock();
+	for (Bitu t=0;t<ticks;t++) {
+		MIXER_Mix();
+		for (Bitu i=ring.read;i!=ring.write;i++) {
+			const Bit16s * in=ring.data[i&MIXER_BUFMASK];
+			sum=sum*31+(Bit16u)in[0];
+			sum=sum*31+(Bit16u)in[1];
+		}
+		ring.read=ring.write;
+	}
+	return (double)(clock()-start)*1000.0/CLOCKS_PER_SEC;
+}
+
+void MIXER_BenchmarkMix(void) {
+	Bitu ticks=10000;
+	mixer.freq=44100;
+	mixer.tick_add=(mixer.freq << MIXER_SHIFT)/1000;
+	mixer.mastervol[0]=mixer.mastervol[1]=1.0f;
+	mixer.channels=0;
+	/* Noise that doesn't repeat within a tick */
+	Bit32u seed=1;
+	for (Bitu i=0;i<MIXER_BENCHDATA*2;i++) {
+		seed=seed*1664525+1013904223;
+		bench_data16[i]=(Bit16s)(seed >> 16);
+	}
+	for (Bitu i=0;i<MIXER_BENCHDATA;i++) bench_data32[i]=bench_data16[i] >> 1;
+	bench_chan[0].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<0>,22050,"SB");
+	bench_chan[1].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<1>,44100,"SB16");
+	bench_chan[2].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<2>,49716,"FM");
+	bench_chan[3].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<3>,44100,"GUS");
+	bench_chan[4].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<4>,44100,"SPKR");
+	bench_chan[5].chan=MIXER_AddChannel(&MIXER_BenchmarkHandler<5>,44100,"CDAUDIO");
+	for (Bitu i=0;i<6;i++) bench_chan[i].chan->SetVolume(0.3f+0.1f*i,0.8f-0.1f*i);
+	Bit32u plainSum;
+	double plain=MIXER_BenchmarkRun(false,ticks,plainSum);
+	printf("Mixing 6 channels, %d ms of sound\n",(int)ticks);
+	printf("plain %8.2f ms\n",plain);
+#if defined(MIXER_SIMD)
+	Bit32u simdSum;
+	double simd=MIXER_BenchmarkRun(true,ticks,simdSum);
+	printf("simd  %8.2f ms, output %s\n",simd,simdSum==plainSum ? "the same" : "DIFFERENT");
+#endif
+	for (Bitu i=0;i<6;i++) MIXER_DelChannel(bench_chan[i].chan);
+}
+#endif
+
+/* Only the settings the devices made, the sound in the buffers gets dropped */
+static void MIXER_SaveState(void) {
+	Bit32u count=0;
+	MixerChannel * chan;
+	for (chan=mixer.channels;chan;chan=chan->next) count++;
+	SAVESTATE_WriteVar(count);
+	for (chan=mixer.channels;chan;chan=chan->next) {
+		char name[32];
+		memset(name,0,sizeof(name));
+		safe_strncpy(name,chan->name,32);
+		SAVESTATE_WriteVar(name);
+		SAVESTATE_WriteVar(chan->volmain);
+		SAVESTATE_WriteVar(chan->scale);
+		SAVESTATE_WriteVar(chan->freq_add);
+		SAVESTATE_WriteVar(chan->enabled);
+	}
+}
+
+static void MIXER_LoadState(void) {
+	Bit32u count;
+	SAVESTATE_ReadVar(count);
+	for (;count>0;count--) {
+		char name[32];float volmain[2];float scale;Bitu freq_add;bool enabled;
+		SAVESTATE_ReadVar(name);
+		SAVESTATE_ReadVar(volmain);
+		SAVESTATE_ReadVar(scale);
+		SAVESTATE_ReadVar(freq_add);
+		SAVESTATE_ReadVar(enabled);
+		name[31]=0;
+		MixerChannel * chan=MIXER_FindChannel(name);
+		if (!chan) continue;
+		chan->scale=scale;
+		chan->SetVolume(volmain[0],volmain[1]);
+		chan->freq_add=freq_add;
+		chan->Enable(enabled);
+	}
+}
+
 static void MIXER_ProgramStart(Program * * make) {
 	*make=new MIXER;
 }
@@ -619,7 +826,7 @@ void MIXER_Init(Section* sec) {
 	Section_prop * section=static_cast<Section_prop *>(sec);
 	/* Read out config section */
 	mixer.freq=section->Get_int("rate");
-	mixer.nosound=section->Get_bool("nosound");
+	mixer.nosound=section->Get_bool("nosound") || BENCH_Active;
 	mixer.blocksize=section->Get_int("blocksize");
 
 	/* Initialize the internal stuff */
@@ -627,8 +834,13 @@ void MIXER_Init(Section* sec) {
 	mixer.pos=0;
 	mixer.done=0;
 	memset(mixer.work,0,sizeof(mixer.work));
+	ring.write=ring.read=0;
+	ring.underruns=ring.overruns=0;
 	mixer.mastervol[0]=1.0f;
 	mixer.mastervol[1]=1.0f;
+#if defined(MIXER_SIMD)
+	mixer.simd=section->Get_bool("simd");
+#endif
 
 	/* Start the Mixer using SDL Sound at 22 khz */
 	SDL_AudioSpec spec;
@@ -666,4 +878,5 @@ void MIXER_Init(Section* sec) {
 	mixer.max_needed=mixer.blocksize * 2 + 2*mixer.min_needed;
 	mixer.needed=mixer.min_needed+1;
 	PROGRAMS_MakeFile("MIXER.COM",MIXER_ProgramStart);
+	SAVESTATE_AddHandler("MIXER",MIXER_SaveState,MIXER_LoadState);
 }
@@ -0,0 +1,360 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+	oplrender, a separate tool that isn't part of dosbox itself.
+
+	Renders a raw dro capture to a wave file as fast as possible, with either of
+	the opl emulators. The same capture always gives the same output, so
+	"oplrender -check tests/opl/checksums.txt" compares the output of a set of
+	captures with known checksums to check changes to the emulators.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "adlib.h"
+#include "mem.h"
+#include "dbopl.h"
+
+/*
+	The compat emulators take the noise of the percussion from rand(), which
+	isn't the same in every c library. They get a generator of their own that
+	starts from the same seed for every capture, to keep the checksums the same
+	on all systems.
+*/
+static Bit32u renderNoise;
+
+static int RenderRand( void ) {
+	renderNoise = renderNoise * 1103515245 + 12345;
+	return ( renderNoise >> 16 ) & 0x7fff;
+}
+
+namespace OPL2 {
+	static int rand( void ) {
+		return RenderRand();
+	}
+	#include "opl.cpp"
+}
+
+namespace OPL3 {
+	static int rand( void ) {
+		return RenderRand();
+	}
+	#define OPLTYPE_IS_OPL3
+	#include "opl.cpp"
+}
+
+/*
+	The dbopl handler feeds the mixer in dosbox, here its chip is used directly
+	and the mixer is never called.
+*/
+void MixerChannel::AddSamples_m32(Bitu len, const Bit32s * data) {
+}
+
+void MixerChannel::AddSamples_s32(Bitu len, const Bit32s * data) {
+}
+
+void GFX_ShowMsg(char const* format,...) {
+	va_list msg;
+	va_start(msg,format);
+	vprintf(format,msg);
+	va_end(msg);
+	printf("\n");
+}
+
+using namespace Adlib;
+
+#define RENDER_RATE 49716
+
+static struct {
+	Bit8u hardware;
+	bool compat;
+	DBOPL::Handler* dbopl;
+} render;
+
+static void OPL_RenderWrite( Bit32u reg, Bit8u val ) {
+	if ( render.hardware == HW_OPL2 ) {
+		reg &= 0xff;
+	} else if ( render.hardware == HW_DUALOPL2 ) {
+		//Same as the dual opl2 mode of the module
+		Bit8u index = reg & 0xff;
+		if ( index == 5 )
+			return;
+		if ( index >= 0xe0 )
+			val &= 3;
+		if ( index >= 0xc0 && index <= 0xc8 ) {
+			val &= 0x0f;
+			val |= ( reg & 0x100 ) ? 0xa0 : 0x50;
+		}
+	}
+	if ( !render.compat )
+		render.dbopl->WriteReg( reg, val );
+	else if ( render.hardware == HW_OPL2 )
+		OPL2::adlib_write( reg, val );
+	else
+		OPL3::adlib_write( reg, val );
+}
+
+//Generate stereo samples, at most 512
+static void OPL_RenderGenerate( Bitu samples, Bit16s* output ) {
+	Bit32s buffer[ 512 * 2 ];
+	if ( render.compat ) {
+		if ( render.hardware != HW_OPL2 ) {
+			OPL3::adlib_getsample( output, samples );
+			return;
+		}
+		OPL2::adlib_getsample( output, samples );
+		for ( Bitu i = samples; i > 0; i-- )
+			output[ i * 2 - 1 ] = output[ i * 2 - 2 ] = output[ i - 1 ];
+		return;
+	}
+	DBOPL::Chip& chip = render.dbopl->chip;
+	if ( !chip.opl3Active ) {
+		chip.GenerateBlock2( samples, buffer );
+		for ( Bitu i = samples; i > 0; i-- )
+			buffer[ i * 2 - 1 ] = buffer[ i * 2 - 2 ] = buffer[ i - 1 ];
+	} else {
+		chip.GenerateBlock3( samples, buffer );
+	}
+	for ( Bitu i = 0; i < samples * 2; i++ ) {
+		Bit32s sample = buffer[ i ];
+		if ( sample > MAX_AUDIO )
+			sample = MAX_AUDIO;
+		else if ( sample < MIN_AUDIO )
+			sample = MIN_AUDIO;
+		output[ i ] = (Bit16s)sample;
+	}
+}
+
+struct RenderResult {
+	Bit8u hardware;
+	Bit32u milliseconds;
+	Bit32u samples;
+	Bit32u checksum;
+	double seconds;
+};
+
+//Render a capture, the wave file is left out when wave is 0
+static bool OPL_RenderDro( const char* name, const char* wave, bool compat, RenderResult& result ) {
+	RawHeader header;
+	Bit8u toReg[ 128 ];
+	FILE* handle = fopen( name, "rb" );
+	if ( !handle ) {
+		printf( "Can't open %s\n", name );
+		return false;
+	}
+	bool valid = fread( &header, 1, sizeof( header ), handle ) == sizeof( header ) &&
+		!memcmp( header.id, "DBRAWOPL", 8 ) && host_readw( (HostPt)&header.versionHigh ) == 2 &&
+		header.format == 0 && header.compression == 0 && header.conversionTableSize <= 128 &&
+		fread( toReg, 1, header.conversionTableSize, handle ) == header.conversionTableSize;
+	std::vector< Bit8u > data;
+	if ( valid ) {
+		data.resize( host_readd( (HostPt)&header.commands ) * 2 );
+		if ( data.size() )
+			data.resize( fread( &data[0], 1, data.size(), handle ) );
+	}
+	fclose( handle );
+	if ( !valid ) {
+		printf( "%s isn't a version 2 dro capture\n", name );
+		return false;
+	}
+	FILE* output = 0;
+	Bit8u wavHeader[ 44 ];
+	if ( wave ) {
+		output = fopen( wave, "wb" );
+		if ( !output ) {
+			printf( "Can't create %s\n", wave );
+			return false;
+		}
+		memset( wavHeader, 0, sizeof( wavHeader ) );
+		fwrite( wavHeader, 1, sizeof( wavHeader ), output );
+	}
+
+	render.hardware = header.hardware;
+	render.compat = compat;
+	render.dbopl = 0;
+	renderNoise = 1;
+	if ( !compat ) {
+		render.dbopl = new DBOPL::Handler();
+		render.dbopl->Init( RENDER_RATE );
+	} else if ( header.hardware == HW_OPL2 ) {
+		OPL2::adlib_init( RENDER_RATE );
+	} else {
+		OPL3::adlib_init( RENDER_RATE );
+	}
+	//Dual opl2 is played on the opl3 like the module does
+	if ( header.hardware == HW_DUALOPL2 ) {
+		if ( !compat )
+			render.dbopl->WriteReg( 0x105, 1 );
+		else
+			OPL3::adlib_write( 0x105, 1 );
+	}
+
+	Bit16s samples[ 512 * 2 ];
+	Bitu remain = 0;
+	Bit32u milliseconds = 0;
+	Bit32u total = 0;
+	Bit32u checksum = 2166136261u;
+	clock_t used = 0;
+	for ( Bitu i = 0; i + 1 < data.size(); i += 2 ) {
+		Bit8u raw = data[ i ];
+		Bit8u val = data[ i + 1 ];
+		Bitu delay;
+		if ( raw == header.delay256 ) {
+			delay = val + 1;
+		} else if ( raw == header.delayShift8 ) {
+			delay = ( val + 1 ) << 8;
+		} else {
+			if ( ( raw & 0x7f ) < header.conversionTableSize )
+				OPL_RenderWrite( toReg[ raw & 0x7f ] | ( ( raw & 0x80 ) << 1 ), val );
+			continue;
+		}
+		milliseconds += delay;
+		remain += delay * RENDER_RATE;
+		Bitu todo = remain / 1000;
+		remain %= 1000;
+		while ( todo > 0 ) {
+			Bitu count = todo > 512 ? 512 : todo;
+			todo -= count;
+			clock_t start = clock();
+			OPL_RenderGenerate( count, samples );
+			used += clock() - start;
+			for ( Bitu s = 0; s < count * 2; s++ ) {
+				checksum = ( checksum ^ (Bit16u)samples[ s ] ) * 16777619u;
+				host_writew( (HostPt)&samples[ s ], samples[ s ] );
+			}
+			if ( output )
+				fwrite( samples, 4, count, output );
+			total += count;
+		}
+	}
+	delete render.dbopl;
+
+	if ( output ) {
+		memcpy( &wavHeader[ 0x00 ], "RIFF", 4 );
+		host_writed( &wavHeader[ 0x04 ], total * 4 + sizeof( wavHeader ) - 8 );
+		memcpy( &wavHeader[ 0x08 ], "WAVEfmt ", 8 );
+		host_writed( &wavHeader[ 0x10 ], 0x10 );
+		host_writew( &wavHeader[ 0x14 ], 1 );				//PCM
+		host_writew( &wavHeader[ 0x16 ], 2 );				//Stereo
+		host_writed( &wavHeader[ 0x18 ], RENDER_RATE );
+		host_writed( &wavHeader[ 0x1c ], RENDER_RATE * 4 );
+		host_writew( &wavHeader[ 0x20 ], 4 );
+		host_writew( &wavHeader[ 0x22 ], 16 );
+		memcpy( &wavHeader[ 0x24 ], "data", 4 );
+		host_writed( &wavHeader[ 0x28 ], total * 4 );
+		fseek( output, 0, SEEK_SET );
+		fwrite( wavHeader, 1, sizeof( wavHeader ), output );
+		fclose( output );
+	}
+	result.hardware = header.hardware;
+	result.milliseconds = milliseconds;
+	result.samples = total;
+	result.checksum = checksum;
+	result.seconds = (double)used / CLOCKS_PER_SEC;
+	return true;
+}
+
+static double RealTime( const RenderResult& result ) {
+	return result.seconds > 0 ? result.samples / result.seconds / RENDER_RATE : 0;
+}
+
+/*
+	Every line of the list is a capture, relative to the list, the emulator and
+	the checksum of its output, like "opl3_4op.dro fast 0123abcd".
+*/
+static int OPL_CheckList( const char* list ) {
+	FILE* f = fopen( list, "rt" );
+	if ( !f ) {
+		printf( "Can't open %s\n", list );
+		return 1;
+	}
+	std::string dir( list );
+	std::string::size_type slash = dir.find_last_of( "/\\" );
+	dir = slash == std::string::npos ? "" : dir.substr( 0, slash + 1 );
+	char line[ 512 ];
+	Bitu checked = 0, failed = 0;
+	while ( fgets( line, sizeof( line ), f ) ) {
+		char name[ 256 ], emu[ 16 ];
+		unsigned int expected;
+		if ( line[0] == '#' || sscanf( line, "%255s %15s %x", name, emu, &expected ) != 3 )
+			continue;
+		RenderResult result;
+		std::string path = dir + name;
+		checked++;
+		if ( !OPL_RenderDro( path.c_str(), 0, !strcmp( emu, "compat" ), result ) ) {
+			failed++;
+			continue;
+		}
+		if ( result.checksum != expected ) {
+			printf( "%s %s: FAILED, checksum %08x instead of %08x\n", name, emu, result.checksum, expected );
+			failed++;
+		} else {
+			printf( "%s %s: ok, %.1f times real time\n", name, emu, RealTime( result ) );
+		}
+	}
+	fclose( f );
+	printf( "%d of %d captures render as expected\n", (int)( checked - failed ), (int)checked );
+	return ( failed || !checked ) ? 1 : 0;
+}
+
+int main( int argc, char* argv[] ) {
+	if ( argc == 3 && !strcmp( argv[1], "-check" ) )
+		return OPL_CheckList( argv[2] );
+	int arg = 1;
+	bool compat = false;
+	if ( arg < argc && !strcmp( argv[arg], "-compat" ) ) {
+		compat = true;
+		arg++;
+	}
+	if ( arg >= argc || argc - arg > 2 ) {
+		printf( "Usage: oplrender [-compat] capture.dro [output.wav]\n" );
+		printf( "       oplrender -check checksums.txt\n" );
+		return 1;
+	}
+	std::string dro( argv[arg] );
+	std::string wave;
+	if ( argc - arg == 2 ) {
+		wave = argv[arg + 1];
+	} else {
+		std::string::size_type dot = dro.rfind( '.' );
+		if ( dot != std::string::npos && dro.find_first_of( "/\\", dot ) == std::string::npos )
+			wave = dro.substr( 0, dot );
+		else
+			wave = dro;
+		wave += ".wav";
+	}
+	RenderResult result;
+	if ( !OPL_RenderDro( dro.c_str(), wave.c_str(), compat, result ) )
+		return 1;
+	static const char* const hardwareNames[] = { "opl2", "dual opl2", "opl3" };
+	printf( "%s: %d ms of %s with the %s emulator at %d Hz\n", dro.c_str(), result.milliseconds,
+		result.hardware <= HW_OPL3 ? hardwareNames[ result.hardware ] : "unknown hardware",
+		compat ? "compat" : "fast", RENDER_RATE );
+	printf( "%d samples in %.2f ms", result.samples, result.seconds * 1000 );
+	if ( result.seconds > 0 )
+		printf( ", %.1f times real time", RealTime( result ) );
+	printf( "\nChecksum %08x, written to %s\n", result.checksum, wave.c_str() );
+	return 0;
+}
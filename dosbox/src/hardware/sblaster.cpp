@@ -31,6 +31,7 @@
 #include "setup.h"
 #include "support.h"
 #include "shell.h"
+#include "savestate.h"
 using namespace std;
 
 void MIDI_RawOutByte(Bit8u data);
@@ -1397,6 +1398,11 @@ static Bitu read_sb(Bitu port,Bitu /*iolen*/) {
 	return 0xff;
 }
 
+/* The read status only changes through dsp commands and dma transfers */
+static double poll_sb(Bitu /*port*/) {
+	return -1;
+}
+
 static void write_sb(Bitu port,Bitu val,Bitu /*iolen*/) {
 	Bit8u val8=(Bit8u)(val&0xff);
 	switch (port-sb.hw.base) {
@@ -1462,6 +1468,25 @@ static void SBLASTER_CallBack(Bitu len) {
 	}
 }
 
+static void SBLASTER_SaveState(void) {
+	SAVESTATE_WriteVar(sb);
+	Bit8u dmachan=sb.dma.chan ? sb.dma.chan->channum : 0xff;
+	SAVESTATE_WriteVar(dmachan);
+	SAVESTATE_WriteVar(ASP_regs);
+	SAVESTATE_WriteVar(ASP_init_in_progress);
+}
+
+static void SBLASTER_LoadState(void) {
+	MixerChannel * chan=sb.chan;
+	SAVESTATE_ReadVar(sb);
+	sb.chan=chan;
+	Bit8u dmachan;
+	SAVESTATE_ReadVar(dmachan);
+	sb.dma.chan=(dmachan==0xff) ? NULL : GetDMAChannel(dmachan);
+	SAVESTATE_ReadVar(ASP_regs);
+	SAVESTATE_ReadVar(ASP_init_in_progress);
+}
+
 class SBLASTER: public Module_base {
 private:
 	/* Data */
@@ -1554,6 +1579,7 @@ public:
 		}
 		if (sb.type==SBT_NONE || sb.type==SBT_GB) return;
 
+		SAVESTATE_AddHandler("SB",SBLASTER_SaveState,SBLASTER_LoadState);
 		sb.chan=MixerChan.Install(&SBLASTER_CallBack,22050,"SB");
 		sb.dsp.state=DSP_S_NORMAL;
 		sb.dsp.out.lastval=0xaa;
@@ -1566,6 +1592,7 @@ public:
 			ReadHandler[i].Install(sb.hw.base+i,read_sb,IO_MB);
 			WriteHandler[i].Install(sb.hw.base+i,write_sb,IO_MB);
 		}
+		IO_RegisterPollHandler(sb.hw.base+DSP_READ_STATUS,poll_sb);
 		for (i=0;i<256;i++) ASP_regs[i] = 0;
 		ASP_regs[5] = 0x01;
 		ASP_regs[9] = 0xf8;
@@ -1610,6 +1637,8 @@ public:
 			break;
 		}
 		if (sb.type==SBT_NONE || sb.type==SBT_GB) return;
+		IO_FreePollHandler(sb.hw.base+DSP_READ_STATUS);
+		SAVESTATE_RemoveHandler("SB");
 		DSP_Reset(); // Stop everything	
 	}	
 }; //End of SBLASTER class
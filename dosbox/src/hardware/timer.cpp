@@ -26,6 +26,7 @@
 #include "mixer.h"
 #include "timer.h"
 #include "setup.h"
+#include "savestate.h"
 
 static INLINE void BIN2BCD(Bit16u& val) {
 	Bit16u temp=val%10 + (((val/10)%10)<<4)+ (((val/100)%10)<<8) + (((val/1000)%10)<<12);
@@ -394,6 +395,20 @@ void TIMER_SetGate2(bool in) {
 	gate2 = in; //Set it here so the counter_latch above works
 }
 
+static void TIMER_SaveState(void) {
+	SAVESTATE_WriteVar(pit);
+	SAVESTATE_WriteVar(gate2);
+	SAVESTATE_WriteVar(latched_timerstatus);
+	SAVESTATE_WriteVar(latched_timerstatus_locked);
+}
+
+static void TIMER_LoadState(void) {
+	SAVESTATE_ReadVar(pit);
+	SAVESTATE_ReadVar(gate2);
+	SAVESTATE_ReadVar(latched_timerstatus);
+	SAVESTATE_ReadVar(latched_timerstatus_locked);
+}
+
 class TIMER:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[4];
@@ -445,6 +460,7 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event,pit[0].delay);
+		SAVESTATE_AddHandler("TIMER",TIMER_SaveState,TIMER_LoadState);
 	}
 	~TIMER(){
 		PIC_RemoveEvents(PIT0_Event);
@@ -23,8 +23,11 @@
 #include "video.h"
 #include "pic.h"
 #include "vga.h"
+#include "mem.h"
+#include "savestate.h"
 
 #include <string.h>
+#include <vector>
 
 VGA_Type vga;
 SVGA_Driver svga;
@@ -149,6 +152,9 @@ void VGA_SetCGA2Table(Bit8u val0,Bit8u val1) {
 			(total[(i >> 1) & 1] << 16 ) | (total[(i >> 0) & 1] << 24 );
 #endif
 	}
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw=true;
+#endif
 }
 
 void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3) {
@@ -171,26 +177,96 @@ void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3) {
 			(total[((i >> 1) & 1) | ((i >> 4) & 2)] << 16 ) | (total[((i >> 0) & 1) | ((i >> 3) & 2)] << 24 );
 #endif
 	}	
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw=true;
+#endif
 }
 
-void VGA_Init(Section* sec) {
-//	Section_prop * section=static_cast<Section_prop *>(sec);
-	vga.draw.resizing=false;
-	vga.mode=M_ERROR;			//For first init
-	SVGA_Setup_Driver();
-	VGA_SetupMemory(sec);
-	VGA_SetupMisc();
-	VGA_SetupDAC();
-	VGA_SetupGFX();
-	VGA_SetupSEQ();
-	VGA_SetupAttr();
-	VGA_SetupOther();
-	VGA_SetupXGA();
-	VGA_SetClock(0,CLK_25);
-	VGA_SetClock(1,CLK_28);
-/* Generate tables */
-	VGA_SetCGA2Table(0,1);
-	VGA_SetCGA4Table(0,1,2,3);
+/* Pointers into the different memory blocks get stored as block and offset */
+enum { VGA_PTR_NULL,VGA_PTR_LINEAR,VGA_PTR_FASTMEM,VGA_PTR_FONT,VGA_PTR_MEMBASE };
+
+static bool VGA_PtrIn(const Bit8u * ptr,const Bit8u * base,Bitu size) {
+	return ptr>=base && ptr<base+size;
+}
+
+static void VGA_SavePtr(const Bit8u * ptr) {
+	Bit8u block=VGA_PTR_NULL;const Bit8u * base=0;
+	Bitu linear_size=((vga.vmemsize<512*1024) ? 512*1024 : vga.vmemsize)+2048;
+	if (!ptr) ;
+	else if (VGA_PtrIn(ptr,vga.mem.linear,linear_size)) { block=VGA_PTR_LINEAR;base=vga.mem.linear; }
+	else if (VGA_PtrIn(ptr,vga.fastmem,(vga.vmemsize<<1)+4096)) { block=VGA_PTR_FASTMEM;base=vga.fastmem; }
+	else if (VGA_PtrIn(ptr,vga.draw.font,sizeof(vga.draw.font))) { block=VGA_PTR_FONT;base=vga.draw.font; }
+	else if (VGA_PtrIn(ptr,MemBase,MEM_TotalPages()*MEM_PAGESIZE)) { block=VGA_PTR_MEMBASE;base=MemBase; }
+	else E_Exit("SAVESTATE:Unknown vga pointer");
+	Bit32u offset=(Bit32u)(ptr-base);
+	SAVESTATE_WriteVar(block);
+	SAVESTATE_WriteVar(offset);
+}
+
+static Bit8u * VGA_LoadPtr(void) {
+	Bit8u block;Bit32u offset;
+	SAVESTATE_ReadVar(block);
+	SAVESTATE_ReadVar(offset);
+	switch (block) {
+	case VGA_PTR_LINEAR:return vga.mem.linear+offset;
+	case VGA_PTR_FASTMEM:return vga.fastmem+offset;
+	case VGA_PTR_FONT:return vga.draw.font+offset;
+	case VGA_PTR_MEMBASE:return MemBase+offset;
+	}
+	return 0;
+}
+
+static std::vector<Bit64u> vga_memhashes;
+
+static void VGA_SaveMemory(void) {
+	vga_memhashes.resize(SAVESTATE_PAGES(vga.vmemsize)+SAVESTATE_PAGES(vga.vmemsize<<1));
+	Bit64u * hashes=&vga_memhashes[0];
+	SAVESTATE_WritePages(vga.mem.linear,vga.vmemsize,hashes);
+	SAVESTATE_WritePages(vga.fastmem,vga.vmemsize<<1,hashes+SAVESTATE_PAGES(vga.vmemsize));
+}
+
+static void VGA_LoadMemory(void) {
+	vga_memhashes.resize(SAVESTATE_PAGES(vga.vmemsize)+SAVESTATE_PAGES(vga.vmemsize<<1));
+	Bit64u * hashes=&vga_memhashes[0];
+	SAVESTATE_ReadPages(vga.mem.linear,vga.vmemsize,hashes);
+	SAVESTATE_ReadPages(vga.fastmem,vga.vmemsize<<1,hashes+SAVESTATE_PAGES(vga.vmemsize));
+}
+
+static void VGA_SaveState(void) {
+	SAVESTATE_WriteVar(vga);
+	VGA_SavePtr(vga.draw.linear_base);
+	VGA_SavePtr(vga.draw.font_tables[0]);
+	VGA_SavePtr(vga.draw.font_tables[1]);
+	VGA_SavePtr(vga.tandy.draw_base);
+	VGA_SavePtr(vga.tandy.mem_base);
+}
+
+static void VGA_LoadState(void) {
+	/* Stop the frame that is being drawn, it belongs to the old screen */
+	VGA_KillDrawing();
+	static VGA_Type current;
+	current=vga;
+	SAVESTATE_ReadVar(vga);
+	vga.mem=current.mem;
+	vga.fastmem=current.fastmem;
+	vga.fastmem_orgptr=current.fastmem_orgptr;
+#ifdef VGA_KEEP_CHANGES
+	vga.changes=current.changes;
+#endif
+	vga.lfb.handler=current.lfb.handler;
+	vga.draw.linear_base=VGA_LoadPtr();
+	vga.draw.font_tables[0]=VGA_LoadPtr();
+	vga.draw.font_tables[1]=VGA_LoadPtr();
+	vga.tandy.draw_base=VGA_LoadPtr();
+	vga.tandy.mem_base=VGA_LoadPtr();
+	VGA_SetupHandlers();
+	VGA_DAC_UpdateColorPalette();
+	/* Force the output to be setup again */
+	vga.draw.width=0;
+	VGA_SetupDrawing(0);
+}
+
+void VGA_SetupTables(void) {
 	Bitu i,j;
 	for (i=0;i<256;i++) {
 		ExpandTable[i]=i | (i << 8)| (i <<16) | (i << 24);
@@ -241,6 +317,29 @@ void VGA_Init(Section* sec) {
 	}
 }
 
+void VGA_Init(Section* sec) {
+//	Section_prop * section=static_cast<Section_prop *>(sec);
+	vga.draw.resizing=false;
+	vga.mode=M_ERROR;			//For first init
+	SVGA_Setup_Driver();
+	VGA_SetupMemory(sec);
+	VGA_SetupMisc();
+	VGA_SetupDAC();
+	VGA_SetupGFX();
+	VGA_SetupSEQ();
+	VGA_SetupAttr();
+	VGA_SetupOther();
+	VGA_SetupXGA();
+	VGA_SetClock(0,CLK_25);
+	VGA_SetClock(1,CLK_28);
+/* Generate tables */
+	VGA_SetCGA2Table(0,1);
+	VGA_SetCGA4Table(0,1,2,3);
+	VGA_SetupTables();
+	SAVESTATE_AddHandler("VGAMEM",VGA_SaveMemory,VGA_LoadMemory,true);
+	SAVESTATE_AddHandler("VGA",VGA_SaveState,VGA_LoadState);
+}
+
 void SVGA_Setup_Driver(void) {
 	memset(&svga, 0, sizeof(SVGA_Driver));
 
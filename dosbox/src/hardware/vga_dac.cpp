@@ -56,6 +56,10 @@ static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
 	const Bit8u blue = vga.dac.rgb[src].blue;
 	//Set entry in 16bit output lookup table
 	vga.dac.xlat16[index] = ((blue>>1)&0x1f) | (((green)&0x3f)<<5) | (((red>>1)&0x1f) << 11);
+#ifdef VGA_KEEP_CHANGES
+	//The 16bit output of the line handlers changes with it
+	vga.changes.redraw = true;
+#endif
 	
 	RENDER_SetPal( index, (red << 2) | ( red >> 4 ), (green << 2) | ( green >> 4 ), (blue << 2) | ( blue >> 4 ) );
 }
@@ -195,6 +199,19 @@ void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue) {
 			VGA_DAC_SendColor( i, i );
 }
 
+/* Send the complete palette again, used after the dac state was restored */
+void VGA_DAC_UpdateColorPalette(void) {
+	switch (vga.mode) {
+	case M_VGA:
+	case M_LIN8:
+		for (Bitu i=0;i<256;i++) VGA_DAC_UpdateColor( i );
+		break;
+	default:
+		for (Bitu i=0;i<16;i++) VGA_DAC_SendColor( i, vga.dac.combine[i] );
+		break;
+	}
+}
+
 void VGA_SetupDAC(void) {
 	vga.dac.first_changed=256;
 	vga.dac.bits=6;
@@ -26,6 +26,8 @@
 #include "../gui/render_scalers.h"
 #include "vga.h"
 #include "pic.h"
+#include "benchmark.h"
+#include "profiler.h"
 
 //#undef C_DEBUG
 //#define C_DEBUG 1
@@ -146,34 +148,6 @@ static Bit8u * VGA_Draw_4BPP_Line_Double(Bitu vidstart, Bitu line) {
 	return TempLine;
 }
 
-#ifdef VGA_KEEP_CHANGES
-static Bit8u * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line) {
-	Bitu checkMask = vga.changes.checkMask;
-	Bit8u *map = vga.changes.map;
-	Bitu start = (vidstart >> VGA_CHANGE_SHIFT);
-	Bitu end = ((vidstart + vga.draw.line_length ) >> VGA_CHANGE_SHIFT);
-	for (; start <= end;start++) {
-		if ( map[start] & checkMask ) {
-			Bitu offset = vidstart & vga.draw.linear_mask;
-			if(vga.draw.linear_mask-offset < vga.draw.line_length)
-				memcpy(vga.draw.linear_base+vga.draw.linear_mask+1, vga.draw.linear_base, vga.draw.line_length);
-			Bit8u *ret = &vga.draw.linear_base[ offset ];
-#if !defined(C_UNALIGNED_MEMORY)
-			if (GCC_UNLIKELY( ((Bitu)ret) & (sizeof(Bitu)-1)) ) {
-				memcpy( TempLine, ret, vga.draw.line_length );
-				return TempLine;
-			}
-#endif
-			return ret;
-		}
-	}
-//	memset( TempLine, 0x30, vga.changes.lineWidth );
-//	return TempLine;
-	return 0;
-}
-
-#endif
-
 static Bit8u * VGA_Draw_Linear_Line(Bitu vidstart, Bitu /*line*/) {
 // There is guaranteed extra memory past the wrap boundary. So, instead of using temporary
 // storage just copy appropriate chunk from the beginning to the wrap boundary when needed.
@@ -610,19 +584,238 @@ skip_cursor:
 }
 
 #ifdef VGA_KEEP_CHANGES
-static INLINE void VGA_ChangesEnd(void ) {
-	if ( vga.changes.active ) {
-//		vga.changes.active = false;
-		Bitu end = vga.draw.address >> VGA_CHANGE_SHIFT;
-		Bitu total = 4 + end - vga.changes.start;
-		Bit32u clearMask = vga.changes.clearMask;
-		total >>= 2;
-		Bit32u *clear = (Bit32u *)&vga.changes.map[  vga.changes.start & ~3 ];
-		while ( total-- ) {
-			clear[0] &= clearMask;
-			clear++;
+/*
+	Lines that didn't change since the last drawn frame are passed to the
+	renderer as 0, which skips both the line handler and the scaler. Memory
+	written through the vga page handlers marks its blocks in the change map,
+	lines drawn from there only check the map. Text, CGA, Tandy and Hercules
+	memory and the mapped lfb are written directly by the guest, those lines
+	are compared with a copy of the memory they were last drawn from.
+*/
+
+/* A write only marks the block of its first byte and a planar dword covers 32 bytes */
+#define VGA_CHANGES_LOOKBACK 32
+
+typedef struct {
+	Bitu vidstart, line;
+	Bitu size;		/* 0 when there's no copy of the line */
+} VGA_ChangesLine;
+
+/* Everything besides the memory that decides what a line looks like */
+typedef struct {
+	VGA_Line_Handler handler;
+	VGAModes mode;
+	Bitu address, address_line, panning, bytes_skip;
+	Bitu split_line, vblank_skip, lines_total;
+	Bitu address_add, address_line_total, blocks, line_length;
+	Bit8u * linear_base;
+	Bitu linear_mask;
+	Bit8u * draw_base;
+	Bitu line_mask, line_shift, addr_mask;
+	Bit8u * font_tables[2];
+	Bit32u font_mask;
+	Bitu cursor_enabled, cursor_sline, cursor_eline;
+	Bitu attr_mode, underline;
+} VGA_ChangesState;
+
+static struct {
+	VGA_ChangesState state;
+	VGA_ChangesLine * lines;
+	Bit8u * copy;
+	Bitu total, pitch;
+	Bitu cursor, lastCursor;
+} changes;
+
+/* Check if everything the line handler reads is marked in the change map */
+static bool VGA_ChangesTracked(void) {
+	if (VGA_DrawLine!=VGA_Draw_Linear_Line && VGA_DrawLine!=VGA_Draw_Xlat16_Linear_Line)
+		return false;
+	switch (vga.mode) {
+	case M_EGA:
+	case M_LIN4:
+		return vga.draw.linear_base==vga.fastmem;
+	case M_VGA:
+	case M_LIN8:
+		if (vga.config.chained && vga.config.compatible_chain4)
+			return vga.draw.linear_base==vga.fastmem;
+#ifndef VGA_LFB_MAPPED
+		return vga.draw.linear_base==vga.mem.linear;
+	case M_LIN15:
+	case M_LIN16:
+	case M_LIN32:
+		return vga.draw.linear_base==vga.mem.linear;
+#endif
+	default:
+		return false;
+	}
+}
+
+static bool VGA_ChangesText(void) {
+	return VGA_DrawLine==VGA_TEXT_Draw_Line || VGA_DrawLine==VGA_TEXT_Herc_Draw_Line ||
+		VGA_DrawLine==VGA_TEXT_Xlat16_Draw_Line || VGA_DrawLine==VGA_TEXT_Xlat16_Draw_Line_9;
+}
+
+/* The memory the line handler reads for a line, false when it's not known */
+static bool VGA_ChangesSource(Bitu line, const Bit8u * &base, Bitu &mask, Bitu &size) {
+	VGA_Line_Handler handler = VGA_DrawLine;
+	if (handler==VGA_Draw_Linear_Line || handler==VGA_Draw_Xlat16_Linear_Line) {
+		base = vga.draw.linear_base;
+		mask = vga.draw.linear_mask;
+		size = vga.draw.line_length;
+	} else if (VGA_ChangesText()) {
+		base = vga.tandy.draw_base;
+		mask = vga.draw.linear_mask;
+		size = 2 * vga.draw.blocks + 2;
+	} else {
+		base = vga.tandy.draw_base + ((line & vga.tandy.line_mask) << vga.tandy.line_shift);
+		if (handler==VGA_Draw_1BPP_Line) {
+			mask = 8 * 1024 - 1;
+			size = vga.draw.blocks;
+		} else if (handler==VGA_Draw_2BPP_Line || handler==VGA_Draw_4BPP_Line_Double) {
+			mask = vga.tandy.addr_mask;
+			size = vga.draw.blocks;
+		} else if (handler==VGA_Draw_2BPPHiRes_Line || handler==VGA_Draw_4BPP_Line) {
+			mask = vga.tandy.addr_mask;
+			size = 2 * vga.draw.blocks;
+		} else if (handler==VGA_Draw_CGA16_Line) {
+			// Reads without wrapping and always looks at 640 pixels
+			mask = ~(Bitu)0;
+			size = vga.draw.blocks > 80 ? vga.draw.blocks : 80;
+		} else return false;
+	}
+	return size!=0;
+}
+
+/* Update the copy of a line, returns true when it was the same already */
+static bool VGA_ChangesCompare(Bit8u * copy, const Bit8u * base, Bitu start, Bitu mask, Bitu size) {
+	start &= mask;
+	Bitu first = mask - start;
+	if (first >= size - 1) {
+		if (!memcmp(copy, &base[start], size))
+			return true;
+		memcpy(copy, &base[start], size);
+		return false;
+	}
+	// The line wraps around the end of memory
+	first++;
+	if (!memcmp(copy, &base[start], first) && !memcmp(&copy[first], base, size - first))
+		return true;
+	memcpy(copy, &base[start], first);
+	memcpy(&copy[first], base, size - first);
+	return false;
+}
+
+static Bit8u * VGA_DrawChangedLine(Bitu vidstart, Bitu line) {
+	if (!vga.changes.compare) {
+		if (vga.changes.active) {
+			Bitu offset = vidstart & vga.draw.linear_mask;
+			// Lines that wrap are put together by the line handler, just draw them
+			if (offset + vga.draw.line_length <= vga.draw.linear_mask + 1) {
+				const Bit8u * map = vga.changes.map;
+				Bitu checkMask = vga.changes.checkMask;
+				Bitu start = (offset > VGA_CHANGES_LOOKBACK ? offset - VGA_CHANGES_LOOKBACK : 0) >> VGA_CHANGE_SHIFT;
+				Bitu end = (offset + vga.draw.line_length - 1) >> VGA_CHANGE_SHIFT;
+				for (; start <= end; start++) {
+					if (map[start] & checkMask)
+						return VGA_DrawLine(vidstart, line);
+				}
+				return 0;
+			}
+		}
+		return VGA_DrawLine(vidstart, line);
+	}
+	if (GCC_UNLIKELY(vga.draw.lines_done >= changes.total))
+		return VGA_DrawLine(vidstart, line);
+	VGA_ChangesLine & last = changes.lines[vga.draw.lines_done];
+	const Bit8u * base;
+	Bitu mask, size;
+	if (!VGA_ChangesSource(line, base, mask, size) || size > changes.pitch) {
+		last.size = 0;
+		return VGA_DrawLine(vidstart, line);
+	}
+	bool same = VGA_ChangesCompare(&changes.copy[vga.draw.lines_done * changes.pitch], base, vidstart, mask, size);
+	same = same && last.size == size && last.vidstart == vidstart && last.line == line;
+	last.vidstart = vidstart;
+	last.line = line;
+	last.size = size;
+	if (same && vga.changes.active) {
+		if (!VGA_ChangesText())
+			return 0;
+		// The cursor blinks and moves without touching memory
+		if ((Bitu)((changes.cursor - vidstart) >> 1) >= vga.draw.blocks &&
+			(Bitu)((changes.lastCursor - vidstart) >> 1) >= vga.draw.blocks)
+			return 0;
+	}
+	return VGA_DrawLine(vidstart, line);
+}
+
+static void VGA_ChangesStart(void) {
+	VGA_ChangesState state;
+	memset(&state, 0, sizeof(state));
+	state.handler = VGA_DrawLine;
+	state.mode = vga.mode;
+	state.address = vga.draw.address;
+	state.address_line = vga.draw.address_line;
+	state.panning = vga.draw.panning;
+	state.bytes_skip = vga.draw.bytes_skip;
+	state.split_line = vga.draw.split_line;
+	state.vblank_skip = vga.draw.vblank_skip;
+	state.lines_total = vga.draw.lines_total;
+	state.address_add = vga.draw.address_add;
+	state.address_line_total = vga.draw.address_line_total;
+	state.blocks = vga.draw.blocks;
+	state.line_length = vga.draw.line_length;
+	state.linear_base = vga.draw.linear_base;
+	state.linear_mask = vga.draw.linear_mask;
+	state.draw_base = vga.tandy.draw_base;
+	state.line_mask = vga.tandy.line_mask;
+	state.line_shift = vga.tandy.line_shift;
+	state.addr_mask = vga.tandy.addr_mask;
+	state.font_tables[0] = vga.draw.font_tables[0];
+	state.font_tables[1] = vga.draw.font_tables[1];
+	state.font_mask = FontMask[1];
+	state.cursor_enabled = vga.draw.cursor.enabled;
+	state.cursor_sline = vga.draw.cursor.sline;
+	state.cursor_eline = vga.draw.cursor.eline;
+	state.attr_mode = vga.attr.mode_control;
+	state.underline = vga.crtc.underline_location;
+	bool same = !memcmp(&state, &changes.state, sizeof(state));
+	changes.state = state;
+	changes.lastCursor = changes.cursor;
+	changes.cursor = vga.draw.cursor.address;
+
+	vga.changes.compare = !VGA_ChangesTracked();
+	if (vga.changes.compare) {
+		const Bit8u * base;
+		Bitu mask, size;
+		if (!VGA_ChangesSource(0, base, mask, size))
+			size = 0;
+		if (changes.total < vga.draw.lines_total || changes.pitch < size) {
+			delete[] changes.lines;
+			delete[] changes.copy;
+			if (changes.total < vga.draw.lines_total) changes.total = vga.draw.lines_total;
+			if (changes.pitch < size) changes.pitch = size;
+			changes.lines = new VGA_ChangesLine[changes.total];
+			memset(changes.lines, 0, changes.total * sizeof(VGA_ChangesLine));
+			changes.copy = new Bit8u[changes.total * changes.pitch];
 		}
 	}
+	vga.changes.active = same && !vga.changes.redraw && render.nullInput;
+	vga.changes.redraw = false;
+
+	// Check the writes since the last frame and those that happen while drawing this one
+	Bit8u lastMask = vga.changes.writeMask;
+	vga.changes.frame++;
+	vga.changes.writeMask = 1 << (vga.changes.frame & 7);
+	vga.changes.checkMask = lastMask | vga.changes.writeMask;
+	Bit32u clearMask = ~(0x01010101 * vga.changes.writeMask);
+	Bit32u * clear = (Bit32u *)vga.changes.map;
+	for (Bitu total = VGA_CHANGE_MAPSIZE >> 2; total; total--)
+		*clear++ &= clearMask;
+}
+#else
+static INLINE Bit8u * VGA_DrawChangedLine(Bitu vidstart, Bitu line) {
+	return VGA_DrawLine(vidstart, line);
 }
 #endif
 
@@ -645,8 +838,11 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 		// draw blanked line (DoWhackaDo, Alien Carnage, TV sports Football)
 		memset(TempLine, 0, sizeof(TempLine));
 		RENDER_DrawLine(TempLine);
+#ifdef VGA_KEEP_CHANGES
+		vga.changes.redraw = true;
+#endif
 	} else {
-		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );	
+		Bit8u * data=VGA_DrawChangedLine( vga.draw.address, vga.draw.address_line );	
 		RENDER_DrawLine(data);
 	}
 
@@ -663,34 +859,29 @@ static void VGA_DrawSingleLine(Bitu /*blah*/) {
 }
 
 static void VGA_DrawPart(Bitu lines) {
+	Bit64u bench=BENCH_Begin();
+	PROF_Enter(PROF_VGA);
 	while (lines--) {
-		Bit8u * data=VGA_DrawLine( vga.draw.address, vga.draw.address_line );
+		Bit8u * data=VGA_DrawChangedLine( vga.draw.address, vga.draw.address_line );
+		PROF_Enter(PROF_SCALER);
 		RENDER_DrawLine(data);
+		PROF_Leave();
 		vga.draw.address_line++;
 		if (vga.draw.address_line>=vga.draw.address_line_total) {
 			vga.draw.address_line=0;
 			vga.draw.address+=vga.draw.address_add;
 		}
 		vga.draw.lines_done++;
-		if (vga.draw.split_line==vga.draw.lines_done) {
-#ifdef VGA_KEEP_CHANGES
-			VGA_ChangesEnd( );
-#endif
-			VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-			vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-#endif
-		}
+		if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
 	}
 	if (--vga.draw.parts_left) {
 		PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts,
 			 (vga.draw.parts_left!=1) ? vga.draw.parts_lines  : (vga.draw.lines_total - vga.draw.lines_done));
 	} else {
-#ifdef VGA_KEEP_CHANGES
-		VGA_ChangesEnd();
-#endif
 		RENDER_EndUpdate(false);
 	}
+	PROF_Leave();
+	BENCH_End(BENCH_TIMER_RENDER,bench);
 }
 
 void VGA_SetBlinking(Bitu enabled) {
@@ -706,30 +897,10 @@ void VGA_SetBlinking(Bitu enabled) {
 		vga.tandy.mode_control&=~0x20;
 	}
 	for (Bitu i=0;i<8;i++) TXT_BG_Table[i+8]=(b+i) | ((b+i) << 8)| ((b+i) <<16) | ((b+i) << 24);
-}
-
 #ifdef VGA_KEEP_CHANGES
-static void INLINE VGA_ChangesStart( void ) {
-	vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-	vga.changes.last = vga.changes.start;
-	if ( vga.changes.lastAddress != vga.draw.address ) {
-//		LOG_MSG("Address");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-		vga.changes.lastAddress = vga.draw.address;
-	} else if ( render.fullFrame ) {
-//		LOG_MSG("Full Frame");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-	} else {
-//		LOG_MSG("Changes");
-		VGA_DrawLine = VGA_Draw_Changes_Line;
-	}
-	vga.changes.active = true;
-	vga.changes.checkMask = vga.changes.writeMask;
-	vga.changes.clearMask = ~( 0x01010101 << (vga.changes.frame & 7));
-	vga.changes.frame++;
-	vga.changes.writeMask = 1 << (vga.changes.frame & 7);
-}
+	vga.changes.redraw = true;
 #endif
+}
 
 static void VGA_VertInterrupt(Bitu /*val*/) {
 	if ((!vga.draw.vret_triggered) && ((vga.crtc.vertical_retrace_end&0x30)==0x10)) {
@@ -800,9 +971,6 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	// go figure...
 	if (machine==MCH_EGA) vga.draw.split_line*=2;
 //	if (machine==MCH_EGA) vga.draw.split_line = ((((vga.config.line_compare&0x5ff)+1)*2-1)/vga.draw.lines_scaled);
-#ifdef VGA_KEEP_CHANGES
-	bool startaddr_changed=false;
-#endif
 	switch (vga.mode) {
 	case M_EGA:
 		if (!(vga.crtc.mode_control&0x1)) vga.draw.linear_mask &= ~0x10000;
@@ -812,9 +980,6 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_VGA:
 		if(vga.config.compatible_chain4 && (vga.crtc.underline_location & 0x40)) {
@@ -832,9 +997,6 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		vga.draw.address += vga.draw.bytes_skip;
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		vga.draw.address += vga.draw.panning;
-#ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
-#endif
 		break;
 	case M_TEXT:
 		vga.draw.byte_panning_shift = 2;
@@ -866,7 +1028,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	}
 	if (GCC_UNLIKELY(vga.draw.split_line==0)) VGA_ProcessSplit();
 #ifdef VGA_KEEP_CHANGES
-	if (startaddr_changed) VGA_ChangesStart();
+	VGA_ChangesStart();
 #endif
 
 	// check if some lines at the top off the screen are blanked
@@ -883,6 +1045,10 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			LOG(LOG_VGAMISC,LOG_NORMAL)( "Parts left: %d", vga.draw.parts_left );
 			PIC_RemoveEvents(VGA_DrawPart);
 			RENDER_EndUpdate(true);
+#ifdef VGA_KEEP_CHANGES
+			// The rest of the last frame never got drawn
+			vga.changes.active = false;
+#endif
 		}
 		vga.draw.lines_done = 0;
 		vga.draw.parts_left = vga.draw.parts_total;
@@ -894,6 +1060,9 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 				vga.draw.lines_total-vga.draw.lines_done);
 			PIC_RemoveEvents(VGA_DrawSingleLine);
 			RENDER_EndUpdate(true);
+#ifdef VGA_KEEP_CHANGES
+			vga.changes.active = false;
+#endif
 		}
 		vga.draw.lines_done = 0;
 		PIC_AddEvent(VGA_DrawSingleLine,(float)(vga.draw.delay.htotal/4.0 + draw_skip));
@@ -1429,8 +1598,7 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 	vga.draw.line_length = width * ((bpp + 1) / 8);
 #ifdef VGA_KEEP_CHANGES
 	vga.changes.active = false;
-	vga.changes.frame = 0;
-	vga.changes.writeMask = 1;
+	vga.changes.redraw = true;
 #endif
     /* 
 	   Cheap hack to just make all > 640x480 modes have 4:3 aspect ratio
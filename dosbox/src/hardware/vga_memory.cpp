@@ -19,7 +19,9 @@
 /* $Id: vga_memory.cpp,v 1.53 2009-07-04 21:23:35 qbix79 Exp $ */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include "dosbox.h"
 #include "mem.h"
 #include "vga.h"
@@ -125,6 +127,169 @@ INLINE static Bit32u ModeOperation(Bit8u val) {
 	return full;
 }
 
+/* SSE2/NEON versions of the latch operations. The planes of consecutive planar
+   addresses sit next to each other as dwords, so a dword write to vga memory
+   handles the four of them with one vector */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+typedef __m128i VGAVec_t;
+
+static INLINE VGAVec_t VGAVecLoad(const void * src) {
+	return _mm_loadu_si128((const __m128i *)src);
+}
+static INLINE void VGAVecStore(void * dst,VGAVec_t v) {
+	_mm_storeu_si128((__m128i *)dst,v);
+}
+static INLINE VGAVec_t VGAVecSplat(Bit32u val) {
+	return _mm_set1_epi32((int)val);
+}
+static INLINE VGAVec_t VGAVecSet(Bit32u d0,Bit32u d1,Bit32u d2,Bit32u d3) {
+	return _mm_set_epi32((int)d3,(int)d2,(int)d1,(int)d0);
+}
+static INLINE VGAVec_t VGAVecAnd(VGAVec_t a,VGAVec_t b) {
+	return _mm_and_si128(a,b);
+}
+static INLINE VGAVec_t VGAVecOr(VGAVec_t a,VGAVec_t b) {
+	return _mm_or_si128(a,b);
+}
+static INLINE VGAVec_t VGAVecXor(VGAVec_t a,VGAVec_t b) {
+	return _mm_xor_si128(a,b);
+}
+/* a & ~b */
+static INLINE VGAVec_t VGAVecAndNot(VGAVec_t a,VGAVec_t b) {
+	return _mm_andnot_si128(b,a);
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef uint32x4_t VGAVec_t;
+
+static INLINE VGAVec_t VGAVecLoad(const void * src) {
+	return vld1q_u32((const uint32_t *)src);
+}
+static INLINE void VGAVecStore(void * dst,VGAVec_t v) {
+	vst1q_u32((uint32_t *)dst,v);
+}
+static INLINE VGAVec_t VGAVecSplat(Bit32u val) {
+	return vdupq_n_u32(val);
+}
+static INLINE VGAVec_t VGAVecSet(Bit32u d0,Bit32u d1,Bit32u d2,Bit32u d3) {
+	const uint32x2_t lo=vcreate_u32((uint64_t)d0 | ((uint64_t)d1 << 32));
+	const uint32x2_t hi=vcreate_u32((uint64_t)d2 | ((uint64_t)d3 << 32));
+	return vcombine_u32(lo,hi);
+}
+static INLINE VGAVec_t VGAVecAnd(VGAVec_t a,VGAVec_t b) {
+	return vandq_u32(a,b);
+}
+static INLINE VGAVec_t VGAVecOr(VGAVec_t a,VGAVec_t b) {
+	return vorrq_u32(a,b);
+}
+static INLINE VGAVec_t VGAVecXor(VGAVec_t a,VGAVec_t b) {
+	return veorq_u32(a,b);
+}
+/* a & ~b */
+static INLINE VGAVec_t VGAVecAndNot(VGAVec_t a,VGAVec_t b) {
+	return vbicq_u32(a,b);
+}
+#else
+typedef struct {
+	Bit32u d[4];
+} VGAVec_t;
+
+static INLINE VGAVec_t VGAVecLoad(const void * src) {
+	VGAVec_t v;
+	memcpy(v.d,src,sizeof(v.d));
+	return v;
+}
+static INLINE void VGAVecStore(void * dst,VGAVec_t v) {
+	memcpy(dst,v.d,sizeof(v.d));
+}
+static INLINE VGAVec_t VGAVecSplat(Bit32u val) {
+	VGAVec_t v;
+	for (Bitu i=0;i<4;i++) v.d[i]=val;
+	return v;
+}
+static INLINE VGAVec_t VGAVecSet(Bit32u d0,Bit32u d1,Bit32u d2,Bit32u d3) {
+	VGAVec_t v;
+	v.d[0]=d0;v.d[1]=d1;v.d[2]=d2;v.d[3]=d3;
+	return v;
+}
+static INLINE VGAVec_t VGAVecAnd(VGAVec_t a,VGAVec_t b) {
+	for (Bitu i=0;i<4;i++) a.d[i]&=b.d[i];
+	return a;
+}
+static INLINE VGAVec_t VGAVecOr(VGAVec_t a,VGAVec_t b) {
+	for (Bitu i=0;i<4;i++) a.d[i]|=b.d[i];
+	return a;
+}
+static INLINE VGAVec_t VGAVecXor(VGAVec_t a,VGAVec_t b) {
+	for (Bitu i=0;i<4;i++) a.d[i]^=b.d[i];
+	return a;
+}
+static INLINE VGAVec_t VGAVecAndNot(VGAVec_t a,VGAVec_t b) {
+	for (Bitu i=0;i<4;i++) a.d[i]&=~b.d[i];
+	return a;
+}
+#endif
+
+INLINE static VGAVec_t RasterOp4(VGAVec_t input,VGAVec_t mask) {
+	VGAVec_t latch=VGAVecSplat(vga.latch.d);
+	switch (vga.config.raster_op) {
+	case 0x00:	/* None */
+		return VGAVecOr(VGAVecAnd(input,mask),VGAVecAndNot(latch,mask));
+	case 0x01:	/* AND */
+		return VGAVecAndNot(latch,VGAVecAndNot(mask,input));
+	case 0x02:	/* OR */
+		return VGAVecOr(VGAVecAnd(input,mask),latch);
+	case 0x03:	/* XOR */
+		return VGAVecXor(VGAVecAnd(input,mask),latch);
+	};
+	return VGAVecSplat(0);
+}
+
+/* ModeOperation for the four bytes of val at once, the write mode and raster op
+   are only looked at once and the latch is the same for all of them */
+INLINE static Bit32u ExpandRotated(Bitu val,Bitu shift,Bitu rotate) {
+	Bit8u b=(Bit8u)(val >> shift);
+	return ExpandTable[(Bit8u)((b >> rotate) | (b << (8-rotate)))];
+}
+
+INLINE static VGAVec_t ModeOperation4(Bitu val) {
+	Bitu rotate=vga.config.data_rotate;
+	switch (vga.config.write_mode) {
+	case 0x00:
+		return RasterOp4(VGAVecOr(VGAVecAnd(VGAVecSet(ExpandRotated(val,0,rotate),ExpandRotated(val,8,rotate),
+			ExpandRotated(val,16,rotate),ExpandRotated(val,24,rotate)),VGAVecSplat(vga.config.full_not_enable_set_reset)),
+			VGAVecSplat(vga.config.full_enable_and_set_reset)),VGAVecSplat(vga.config.full_bit_mask));
+	case 0x01:
+		return VGAVecSplat(vga.latch.d);
+	case 0x02:
+		return RasterOp4(VGAVecSet(FillTable[val & 0xF],FillTable[(val >> 8) & 0xF],
+			FillTable[(val >> 16) & 0xF],FillTable[(val >> 24) & 0xF]),VGAVecSplat(vga.config.full_bit_mask));
+	case 0x03:
+		return RasterOp4(VGAVecSplat(vga.config.full_set_reset),
+			VGAVecAnd(VGAVecSet(ExpandRotated(val,0,rotate),ExpandRotated(val,8,rotate),
+			ExpandRotated(val,16,rotate),ExpandRotated(val,24,rotate)),VGAVecSplat(vga.config.full_bit_mask)));
+	default:
+		LOG(LOG_VGAMISC,LOG_NORMAL)("VGA:Unsupported write mode %d",vga.config.write_mode);
+		return VGAVecSplat(0);
+	}
+}
+
+/* Writes the planes of count (2 or 4) consecutive planar addresses through the map mask */
+INLINE static void WritePlanes(PhysPt start,Bitu val,Bitu count) {
+	VGAVec_t data=ModeOperation4(val);
+	Bit32u * planes=&((Bit32u*)vga.mem.linear)[start];
+	if (count==4) {
+		VGAVec_t map=VGAVecSplat(vga.config.full_map_mask);
+		VGAVecStore(planes,VGAVecOr(VGAVecAndNot(VGAVecLoad(planes),map),VGAVecAnd(data,map)));
+	} else {
+		Bit32u lanes[4];
+		VGAVecStore(lanes,data);
+		for (Bitu i=0;i<count;i++)
+			planes[i]=(planes[i] & vga.config.full_not_map_mask) | (lanes[i] & vga.config.full_map_mask);
+	}
+}
+
 /* Gonna assume that whoever maps vga memory, maps it on 32/64kb boundary */
 
 #define VGA_PAGES		(128/4)
@@ -216,14 +381,14 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( addr << 1);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( addr << 1);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -231,7 +396,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( addr << 1);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -274,6 +439,18 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[start]=pixels.d;
+		writePixels(start,pixels);
+	}
+	/* Word and dword writes, count bytes of val in one pass */
+	void writeBlock(PhysPt start, Bitu val, Bitu count) {
+		WritePlanes(start,val,count);
+		for (Bitu i=0;i<count;i++) {
+			VGA_Latch pixels;
+			pixels.d=((Bit32u*)vga.mem.linear)[start+i];
+			writePixels(start+i,pixels);
+		}
+	}
+	static INLINE void writePixels(PhysPt start, VGA_Latch pixels) {
 		Bit8u * write_pixels=&vga.fastmem[start<<3];
 
 		Bit32u colors0_3, colors4_7;
@@ -308,18 +485,14 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
-		writeHandler<true>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<true>(addr+1,(Bit8u)(val >> 8));
+		writeBlock(addr,val,2);
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
-		writeHandler<true>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<true>(addr+1,(Bit8u)(val >> 8));
-		writeHandler<true>(addr+2,(Bit8u)(val >> 16));
-		writeHandler<true>(addr+3,(Bit8u)(val >> 24));
+		writeBlock(addr,val,4);
 	}
 };
 
@@ -444,18 +617,14 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(Bit8u)(val >> 0));
-		writeHandler(addr+1,(Bit8u)(val >> 8));
+		WritePlanes(addr,val,2);
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
-		writeHandler(addr+0,(Bit8u)(val >> 0));
-		writeHandler(addr+1,(Bit8u)(val >> 8));
-		writeHandler(addr+2,(Bit8u)(val >> 16));
-		writeHandler(addr+3,(Bit8u)(val >> 24));
+		WritePlanes(addr,val,4);
 	}
 };
 
@@ -472,6 +641,9 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		if (vga.seq.map_mask & 0x4) {
 			vga.draw.font[addr]=(Bit8u)val;
+#ifdef VGA_KEEP_CHANGES
+			vga.changes.redraw=true;
+#endif
 		}
 	}
 };
@@ -552,17 +724,13 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
-		writeHandler<false>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<false>(addr+1,(Bit8u)(val >> 8));
+		writeBlock(addr,val,2);
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
-		writeHandler<false>(addr+0,(Bit8u)(val >> 0));
-		writeHandler<false>(addr+1,(Bit8u)(val >> 8));
-		writeHandler<false>(addr+2,(Bit8u)(val >> 16));
-		writeHandler<false>(addr+3,(Bit8u)(val >> 24));
+		writeBlock(addr,val,4);
 	}
 	Bitu readb(PhysPt addr) {
 		addr = vga.svga.bank_read_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
@@ -887,6 +1055,9 @@ void VGA_SetupHandlers(void) {
 	if(svgaCard == SVGA_S3Trio && (vga.s3.ext_mem_ctrl & 0x10))
 		MEM_SetPageHandler(VGA_PAGE_A0, 16, &vgaph.mmio);
 range_done:
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw=true;
+#endif
 	PAGING_ClearTLB();
 }
 
@@ -931,9 +1102,8 @@ void VGA_SetupMemory(Section* sec) {
 
 #ifdef VGA_KEEP_CHANGES
 	memset( &vga.changes, 0, sizeof( vga.changes ));
-	int changesMapSize = (vga.vmemsize >> VGA_CHANGE_SHIFT) + 32;
-	vga.changes.map = new Bit8u[changesMapSize];
-	memset(vga.changes.map, 0, changesMapSize);
+	vga.changes.map = new Bit8u[VGA_CHANGE_MAPSIZE];
+	memset(vga.changes.map, 0, VGA_CHANGE_MAPSIZE);
 #endif
 	vga.svga.bank_read = vga.svga.bank_write = 0;
 	vga.svga.bank_read_full = vga.svga.bank_write_full = 0;
@@ -947,3 +1117,89 @@ void VGA_SetupMemory(Section* sec) {
 		//TODO map?	
 	} 
 }
+
+#if C_BENCHMARKS
+static void VGA_BenchmarkConfig(void) {
+	vga.config.write_mode=rand() & 3;
+	vga.config.raster_op=rand() & 3;
+	vga.config.data_rotate=rand() & 7;
+	vga.config.full_bit_mask=ExpandTable[rand() & 0xff];
+	vga.config.full_map_mask=FillTable[rand() & 0xf];
+	vga.config.full_not_map_mask=~vga.config.full_map_mask;
+	vga.config.full_set_reset=FillTable[rand() & 0xf];
+	vga.config.full_enable_set_reset=FillTable[rand() & 0xf];
+	vga.config.full_not_enable_set_reset=~vga.config.full_enable_set_reset;
+	vga.config.full_enable_and_set_reset=vga.config.full_set_reset & vga.config.full_enable_set_reset;
+	vga.latch.d=((Bit32u)rand() << 16) ^ (Bit32u)rand();
+}
+
+/* Checks the word and dword writes of the planar modes against byte writes with
+   random register settings, then times both */
+void VGA_BenchmarkPlanar(void) {
+	const Bitu planar=0x10000;
+	const Bitu settings=400;
+	const Bitu writes=4*1024*1024;
+	VGA_Type saved=vga;
+	VGA_SetupTables();
+	Bit8u * mem[2];
+	Bit8u * fast[2];
+	for (Bitu i=0;i<2;i++) {
+		mem[i]=new Bit8u[planar*4+2048];
+		fast[i]=new Bit8u[planar*8+2048];
+	}
+	VGA_UnchainedVGA_Handler vgaHandler;
+	VGA_UnchainedEGA_Handler egaHandler;
+	Bitu errors=0;
+	srand(1);
+	for (Bitu s=0;s<settings;s++) {
+		bool ega=(s & 1)!=0;
+		for (Bitu i=0;i<planar*4;i++) mem[0][i]=(Bit8u)rand();
+		for (Bitu i=0;i<planar*8;i++) fast[0][i]=(Bit8u)rand();
+		memcpy(mem[1],mem[0],planar*4);
+		memcpy(fast[1],fast[0],planar*8);
+		VGA_BenchmarkConfig();
+		for (Bitu w=0;w<1000;w++) {
+			Bitu count=(rand() & 1) ? 4 : 2;
+			PhysPt addr=rand() % (planar-4);
+			Bitu val=((Bit32u)rand() << 16) ^ (Bit32u)rand();
+			vga.mem.linear=mem[0];
+			vga.fastmem=fast[0];
+			for (Bitu i=0;i<count;i++) {
+				if (ega) egaHandler.writeHandler<true>(addr+i,(Bit8u)(val >> (i*8)));
+				else vgaHandler.writeHandler(addr+i,(Bit8u)(val >> (i*8)));
+			}
+			vga.mem.linear=mem[1];
+			vga.fastmem=fast[1];
+			if (ega) egaHandler.writeBlock(addr,val,count);
+			else WritePlanes(addr,val,count);
+		}
+		if (memcmp(mem[0],mem[1],planar*4) || memcmp(fast[0],fast[1],planar*8)) {
+			printf("Mismatch in %s write mode %d raster op %d\n",ega ? "ega" : "vga",
+				vga.config.write_mode,vga.config.raster_op);
+			errors++;
+		}
+	}
+	printf("%d random register settings checked, %d mismatches\n\n",(int)settings,(int)errors);
+	printf("Write mode   byte ms  dword ms   (%d dword writes)\n",(int)writes);
+	vga.mem.linear=mem[0];
+	for (Bit8u mode=0;mode<4;mode++) {
+		VGA_BenchmarkConfig();
+		vga.config.write_mode=mode;
+		clock_t start=clock();
+		for (Bitu n=0;n<writes;n++) {
+			PhysPt addr=(PhysPt)((n*4) & (planar-4));
+			for (Bitu i=0;i<4;i++) vgaHandler.writeHandler(addr+i,(Bit8u)(n >> (i*8)));
+		}
+		double bytes=(double)(clock()-start)*1000.0/CLOCKS_PER_SEC;
+		start=clock();
+		for (Bitu n=0;n<writes;n++) WritePlanes((PhysPt)((n*4) & (planar-4)),n,4);
+		double dwords=(double)(clock()-start)*1000.0/CLOCKS_PER_SEC;
+		printf("%10d %9.1f %9.1f\n",mode,bytes,dwords);
+	}
+	for (Bitu i=0;i<2;i++) {
+		delete[] mem[i];
+		delete[] fast[i];
+	}
+	vga=saved;
+}
+#endif
@@ -56,6 +56,27 @@ Bitu vga_read_p3da(Bitu port,Bitu iolen) {
 	return retval;
 }
 
+/* Next moment one of the status bits of 3DAh flips */
+static double vga_poll_p3da(Bitu /*port*/) {
+	double timeInFrame = PIC_FullIndex()-vga.draw.delay.framestart;
+	double next = -1;
+	if (timeInFrame < vga.draw.delay.vrstart) next = vga.draw.delay.vrstart;
+	else if (timeInFrame <= vga.draw.delay.vrend) next = vga.draw.delay.vrend;
+	if (timeInFrame < vga.draw.delay.vdend) {
+		double lineStart = timeInFrame-fmod(timeInFrame,vga.draw.delay.htotal);
+		double timeInLine = timeInFrame-lineStart;
+		double lineNext;
+		if (timeInLine < vga.draw.delay.hblkstart) lineNext = lineStart+vga.draw.delay.hblkstart;
+		else if (timeInLine <= vga.draw.delay.hblkend) lineNext = lineStart+vga.draw.delay.hblkend;
+		else lineNext = lineStart+vga.draw.delay.htotal+vga.draw.delay.hblkstart;
+		if (lineNext > vga.draw.delay.vdend) lineNext = vga.draw.delay.vdend;
+		if (next < 0 || lineNext < next) next = lineNext;
+	}
+	/* Otherwise nothing changes before the vertical timer starts a new frame */
+	if (next < 0) return -1;
+	return vga.draw.delay.framestart+next;
+}
+
 static void write_p3c2(Bitu port,Bitu val,Bitu iolen) {
 	vga.misc_output=val;
 	if (val & 0x1) {
@@ -141,6 +162,8 @@ static Bitu read_p3c2(Bitu port,Bitu iolen) {
 void VGA_SetupMisc(void) {
 	if (IS_EGAVGA_ARCH) {
 		vga.draw.vret_triggered=false;
+		IO_RegisterPollHandler(0x3ba,vga_poll_p3da);
+		IO_RegisterPollHandler(0x3da,vga_poll_p3da);
 		IO_RegisterReadHandler(0x3c2,read_p3c2,IO_MB);
 		IO_RegisterWriteHandler(0x3c2,write_p3c2,IO_MB);
 		if (IS_VGA_ARCH) {
@@ -151,5 +174,6 @@ void VGA_SetupMisc(void) {
 		}
 	} else if (machine==MCH_CGA || IS_TANDY_ARCH) {
 		IO_RegisterReadHandler(0x3da,vga_read_p3da,IO_MB);
+		IO_RegisterPollHandler(0x3da,vga_poll_p3da);
 	}
 }
@@ -138,6 +138,9 @@ void XGA_DrawPoint(Bitu x, Bitu y, Bitu c) {
 	if(y > xga.scissors.y2) return;
 
 	Bit32u memaddr = (y * XGA_SCREEN_WIDTH) + x;
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw = true;
+#endif
 	/* Need to zero out all unused bits in modes that have any (15-bit or "32"-bit -- the last
 	   one is actually 24-bit. Without this step there may be some graphics corruption (mainly,
 	   during windows dragging. */
@@ -20,6 +20,7 @@
 
 #include "dosbox.h"
 #include "callback.h"
+#include "cpu.h"
 #include "mem.h"
 #include "bios.h"
 #include "keyboard.h"
@@ -497,6 +498,8 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			/* nothing changes until the next key arrives, don't spin through the slice */
+			CPU_Idle();
 		}
 		break;
 	case 0x10: /* GET KEYSTROKE (enhanced keyboards only) */
@@ -509,6 +512,7 @@ static Bitu INT16_Handler(void) {
 		} else {
 			/* enter small idle loop to allow for irqs to happen */
 			reg_ip+=1;
+			CPU_Idle();
 		}
 		break;
 	case 0x01: /* CHECK FOR KEYSTROKE */
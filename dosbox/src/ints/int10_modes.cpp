@@ -400,6 +400,9 @@ static void FinishSetMode(bool clearmem) {
 			/* Hack we just acess the memory directly */
 			memset(vga.mem.linear,0,vga.vmemsize);
 			memset(vga.fastmem, 0, vga.vmemsize<<1);
+#ifdef VGA_KEEP_CHANGES
+			vga.changes.redraw = true;
+#endif
       default:;
 		}
 	}
@@ -33,6 +33,7 @@
 #include "int10.h"
 #include "bios.h"
 #include "dos_inc.h"
+#include "benchmark.h"
 
 static Bitu call_int33,call_int74,int74_ret_callback,call_mouse_bd;
 static Bit16u ps2cbseg,ps2cbofs;
@@ -447,6 +448,7 @@ void DrawCursor() {
 }
 
 void Mouse_CursorMoved(float xrel,float yrel,float x,float y,bool emulate) {
+	if (GCC_UNLIKELY(BENCH_Recording)) BENCH_RecordMouseMove(xrel,yrel,x,y,emulate);
 	float dx = xrel * mouse.pixelPerMickey_x;
 	float dy = yrel * mouse.pixelPerMickey_y;
 
@@ -496,6 +498,7 @@ void Mouse_CursorSet(float x,float y) {
 }
 
 void Mouse_ButtonPressed(Bit8u button) {
+	if (GCC_UNLIKELY(BENCH_Recording)) BENCH_RecordMouseButton(button,true);
 	switch (button) {
 #if (MOUSE_BUTTONS >= 1)
 	case 0:
@@ -524,6 +527,7 @@ void Mouse_ButtonPressed(Bit8u button) {
 }
 
 void Mouse_ButtonReleased(Bit8u button) {
+	if (GCC_UNLIKELY(BENCH_Recording)) BENCH_RecordMouseButton(button,false);
 	switch (button) {
 #if (MOUSE_BUTTONS >= 1)
 	case 0:
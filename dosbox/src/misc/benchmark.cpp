@@ -0,0 +1,285 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "dosbox.h"
+#include "benchmark.h"
+#include "control.h"
+#include "programs.h"
+#include "setup.h"
+#include "timer.h"
+#include "pic.h"
+#include "cpu.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "support.h"
+
+#if defined (WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+bool BENCH_Active=false;
+bool BENCH_Recording=false;
+Bit64u BENCH_Counts[BENCH_COUNT_MAX];
+Bit64u BENCH_Times[BENCH_TIMER_MAX];
+
+/* Indexed by KBD_KEYS, the same names the mapper uses */
+static const char * const bench_keys[KBD_LAST]={
+	"none",
+	"1","2","3","4","5","6","7","8","9","0",
+	"q","w","e","r","t","y","u","i","o","p",
+	"a","s","d","f","g","h","j","k","l","z",
+	"x","c","v","b","n","m",
+	"f1","f2","f3","f4","f5","f6","f7","f8","f9","f10","f11","f12",
+	"esc","tab","bspace","enter","space",
+	"lalt","ralt","lctrl","rctrl","lshift","rshift",
+	"capslock","scrolllock","numlock",
+	"grave","minus","equals","backslash","lbracket","rbracket",
+	"semicolon","quote","period","comma","slash","lessthan",
+	"printscreen","pause",
+	"insert","home","pageup","delete","end","pagedown",
+	"left","up","down","right",
+	"kp_1","kp_2","kp_3","kp_4","kp_5","kp_6","kp_7","kp_8","kp_9","kp_0",
+	"kp_divide","kp_multiply","kp_minus","kp_plus","kp_enter","kp_period"
+};
+
+enum BenchEventType {
+	BEV_KEY,BEV_MOVE,BEV_BUTTON
+};
+
+struct BenchEvent {
+	Bitu time;
+	BenchEventType type;
+	Bitu code;
+	bool pressed;
+	float xrel,yrel,x,y;
+	bool emulate;
+	bool operator<(const BenchEvent & other) const {
+		return time<other.time;
+	}
+};
+
+static struct {
+	Bitu duration;
+	Bitu start;
+	Bit64u wallStart;
+	std::vector<BenchEvent> events;
+	Bitu next;
+	FILE * record;
+	std::string recordName;
+} bench;
+
+Bit64u BENCH_Time(void) {
+#if defined (WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (Bit64u)((double)count.QuadPart*1000000.0/(double)freq.QuadPart);
+#else
+	struct timeval tv;
+	gettimeofday(&tv,0);
+	return (Bit64u)tv.tv_sec*1000000+tv.tv_usec;
+#endif
+}
+
+bool BENCH_Headless(void) {
+	return control->cmdline->FindExist("-benchmark") || control->cmdline->FindExist("-checkdynrec");
+}
+
+static Bitu BENCH_Now(void) {
+	return PIC_Ticks-bench.start;
+}
+
+void BENCH_RecordKey(Bitu key,bool pressed) {
+	if (key>=KBD_LAST) return;
+	fprintf(bench.record,"%lu key %s %s\n",(unsigned long)BENCH_Now(),bench_keys[key],pressed ? "down" : "up");
+}
+
+void BENCH_RecordMouseMove(float xrel,float yrel,float x,float y,bool emulate) {
+	fprintf(bench.record,"%lu move %g %g %g %g %d\n",(unsigned long)BENCH_Now(),xrel,yrel,x,y,emulate ? 1 : 0);
+}
+
+void BENCH_RecordMouseButton(Bit8u button,bool pressed) {
+	fprintf(bench.record,"%lu button %d %s\n",(unsigned long)BENCH_Now(),button,pressed ? "down" : "up");
+}
+
+static bool BENCH_ParseLine(const char * line,BenchEvent & event) {
+	char type[16],name[32],state[8];
+	unsigned long time;
+	int button,emulate;
+	if (sscanf(line,"%lu %15s",&time,type)!=2) return false;
+	event.time=time;
+	if (!strcmp(type,"key")) {
+		if (sscanf(line,"%*u %*s %31s %7s",name,state)!=2) return false;
+		for (event.code=0;event.code<KBD_LAST;event.code++)
+			if (!strcasecmp(name,bench_keys[event.code])) break;
+		if (event.code==KBD_LAST) return false;
+		event.type=BEV_KEY;
+		event.pressed=!strcasecmp(state,"down");
+	} else if (!strcmp(type,"move")) {
+		if (sscanf(line,"%*u %*s %f %f %f %f %d",&event.xrel,&event.yrel,&event.x,&event.y,&emulate)!=5) return false;
+		event.type=BEV_MOVE;
+		event.emulate=emulate!=0;
+	} else if (!strcmp(type,"button")) {
+		if (sscanf(line,"%*u %*s %d %7s",&button,state)!=2) return false;
+		event.type=BEV_BUTTON;
+		event.code=button;
+		event.pressed=!strcasecmp(state,"down");
+	} else return false;
+	return true;
+}
+
+static void BENCH_LoadScript(const char * name) {
+	FILE * f=fopen(name,"rt");
+	if (!f) E_Exit("BENCH:Can't open replay script %s",name);
+	char line[256];
+	Bitu linenum=0;
+	while (fgets(line,sizeof(line),f)) {
+		linenum++;
+		char * start=line;
+		while (*start==' ' || *start=='\t') start++;
+		if (*start=='#' || *start=='\n' || *start=='\r' || !*start) continue;
+		BenchEvent event;
+		if (!BENCH_ParseLine(start,event)) {
+			LOG_MSG("BENCH:Ignoring line %d of %s",(int)linenum,name);
+			continue;
+		}
+		bench.events.push_back(event);
+	}
+	fclose(f);
+	std::stable_sort(bench.events.begin(),bench.events.end());
+	LOG_MSG("BENCH:Replaying %d input events from %s",(int)bench.events.size(),name);
+}
+
+static void BENCH_Report(void) {
+	double wall=(double)(BENCH_Time()-bench.wallStart)/1000000.0;
+	double emulated=(double)BENCH_Now()/1000.0;
+	if (wall<=0) wall=0.000001;
+	double times[BENCH_TIMER_MAX];
+	for (Bitu i=0;i<BENCH_TIMER_MAX;i++) times[i]=(double)BENCH_Times[i]/1000000.0;
+	double tick=times[BENCH_TIMER_TICK]-times[BENCH_TIMER_MIXER];
+	double cpu=wall-times[BENCH_TIMER_TICK]-times[BENCH_TIMER_RENDER]-times[BENCH_TIMER_EVENTS];
+	printf("\nBenchmark: %.1f emulated seconds in %.3f seconds, %.2fx real time\n",emulated,wall,emulated/wall);
+	double cycles=(double)(BENCH_Counts[BENCH_COUNT_CYCLES]-BENCH_Counts[BENCH_COUNT_IDLE]);
+	printf("  cycles        %14.0f  %10.3f million/s\n",cycles,cycles/wall/1000000.0);
+	printf("  idle cycles   %14.0f\n",(double)BENCH_Counts[BENCH_COUNT_IDLE]);
+	printf("  frames        %14.0f  %10.2f /s\n",(double)BENCH_Counts[BENCH_COUNT_FRAMES],(double)BENCH_Counts[BENCH_COUNT_FRAMES]/wall);
+	printf("  audio samples %14.0f  %10.0f /s\n",(double)BENCH_Counts[BENCH_COUNT_SAMPLES],(double)BENCH_Counts[BENCH_COUNT_SAMPLES]/wall);
+	printf("  input events  %14.0f\n",(double)BENCH_Counts[BENCH_COUNT_INPUT]);
+	printf("  host time: cpu and devices %.3fs (%.1f%%), timers %.3fs (%.1f%%), mixer %.3fs (%.1f%%),\n",
+		cpu,cpu*100/wall,tick,tick*100/wall,times[BENCH_TIMER_MIXER],times[BENCH_TIMER_MIXER]*100/wall);
+	printf("             render %.3fs (%.1f%%), events %.3fs (%.1f%%)\n",
+		times[BENCH_TIMER_RENDER],times[BENCH_TIMER_RENDER]*100/wall,times[BENCH_TIMER_EVENTS],times[BENCH_TIMER_EVENTS]*100/wall);
+	if (CPU_CycleAutoAdjust) printf("  automatic cycles don't adjust while benchmarking, use a fixed cycles setting\n");
+	fflush(stdout);
+}
+
+static void BENCH_TickHandler(void) {
+	Bitu now=BENCH_Now();
+	while (bench.next<bench.events.size() && bench.events[bench.next].time<=now) {
+		const BenchEvent & event=bench.events[bench.next++];
+		switch (event.type) {
+		case BEV_KEY:
+			KEYBOARD_AddKey((KBD_KEYS)event.code,event.pressed);
+			break;
+		case BEV_MOVE:
+			Mouse_CursorMoved(event.xrel,event.yrel,event.x,event.y,event.emulate);
+			break;
+		case BEV_BUTTON:
+			if (event.pressed) Mouse_ButtonPressed((Bit8u)event.code);
+			else Mouse_ButtonReleased((Bit8u)event.code);
+			break;
+		}
+		BENCH_Count(BENCH_COUNT_INPUT,1);
+	}
+	if (BENCH_Active) {
+		if (now>=bench.duration) {
+			BENCH_Report();
+			throw(0);
+		}
+	}
+}
+
+void BENCH_Clone(Bitu index) {
+	char name[32];
+	sprintf(name,"clone%d.txt",(int)index);
+	if (!freopen(name,"wt",stdout)) E_Exit("BENCH:Can't create %s",name);
+	if (!bench.record) return;
+	/* The script of the copy starts with everything recorded before the clone */
+	fclose(bench.record);
+	sprintf(name,".%d",(int)index);
+	std::string copy=bench.recordName+name;
+	FILE * from=fopen(bench.recordName.c_str(),"rb");
+	bench.record=fopen(copy.c_str(),"wb");
+	if (!bench.record) E_Exit("BENCH:Can't create input script %s",copy.c_str());
+	if (from) {
+		char buf[4096];
+		size_t size;
+		while ((size=fread(buf,1,sizeof(buf),from))>0) fwrite(buf,1,size,bench.record);
+		fclose(from);
+	}
+	bench.recordName=copy;
+}
+
+static void BENCH_Destroy(Section * /*sec*/) {
+	if (bench.record) {
+		fclose(bench.record);
+		bench.record=0;
+	}
+	BENCH_Recording=false;
+	BENCH_Active=false;
+	TIMER_DelTickHandler(BENCH_TickHandler);
+}
+
+void BENCH_Init(Section * sec) {
+	std::string value;
+	int seconds;
+	bench.start=PIC_Ticks;
+	bench.next=0;
+	bench.events.clear();
+	bench.record=0;
+	if (control->cmdline->FindInt("-benchmark",seconds,true)) {
+		if (seconds<1) seconds=1;
+		bench.duration=seconds*1000;
+		BENCH_Active=true;
+		memset(BENCH_Counts,0,sizeof(BENCH_Counts));
+		memset(BENCH_Times,0,sizeof(BENCH_Times));
+		LOG_MSG("BENCH:Running for %d emulated seconds",seconds);
+	}
+	if (control->cmdline->FindString("-replay",value,true)) {
+		BENCH_LoadScript(value.c_str());
+	} else if (control->cmdline->FindString("-record",value,true)) {
+		bench.record=fopen(value.c_str(),"wt");
+		if (!bench.record) E_Exit("BENCH:Can't create input script %s",value.c_str());
+		bench.recordName=value;
+		fprintf(bench.record,"# DOSBox input script, times in emulated milliseconds\n");
+		BENCH_Recording=true;
+	}
+	if (BENCH_Active || bench.events.size()) TIMER_AddTickHandler(BENCH_TickHandler);
+	sec->AddDestroyFunction(&BENCH_Destroy);
+	bench.wallStart=BENCH_Time();
+}
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+	The micro benchmarks of single subsystems, "dosbox -bench <name>" runs
+	one and exits. They're only built with C_BENCHMARKS, this file isn't part
+	of the iOS app.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "dosbox.h"
+#include "benchmark.h"
+#include "control.h"
+#include "setup.h"
+#include "render.h"
+#include "pic.h"
+#include "paging.h"
+#include "vga.h"
+#include "mixer.h"
+
+#if C_BENCHMARKS
+
+static const struct {
+	const char * name;
+	void (*run)(void);
+	const char * help;
+} micro_benches[]={
+	{ "scalers",	RENDER_BenchmarkScalers,	"the scalers, plain and with SIMD" },
+	{ "pic",		PIC_BenchmarkQueue,			"the event heap against the old sorted list" },
+	{ "tlb",		PAGING_BenchmarkTLB,		"cr3 reloads and lookups, flushing by walk and by generation" },
+	{ "vga",		VGA_BenchmarkPlanar,		"planar byte writes against dword writes" },
+	{ "mixer",		MIXER_BenchmarkMix,			"mixing typical channels, plain and with SIMD" },
+};
+
+bool BENCH_RunMicro(void) {
+	std::string name;
+	if (control->cmdline->FindString("-bench",name,true)) {
+		for (Bitu i=0;i<sizeof(micro_benches)/sizeof(micro_benches[0]);i++) {
+			if (!strcasecmp(name.c_str(),micro_benches[i].name)) {
+				micro_benches[i].run();
+				return true;
+			}
+		}
+		printf("Unknown benchmark %s\n",name.c_str());
+	} else if (!control->cmdline->FindExist("-bench",true)) {
+		return false;
+	}
+	printf("Usage: dosbox -bench <name>, the benchmarks are\n");
+	for (Bitu i=0;i<sizeof(micro_benches)/sizeof(micro_benches[0]);i++) {
+		printf("  %-10s %s\n",micro_benches[i].name,micro_benches[i].help);
+	}
+	return true;
+}
+
+#endif
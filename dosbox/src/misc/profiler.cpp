@@ -0,0 +1,184 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "SDL.h"
+#include "SDL_thread.h"
+#include "dosbox.h"
+#include "profiler.h"
+#include "setup.h"
+#include "mapper.h"
+#include "hardware.h"
+#include "regs.h"
+
+volatile bool PROF_Active=false;
+volatile Bitu PROF_Depth=0;
+volatile Bit8u PROF_Stack[PROF_STACKSIZE];
+
+static const char * const prof_names[PROF_MAX]={
+	"cpu","paging","io","pic","timer","mixer","vga","scaler","events"
+};
+
+/* Guest locations are grouped in blocks of this many bytes */
+#define PROF_GUESTSHIFT 4
+
+static struct {
+	SDL_Thread * thread;
+	volatile bool quit;
+	Bitu samples;
+	Bitu start;
+	Bitu self[PROF_MAX];
+	Bitu total[PROF_MAX];
+	std::map<Bit64u,Bitu> guest;
+	std::map<std::string,Bitu> folded;
+} prof;
+
+static void PROF_Sample(void) {
+	Bit8u stack[PROF_STACKSIZE];
+	Bitu depth=PROF_Depth;
+	if (depth>PROF_STACKSIZE) depth=PROF_STACKSIZE;
+	for (Bitu i=0;i<depth;i++) stack[i]=PROF_Stack[i];
+	/* Read without any locking, at worst a sample lands on a neighbouring instruction */
+	Bit32u seg=SegValue(cs);
+	Bit32u eip=reg_eip;
+
+	prof.samples++;
+	Bitu top=depth ? stack[depth-1] : (Bitu)PROF_CPU;
+	prof.self[top]++;
+	bool seen[PROF_MAX];
+	memset(seen,0,sizeof(seen));
+	for (Bitu i=0;i<depth;i++) {
+		if (!seen[stack[i]]) prof.total[stack[i]]++;
+		seen[stack[i]]=true;
+	}
+	if (!seen[PROF_CPU] && (!depth || stack[0]==PROF_PAGING || stack[0]==PROF_IO)) prof.total[PROF_CPU]++;
+
+	std::string key("dosbox");
+	/* Paging and io are always reached from the cpu core */
+	if (!depth || stack[0]==PROF_PAGING || stack[0]==PROF_IO) key+=";cpu";
+	for (Bitu i=0;i<depth;i++) {
+		key+=';';
+		key+=prof_names[stack[i]];
+	}
+	if (!depth) {
+		Bit64u where=((Bit64u)seg << 32) | (eip & ~((1 << PROF_GUESTSHIFT)-1));
+		prof.guest[where]++;
+		char buf[24];
+		sprintf(buf,";%04X:%08X",seg,(Bit32u)where);
+		key+=buf;
+	}
+	prof.folded[key]++;
+}
+
+static int PROF_Thread(void * /*data*/) {
+	while (!prof.quit) {
+		SDL_Delay(1);
+		if (!prof.quit) PROF_Sample();
+	}
+	return 0;
+}
+
+static bool PROF_CompareGuest(const std::pair<Bit64u,Bitu> & a,const std::pair<Bit64u,Bitu> & b) {
+	return a.second>b.second;
+}
+
+static void PROF_Report(void) {
+	if (!prof.samples) return;
+	Bitu msecs=SDL_GetTicks()-prof.start;
+	FILE * f=OpenCaptureFile("Profile",".txt");
+	if (f) {
+		fprintf(f,"%d samples over %d ms\n\n",(int)prof.samples,(int)msecs);
+		fprintf(f,"section      self%%   total%%\n");
+		for (Bitu i=0;i<PROF_MAX;i++) {
+			fprintf(f,"%-10s %6.2f  %6.2f\n",prof_names[i],
+				prof.self[i]*100.0/prof.samples,prof.total[i]*100.0/prof.samples);
+		}
+		std::vector<std::pair<Bit64u,Bitu> > guest(prof.guest.begin(),prof.guest.end());
+		std::sort(guest.begin(),guest.end(),PROF_CompareGuest);
+		fprintf(f,"\nguest hot spots, %d byte blocks\n",1 << PROF_GUESTSHIFT);
+		fprintf(f,"  cs:eip         samples       %%\n");
+		for (Bitu i=0;i<guest.size() && i<64;i++) {
+			fprintf(f,"  %04X:%08X %8d  %6.2f\n",(Bit32u)(guest[i].first>>32),(Bit32u)guest[i].first,
+				(int)guest[i].second,guest[i].second*100.0/prof.samples);
+		}
+		fclose(f);
+	}
+	f=OpenCaptureFile("Profile stacks",".folded");
+	if (f) {
+		for (std::map<std::string,Bitu>::const_iterator it=prof.folded.begin();it!=prof.folded.end();++it)
+			fprintf(f,"%s %d\n",it->first.c_str(),(int)it->second);
+		fclose(f);
+	}
+	LOG_MSG("PROFILER:%d samples, cpu %.1f%% paging %.1f%% io %.1f%% pic %.1f%% mixer %.1f%% vga %.1f%% scaler %.1f%%",
+		(int)prof.samples,prof.total[PROF_CPU]*100.0/prof.samples,prof.total[PROF_PAGING]*100.0/prof.samples,
+		prof.total[PROF_IO]*100.0/prof.samples,prof.total[PROF_PIC]*100.0/prof.samples,
+		prof.total[PROF_MIXER]*100.0/prof.samples,prof.total[PROF_VGA]*100.0/prof.samples,
+		prof.total[PROF_SCALER]*100.0/prof.samples);
+}
+
+void PROF_Start(void) {
+	if (PROF_Active) return;
+	prof.samples=0;
+	memset(prof.self,0,sizeof(prof.self));
+	memset(prof.total,0,sizeof(prof.total));
+	prof.guest.clear();
+	prof.folded.clear();
+	prof.start=SDL_GetTicks();
+	prof.quit=false;
+	PROF_Active=true;
+	prof.thread=SDL_CreateThread(&PROF_Thread,0);
+	if (!prof.thread) {
+		PROF_Active=false;
+		LOG_MSG("PROFILER:Can't create sampling thread");
+		return;
+	}
+	LOG_MSG("PROFILER:Started");
+}
+
+void PROF_Stop(void) {
+	if (!PROF_Active) return;
+	PROF_Active=false;
+	prof.quit=true;
+	SDL_WaitThread(prof.thread,NULL);
+	prof.thread=0;
+	PROF_Report();
+}
+
+static void PROF_Toggle(bool pressed) {
+	if (!pressed) return;
+	if (PROF_Active) PROF_Stop();
+	else PROF_Start();
+}
+
+static void PROF_Destroy(Section * /*sec*/) {
+	PROF_Stop();
+}
+
+void PROF_Init(Section * sec) {
+	Section_prop * section=static_cast<Section_prop *>(sec);
+	sec->AddDestroyFunction(&PROF_Destroy);
+	MAPPER_AddHandler(PROF_Toggle,MK_f9,MMOD1|MMOD2,"profiler","Profiler");
+	if (section->Get_bool("profiler")) PROF_Start();
+}
@@ -43,7 +43,7 @@ static Bit8u exe_block[]={
 	0xcd,0x21,						//INT 0x21
 //pos 12 is callback number
 	0xFE,0x38,0x00,0x00,			//CALLBack number
-	0xb8,0x00,0x4c,					//Mov ax,4c00
+	0xb4,0x4c,						//Mov ah,4c al is the exitcode
 	0xcd,0x21,						//INT 0x21
 };
 
@@ -82,6 +82,7 @@ static Bitu PROGRAMS_Handler(void) {
 	PROGRAMS_Main * handler = internal_progs[index];
 	(*handler)(&new_program);
 	new_program->Run();
+	reg_al=new_program->exitcode;
 	delete new_program;
 	return CBRET_NONE;
 }
@@ -91,6 +92,7 @@ static Bitu PROGRAMS_Handler(void) {
 
 
 Program::Program() {
+	exitcode=0;
 	/* Find the command line and setup the PSP */
 	psp = new DOS_PSP(dos.psp());
 	/* Scan environment for filename */
@@ -0,0 +1,453 @@
+/*
+ *  Copyright (C) 2002-2010  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "dosbox.h"
+#include "savestate.h"
+#include "mem.h"
+#include "cpu.h"
+#include "pic.h"
+#include "vga.h"
+#include "setup.h"
+#include "control.h"
+#include "mapper.h"
+#include "support.h"
+#include "cross.h"
+#include "SDL.h"
+#include "SDL_thread.h"
+
+#define SAVESTATE_MAGIC		0x53534244		/* "DBSS" */
+#define SAVESTATE_VERSION	3
+#define SAVESTATE_NAMELEN	16
+
+#define SAVESTATE_FULL		0x1
+/* a save past this many records starts the file over with a full one */
+#define SAVESTATE_MAXRECORDS	16
+
+struct SaveStateEntry {
+	char name[SAVESTATE_NAMELEN];
+	SaveStateHandler save;
+	SaveStateHandler load;
+	bool chained;
+};
+
+struct SaveStateHeader {
+	Bit32u magic;
+	Bit32u version;
+	Bit32u flags;
+	Bit32u chunks;
+	Bit32u mempages;
+	/* nesting of DOSBOX_RunMachine, the host stack can't be restored */
+	Bit32u rundepth;
+	/* distances of a few functions, they change whenever the binary changes */
+	Bit32s anchors[3];
+};
+
+static std::vector<SaveStateEntry> handlers;
+
+static struct {
+	FILE * file;
+	bool incremental;
+	bool failed;
+	/* the last file that was saved or loaded completely, deltas get appended to it */
+	std::string chain;
+	Bitu records;
+	/* requests come from the ui thread, lock guards them */
+	SDL_mutex * lock;
+	struct {
+		char file[CROSS_LEN];
+		bool save;
+	} request;
+	std::string hotkeyfile;
+} state;
+
+volatile bool SAVESTATE_Pending=false;
+
+static Bits CodeOffset(const void * code) {
+	return (Bits)((Bitu)code-(Bitu)&SAVESTATE_Save);
+}
+
+static void MakeHeader(SaveStateHeader & header,Bit32u flags,Bit32u chunks) {
+	header.magic=SAVESTATE_MAGIC;
+	header.version=SAVESTATE_VERSION;
+	header.flags=flags;
+	header.chunks=chunks;
+	header.mempages=(Bit32u)MEM_TotalPages();
+	header.rundepth=(Bit32u)DOSBOX_RunDepth();
+	header.anchors[0]=(Bit32s)CodeOffset((const void *)&CPU_Core_Normal_Run);
+	header.anchors[1]=(Bit32s)CodeOffset((const void *)&PIC_RunQueue);
+	header.anchors[2]=(Bit32s)CodeOffset((const void *)&VGA_SetupHandlers);
+}
+
+void SAVESTATE_AddHandler(const char * name,SaveStateHandler save,SaveStateHandler load,bool chained) {
+	SaveStateEntry entry;
+	safe_strncpy(entry.name,name,SAVESTATE_NAMELEN);
+	entry.save=save;
+	entry.load=load;
+	entry.chained=chained;
+	/* Modules that get restarted just replace their old entry */
+	for (std::vector<SaveStateEntry>::iterator it=handlers.begin();it!=handlers.end();it++) {
+		if (!memcmp(it->name,entry.name,SAVESTATE_NAMELEN)) {
+			*it=entry;
+			return;
+		}
+	}
+	handlers.push_back(entry);
+}
+
+void SAVESTATE_RemoveHandler(const char * name) {
+	char find[SAVESTATE_NAMELEN];
+	safe_strncpy(find,name,SAVESTATE_NAMELEN);
+	for (std::vector<SaveStateEntry>::iterator it=handlers.begin();it!=handlers.end();it++) {
+		if (!memcmp(it->name,find,SAVESTATE_NAMELEN)) {
+			handlers.erase(it);
+			return;
+		}
+	}
+}
+
+void SAVESTATE_Write(const void * data,Bitu size) {
+	if (state.failed || !state.file) return;
+	if (fwrite(data,1,size,state.file)!=size) state.failed=true;
+}
+
+void SAVESTATE_Read(void * data,Bitu size) {
+	if (state.failed || !state.file || fread(data,1,size,state.file)!=size) {
+		state.failed=true;
+		memset(data,0,size);
+	}
+}
+
+void SAVESTATE_WriteCode(const void * code) {
+	Bits offset=code ? CodeOffset(code) : 0;
+	SAVESTATE_WriteVar(offset);
+}
+
+void * SAVESTATE_ReadCode(void) {
+	Bits offset;
+	SAVESTATE_ReadVar(offset);
+	if (!offset) return 0;
+	return (void *)((Bitu)&SAVESTATE_Save+offset);
+}
+
+bool SAVESTATE_Incremental(void) {
+	return state.incremental;
+}
+
+static Bit64u HashPage(const Bit8u * data,Bitu size) {
+	/* FNV-1a on 32bit words, good enough to spot changes */
+	Bit64u hash=0xcbf29ce484222325ULL;
+	Bitu i=0;
+	for (;i+4<=size;i+=4) {
+		Bit32u val;
+		memcpy(&val,data+i,4);
+		hash=(hash^val)*0x100000001b3ULL;
+	}
+	for (;i<size;i++) hash=(hash^data[i])*0x100000001b3ULL;
+	return hash;
+}
+
+void SAVESTATE_WritePages(const void * data,Bitu size,Bit64u * hashes) {
+	const Bit8u * base=(const Bit8u *)data;
+	Bitu pages=SAVESTATE_PAGES(size);
+	std::vector<Bit32u> changed;
+	for (Bitu i=0;i<pages;i++) {
+		Bitu len=(i==pages-1) ? size-i*SAVESTATE_PAGESIZE : SAVESTATE_PAGESIZE;
+		Bit64u hash=HashPage(base+i*SAVESTATE_PAGESIZE,len);
+		if (state.incremental && hash==hashes[i]) continue;
+		hashes[i]=hash;
+		changed.push_back((Bit32u)i);
+	}
+	Bit32u count=(Bit32u)changed.size();
+	SAVESTATE_WriteVar(count);
+	for (Bitu i=0;i<changed.size();i++) {
+		Bitu page=changed[i];
+		Bitu len=(page==pages-1) ? size-page*SAVESTATE_PAGESIZE : SAVESTATE_PAGESIZE;
+		SAVESTATE_WriteVar(changed[i]);
+		SAVESTATE_Write(base+page*SAVESTATE_PAGESIZE,len);
+	}
+}
+
+void SAVESTATE_ReadPages(void * data,Bitu size,Bit64u * hashes) {
+	Bit8u * base=(Bit8u *)data;
+	Bitu pages=SAVESTATE_PAGES(size);
+	Bit32u count;
+	SAVESTATE_ReadVar(count);
+	for (;count>0 && !state.failed;count--) {
+		Bit32u page;
+		SAVESTATE_ReadVar(page);
+		if (page>=pages) {
+			state.failed=true;
+			break;
+		}
+		Bitu len=(page==pages-1) ? size-page*SAVESTATE_PAGESIZE : SAVESTATE_PAGESIZE;
+		SAVESTATE_Read(base+page*SAVESTATE_PAGESIZE,len);
+		hashes[page]=HashPage(base+page*SAVESTATE_PAGESIZE,len);
+	}
+}
+
+static void WriteRecord(bool incremental) {
+	state.incremental=incremental;
+	SaveStateHeader header;
+	MakeHeader(header,incremental ? 0 : SAVESTATE_FULL,(Bit32u)handlers.size());
+	SAVESTATE_Write(&header,sizeof(header));
+	for (std::vector<SaveStateEntry>::iterator it=handlers.begin();it!=handlers.end();it++) {
+		SAVESTATE_Write(it->name,SAVESTATE_NAMELEN);
+		/* Reserve room for the size and fill it in once the chunk is done */
+		long start=ftell(state.file);
+		Bit32u size=0;
+		SAVESTATE_WriteVar(size);
+		it->save();
+		long end=ftell(state.file);
+		size=(Bit32u)(end-start-sizeof(size));
+		fseek(state.file,start,SEEK_SET);
+		SAVESTATE_WriteVar(size);
+		fseek(state.file,end,SEEK_SET);
+	}
+	state.incremental=false;
+}
+
+bool SAVESTATE_Save(const char * filename,bool incremental) {
+	/* Only append to a chain that is still in sync with the dirty page tracking,
+	   and start it over once it gets long */
+	incremental=incremental && !state.chain.empty() && state.chain==filename && state.records<SAVESTATE_MAXRECORDS;
+	/* Not "ab", appending would also move the chunk sizes that get filled in afterwards */
+	state.file=fopen(filename,incremental ? "r+b" : "wb");
+	if (state.file && incremental) fseek(state.file,0,SEEK_END);
+	if (!state.file) {
+		LOG_MSG("SAVESTATE:Can't open %s for writing",filename);
+		state.chain.clear();
+		return false;
+	}
+	state.failed=false;
+	WriteRecord(incremental);
+	if (fclose(state.file)) state.failed=true;
+	state.file=0;
+	if (state.failed) {
+		LOG_MSG("SAVESTATE:Writing %s failed",filename);
+		state.chain.clear();
+		return false;
+	}
+	state.chain=filename;
+	state.records=incremental ? state.records+1 : 1;
+	return true;
+}
+
+static bool CheckHeader(SaveStateHeader & header,bool first) {
+	SaveStateHeader current;
+	MakeHeader(current,header.flags,header.chunks);
+	if (header.magic!=SAVESTATE_MAGIC || header.version!=SAVESTATE_VERSION) return false;
+	if (first!=((header.flags & SAVESTATE_FULL)>0)) return false;
+	if (header.mempages!=current.mempages) {
+		LOG_MSG("SAVESTATE:State was saved with a different memsize");
+		return false;
+	}
+	if (header.rundepth!=current.rundepth) {
+		LOG_MSG("SAVESTATE:State was saved while the emulator was in a different call depth");
+		return false;
+	}
+	if (memcmp(header.anchors,current.anchors,sizeof(current.anchors))) {
+		LOG_MSG("SAVESTATE:State was saved by a different build");
+		return false;
+	}
+	return true;
+}
+
+static bool KnownChunk(const char * name) {
+	for (std::vector<SaveStateEntry>::iterator it=handlers.begin();it!=handlers.end();it++) {
+		if (!memcmp(it->name,name,SAVESTATE_NAMELEN)) return true;
+	}
+	return false;
+}
+
+/* Walk the records in state.file and check they fit the file and this session */
+static bool ScanRecords(std::vector<long> & records) {
+	fseek(state.file,0,SEEK_END);
+	long length=ftell(state.file);
+	fseek(state.file,0,SEEK_SET);
+	SaveStateHeader header;
+	for (;;) {
+		long pos=ftell(state.file);
+		if (pos==length) break;
+		if (fread(&header,1,sizeof(header),state.file)!=sizeof(header)) return false;
+		if (!CheckHeader(header,records.empty())) return false;
+		/* Every record holds the complete device state */
+		if (header.chunks!=handlers.size()) return false;
+		records.push_back(pos);
+		for (Bit32u i=0;i<header.chunks;i++) {
+			char name[SAVESTATE_NAMELEN];Bit32u size;
+			SAVESTATE_Read(name,SAVESTATE_NAMELEN);
+			SAVESTATE_ReadVar(size);
+			if (state.failed || !KnownChunk(name)) return false;
+			if (size>(Bit32u)(length-ftell(state.file))) return false;
+			fseek(state.file,size,SEEK_CUR);
+		}
+	}
+	return !records.empty();
+}
+
+static void ReadRecords(const std::vector<long> & records) {
+	SaveStateHeader header;
+	for (Bitu r=0;r<records.size() && !state.failed;r++) {
+		bool last=(r==records.size()-1);
+		fseek(state.file,records[r],SEEK_SET);
+		SAVESTATE_ReadVar(header);
+		state.incremental=(header.flags & SAVESTATE_FULL)==0;
+		for (Bit32u i=0;i<header.chunks;i++) {
+			char name[SAVESTATE_NAMELEN];Bit32u size;
+			SAVESTATE_Read(name,SAVESTATE_NAMELEN);
+			SAVESTATE_ReadVar(size);
+			long end=ftell(state.file)+size;
+			for (std::vector<SaveStateEntry>::iterator it=handlers.begin();it!=handlers.end();it++) {
+				if (memcmp(it->name,name,SAVESTATE_NAMELEN)) continue;
+				if (last || it->chained) it->load();
+				break;
+			}
+			if (ftell(state.file)>end) state.failed=true;
+			fseek(state.file,end,SEEK_SET);
+		}
+	}
+	state.incremental=false;
+}
+
+bool SAVESTATE_Load(const char * filename) {
+	FILE * file=fopen(filename,"rb");
+	if (!file) {
+		LOG_MSG("SAVESTATE:Can't open %s",filename);
+		return false;
+	}
+	state.file=file;
+	state.failed=false;
+	state.incremental=false;
+
+	/* Validate the whole chain before anything in the machine gets touched */
+	std::vector<long> records;
+	if (!ScanRecords(records)) {
+		LOG_MSG("SAVESTATE:%s is not a valid state file",filename);
+		fclose(file);
+		state.file=0;
+		return false;
+	}
+
+	/* A chunk can still turn out to be damaged while it gets applied,
+	   keep the running machine so it can be put back */
+	FILE * backup=tmpfile();
+	if (!backup) {
+		LOG_MSG("SAVESTATE:Can't create a temporary file to restore %s",filename);
+		fclose(file);
+		state.file=0;
+		return false;
+	}
+	state.file=backup;
+	WriteRecord(false);
+	if (state.failed) {
+		LOG_MSG("SAVESTATE:Can't keep the running machine to restore %s",filename);
+		state.chain.clear();
+		fclose(backup);
+		fclose(file);
+		state.file=0;
+		return false;
+	}
+
+	state.file=file;
+	ReadRecords(records);
+	fclose(file);
+	bool loaded=!state.failed;
+	if (!loaded) {
+		LOG_MSG("SAVESTATE:Restoring %s failed, going back to the running machine",filename);
+		std::vector<long> full(1,0);
+		state.file=backup;
+		state.failed=false;
+		ReadRecords(full);
+		/* The page hashes now describe the running machine, not the chain */
+		state.chain.clear();
+	}
+	fclose(backup);
+	state.file=0;
+	if (state.failed) E_Exit("SAVESTATE:Can't go back to the running machine");
+	if (!loaded) return false;
+	state.chain=filename;
+	state.records=records.size();
+	return true;
+}
+
+static void Request(const char * filename,bool save) {
+	/* A request before SAVESTATE_Init comes from the thread that is about to
+	   start the emulation, it's kept for the first service in the loop */
+	if (state.lock) SDL_mutexP(state.lock);
+	safe_strncpy(state.request.file,filename,CROSS_LEN);
+	state.request.save=save;
+	SAVESTATE_Pending=true;
+	if (state.lock) SDL_mutexV(state.lock);
+}
+
+void SAVESTATE_RequestSave(const char * filename) {
+	Request(filename,true);
+}
+
+void SAVESTATE_RequestLoad(const char * filename) {
+	Request(filename,false);
+}
+
+void SAVESTATE_Service(void) {
+	/* The unlocked read only decides whether to look, the lock orders the request */
+	if (!SAVESTATE_Pending || !state.lock) return;
+	char file[CROSS_LEN];
+	SDL_mutexP(state.lock);
+	bool save=state.request.save;
+	safe_strncpy(file,state.request.file,CROSS_LEN);
+	SAVESTATE_Pending=false;
+	SDL_mutexV(state.lock);
+	if (save) {
+		if (SAVESTATE_Save(file,true)) LOG_MSG("Saved state to %s",file);
+	} else {
+		if (SAVESTATE_Load(file)) LOG_MSG("Restored state from %s",file);
+	}
+}
+
+void SAVESTATE_Clone(Bitu index) {
+	char suffix[16];
+	sprintf(suffix,".%d",(int)index);
+	state.hotkeyfile+=suffix;
+	state.chain.clear();
+}
+
+static void SAVESTATE_SaveEvent(bool pressed) {
+	if (!pressed) return;
+	SAVESTATE_RequestSave(state.hotkeyfile.c_str());
+}
+
+static void SAVESTATE_LoadEvent(bool pressed) {
+	if (!pressed) return;
+	SAVESTATE_RequestLoad(state.hotkeyfile.c_str());
+}
+
+void SAVESTATE_Init(Section * sec) {
+	Section_prop * section=static_cast<Section_prop *>(sec);
+	Prop_path * pathprop=section->Get_path("savestate");
+	state.hotkeyfile=pathprop->realpath;
+	state.chain.clear();
+	if (!state.lock) state.lock=SDL_CreateMutex();
+	MAPPER_AddHandler(SAVESTATE_SaveEvent,MK_f2,MMOD1|MMOD2,"savestate","Save State");
+	MAPPER_AddHandler(SAVESTATE_LoadEvent,MK_f3,MMOD1|MMOD2,"loadstate","Load State");
+}
@@ -0,0 +1,238 @@
+#!/usr/bin/env python
+#
+# Writes the dro captures used by "make check-opl". They're short songs with
+# ordinary instrument patches, percussion, dual opl2 and opl3 4 op voices, so
+# the checksums cover what games really play. The captures are checked in,
+# this only has to be run again to add new ones.
+
+import struct
+
+RATE = 49716.0
+
+# Patches as mod20 car20 mod40 car40 mod60 car60 mod80 car80 modE0 carE0 c0
+PIANO   = ( 0x01, 0x01, 0x4f, 0x00, 0xf1, 0xd2, 0x53, 0x74, 0x00, 0x00, 0x06 )
+EPIANO  = ( 0x01, 0x01, 0x4b, 0x00, 0xf2, 0xf2, 0x14, 0xf4, 0x00, 0x00, 0x08 )
+ORGAN   = ( 0xe1, 0x61, 0x00, 0x00, 0xf0, 0xf0, 0x00, 0x00, 0x00, 0x00, 0x01 )
+BRASS   = ( 0x21, 0x21, 0x1d, 0x00, 0x75, 0x86, 0x14, 0x14, 0x00, 0x00, 0x0e )
+STRINGS = ( 0x61, 0x21, 0x1e, 0x05, 0x42, 0x51, 0x05, 0x05, 0x00, 0x00, 0x0a )
+BASS    = ( 0x00, 0x00, 0x0b, 0x00, 0xa8, 0xd6, 0x4c, 0x4f, 0x00, 0x00, 0x00 )
+FLUTE   = ( 0xe1, 0xe1, 0x27, 0x00, 0x62, 0x63, 0x37, 0x37, 0x00, 0x00, 0x0e )
+BELL    = ( 0x07, 0x12, 0x4f, 0x00, 0xf2, 0xf2, 0x60, 0x72, 0x01, 0x02, 0x08 )
+GUITAR  = ( 0x03, 0x01, 0x49, 0x80, 0xf4, 0xf3, 0x53, 0x74, 0x02, 0x00, 0x0c )
+# percussion, the two operators are used by different drums on channels 7 and 8
+KICK    = ( 0x00, 0x00, 0x0b, 0x00, 0xa8, 0xd6, 0x4c, 0x4f, 0x00, 0x00, 0x00 )
+SNAREHH = ( 0x0c, 0x12, 0x00, 0x00, 0xf8, 0xf6, 0xb5, 0xb5, 0x00, 0x00, 0x00 )
+TOMCYM  = ( 0x04, 0x01, 0x00, 0x00, 0xf7, 0xf5, 0xb5, 0xb5, 0x00, 0x03, 0x00 )
+
+def table():
+	t = [ 0x01, 0x04, 0x05, 0x08, 0xbd ]
+	for i in range( 24 ):
+		if ( i & 7 ) < 6:
+			t += [ 0x20 + i, 0x40 + i, 0x60 + i, 0x80 + i, 0xe0 + i ]
+	for i in range( 9 ):
+		t += [ 0xa0 + i, 0xb0 + i, 0xc0 + i ]
+	return t
+
+class Song:
+	def __init__( self, hardware ):
+		self.hardware = hardware
+		self.table = table()
+		self.raw = dict( ( reg, i ) for i, reg in enumerate( self.table ) )
+		self.delay256 = len( self.table )
+		self.delayShift8 = len( self.table ) + 1
+		self.cmds = []
+		self.ms = 0
+		self.keys = {}
+
+	def write( self, reg, val ):
+		raw = self.raw[ reg & 0xff ] | ( 0x80 if reg & 0x100 else 0 )
+		self.cmds.append( ( raw, val & 0xff ) )
+
+	def wait( self, ms ):
+		self.ms += ms
+		while ms > 0:
+			if ms > 256:
+				step = min( ms & ~255, 256 * 256 )
+				self.cmds.append( ( self.delayShift8, ( step >> 8 ) - 1 ) )
+			else:
+				step = ms
+				self.cmds.append( ( self.delay256, step - 1 ) )
+			ms -= step
+
+	def patch( self, chan, p, pan = 0x30 ):
+		bank = ( chan // 9 ) << 8
+		c = chan % 9
+		slot = ( c // 3 ) * 8 + c % 3
+		for o, off in ( ( 0, 0 ), ( 1, 3 ) ):
+			self.write( bank + 0x20 + slot + off, p[ 0 + o ] )
+			self.write( bank + 0x40 + slot + off, p[ 2 + o ] )
+			self.write( bank + 0x60 + slot + off, p[ 4 + o ] )
+			self.write( bank + 0x80 + slot + off, p[ 6 + o ] )
+			self.write( bank + 0xe0 + slot + off, p[ 8 + o ] )
+		self.write( bank + 0xc0 + c, p[ 10 ] | ( pan if self.hardware == 2 else 0 ) )
+
+	def level( self, chan, val ):
+		bank = ( chan // 9 ) << 8
+		c = chan % 9
+		self.write( bank + 0x43 + ( c // 3 ) * 8 + c % 3, val )
+
+	def freq( self, note ):
+		hz = 440.0 * 2 ** ( ( note - 69 ) / 12.0 )
+		block = 0
+		while block < 7 and hz * ( 1 << ( 20 - block ) ) / RATE >= 1024:
+			block += 1
+		return int( hz * ( 1 << ( 20 - block ) ) / RATE + 0.5 ), block
+
+	def note( self, chan, note, on = True, bend = 0 ):
+		bank = ( chan // 9 ) << 8
+		c = chan % 9
+		fnum, block = self.freq( note )
+		fnum = min( 1023, max( 0, fnum + bend ) )
+		self.write( bank + 0xa0 + c, fnum )
+		self.write( bank + 0xb0 + c, ( fnum >> 8 ) | ( block << 2 ) | ( 0x20 if on else 0 ) )
+		self.keys[ chan ] = ( note, bend )
+
+	def off( self, chan ):
+		if chan in self.keys:
+			note, bend = self.keys.pop( chan )
+			self.note( chan, note, False, bend )
+
+	def save( self, name ):
+		header = b"DBRAWOPL" + struct.pack( "<HHIIBBBBBB", 2, 0, len( self.cmds ), self.ms,
+			self.hardware, 0, 0, self.delay256, self.delayShift8, len( self.table ) )
+		data = b"".join( struct.pack( "BB", raw, val ) for raw, val in self.cmds )
+		open( name, "wb" ).write( header + bytearray( self.table ) + data )
+
+CHORDS = [ ( 48, 52, 55, 60 ), ( 45, 48, 52, 57 ), ( 41, 45, 48, 53 ), ( 43, 47, 50, 55 ) ]
+MELODY = [ 72, 74, 76, 79, 77, 76, 74, 72, 69, 71, 72, 74, 76, 74, 71, 67 ]
+
+def opl2_instruments():
+	s = Song( 0 )
+	s.write( 0x01, 0x20 )
+	s.write( 0xbd, 0xc0 )
+	voices = [ PIANO, EPIANO, ORGAN, BRASS, STRINGS, BASS, FLUTE, BELL, GUITAR ]
+	for c, p in enumerate( voices ):
+		s.patch( c, p )
+	for bar in range( 8 ):
+		chord = CHORDS[ bar % 4 ]
+		s.note( 5, chord[ 0 ] - 12 )
+		s.note( 4, chord[ 1 ] )
+		s.note( 2, chord[ 2 ] )
+		s.note( 1, chord[ 3 ] )
+		for beat in range( 4 ):
+			m = MELODY[ ( bar * 4 + beat ) % len( MELODY ) ]
+			lead = ( 0, 3, 6, 7, 8 )[ bar % 5 ]
+			s.note( lead, m )
+			# a slow bend on the flute and a fading brass
+			for step in range( 5 ):
+				if lead == 6:
+					s.note( 6, m, True, step * 2 )
+				if lead == 3:
+					s.level( 3, step * 3 )
+				s.wait( 40 )
+			s.off( lead )
+			s.wait( 50 )
+		s.off( 5 ); s.off( 4 ); s.off( 2 ); s.off( 1 )
+		s.wait( 30 )
+	s.write( 0xbd, 0x00 )
+	s.wait( 1500 )
+	return s
+
+def drums( s, bank = 0 ):
+	s.patch( bank * 9 + 6, KICK )
+	s.patch( bank * 9 + 7, SNAREHH )
+	s.patch( bank * 9 + 8, TOMCYM )
+	s.write( ( bank << 8 ) + 0xa6, 0x57 ); s.write( ( bank << 8 ) + 0xb6, 0x09 )
+	s.write( ( bank << 8 ) + 0xa7, 0x03 ); s.write( ( bank << 8 ) + 0xb7, 0x0a )
+	s.write( ( bank << 8 ) + 0xa8, 0x03 ); s.write( ( bank << 8 ) + 0xb8, 0x0a )
+
+def opl2_drums():
+	s = Song( 0 )
+	s.write( 0x01, 0x20 )
+	s.patch( 0, BASS )
+	s.patch( 1, PIANO )
+	s.patch( 2, PIANO )
+	s.patch( 3, STRINGS )
+	drums( s )
+	#         bd    sd    tt    cy    hh
+	pattern = [ 0x10, 0x01, 0x08, 0x01, 0x10 | 0x01, 0x01, 0x08 | 0x04, 0x02 | 0x01 ]
+	for bar in range( 8 ):
+		chord = CHORDS[ bar % 4 ]
+		s.note( 1, chord[ 1 ] ); s.note( 2, chord[ 2 ] ); s.note( 3, chord[ 3 ] + 12 )
+		for step, hits in enumerate( pattern ):
+			if step % 2 == 0:
+				s.note( 0, chord[ 0 ] - 12 + ( 7 if step == 4 else 0 ) )
+			s.write( 0xbd, 0x20 )
+			s.write( 0xbd, 0x20 | hits | ( 0xc0 if bar & 1 else 0 ) )
+			s.wait( 110 )
+			if step % 2 == 1:
+				s.off( 0 )
+		s.off( 1 ); s.off( 2 ); s.off( 3 )
+	s.write( 0xbd, 0x20 )
+	s.wait( 1000 )
+	return s
+
+def dual_opl2():
+	s = Song( 1 )
+	s.write( 0x01, 0x20 ); s.write( 0x101, 0x20 )
+	for c, p in enumerate( [ PIANO, BRASS, BASS, STRINGS ] ):
+		s.patch( c, p )
+		s.patch( 9 + c, [ FLUTE, BELL, ORGAN, GUITAR ][ c ] )
+	for bar in range( 8 ):
+		chord = CHORDS[ bar % 4 ]
+		s.note( 2, chord[ 0 ] - 12 )
+		s.note( 3, chord[ 2 ] )
+		s.note( 11, chord[ 1 ] )
+		for beat in range( 4 ):
+			m = MELODY[ ( bar * 4 + beat ) % len( MELODY ) ]
+			s.note( bar & 1, m )
+			s.note( 9 + ( bar & 1 ), m - 5 )
+			s.wait( 180 )
+			s.off( bar & 1 ); s.off( 9 + ( bar & 1 ) )
+			s.wait( 40 )
+		s.off( 2 ); s.off( 3 ); s.off( 11 )
+	s.wait( 1000 )
+	return s
+
+def opl3_4op():
+	s = Song( 2 )
+	s.write( 0x105, 0x01 )
+	s.write( 0x104, 0x3f )
+	# the 4 op pairs are channels 0+3, 1+4, 2+5 on both banks, one pair for every connection
+	modes = [ ( 0, 0 ), ( 1, 0 ), ( 0, 1 ), ( 1, 1 ), ( 0, 0 ), ( 1, 1 ) ]
+	pairs = [ 0, 1, 2, 9, 10, 11 ]
+	voices = [ ( BRASS, STRINGS ), ( PIANO, BELL ), ( ORGAN, FLUTE ), ( EPIANO, GUITAR ), ( BASS, BASS ), ( STRINGS, ORGAN ) ]
+	pans = [ 0x10, 0x20, 0x30, 0x10, 0x30, 0x20 ]
+	for i, first in enumerate( pairs ):
+		a, b = voices[ i ]
+		s.patch( first, a[ :10 ] + ( ( a[ 10 ] & 0x0e ) | modes[ i ][ 0 ], ), pans[ i ] )
+		s.patch( first + 3, b[ :10 ] + ( ( b[ 10 ] & 0x0e ) | modes[ i ][ 1 ], ), pans[ i ] )
+	# the upper waveforms only exist on the opl3
+	for slot, wave in ( ( 0x00, 4 ), ( 0x03, 5 ), ( 0x09, 6 ), ( 0x0c, 7 ) ):
+		s.write( 0x1e0 + slot, wave )
+	s.patch( 15, PIANO, 0x10 )
+	s.patch( 16, GUITAR, 0x20 )
+	s.patch( 17, BASS )
+	drums( s )
+	for bar in range( 8 ):
+		chord = CHORDS[ bar % 4 ]
+		s.note( 17, chord[ 0 ] - 12 )
+		s.note( 15, chord[ 1 ] ); s.note( 16, chord[ 2 ] )
+		for beat in range( 4 ):
+			m = MELODY[ ( bar * 4 + beat ) % len( MELODY ) ]
+			lead = pairs[ ( bar + beat ) % 6 ]
+			s.note( lead, m - 12 * ( beat & 1 ) )
+			s.write( 0xbd, 0x20 | ( 0x10 if beat % 2 == 0 else 0x08 ) )
+			s.wait( 150 )
+			s.write( 0xbd, 0x20 )
+			s.off( lead )
+			s.wait( 60 )
+		s.off( 17 ); s.off( 15 ); s.off( 16 )
+	s.write( 0xbd, 0x00 )
+	s.wait( 1000 )
+	return s
+
+opl2_instruments().save( "opl2_instruments.dro" )
+opl2_drums().save( "opl2_drums.dro" )
+dual_opl2().save( "dual_opl2.dro" )
+opl3_4op().save( "opl3_4op.dro" )
@@ -102,6 +102,8 @@
 - (void)applicationDidEnterBackground:(UIApplication *)application
 {
     dospad_save_history();
+    // The emulator is paused at this point, the save happens in its pause loop
+    dospad_save_state([dospad_state_path() UTF8String]);
 }
 
 // iOS 3.x
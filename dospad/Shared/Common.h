@@ -90,6 +90,10 @@
 
 void dospad_pause();
 void dospad_resume();
+void dospad_save_state(const char *path);
+void dospad_load_state(const char *path);
+void dospad_service_state();
+NSString *dospad_state_path();
 extern int SDL_SendKeyboardKey(int index, Uint8 state, SDL_scancode scancode);
 extern int dospad_should_launch_game;
 extern int dospad_command_line_ready;
@@ -18,6 +18,7 @@
 
 
 #import "DosEmuThread.h"
+#import "Common.h"
 
 extern int SDL_main(int argc, char *argv[]);
 
@@ -40,6 +41,10 @@ extern int SDL_main(int argc, char *argv[]);
         
         dispatch_async(dispatch_get_main_queue(), ^{
             char *argv[1] = {"dosbox"};
+            // Resume where the last session was suspended
+            NSString *state = dospad_state_path();
+            if ([[NSFileManager defaultManager] fileExistsAtPath:state])
+                dospad_load_state([state UTF8String]);
             SDL_main(1, argv);
             self.started = NO;
         });
@@ -142,11 +142,20 @@ void dospad_init_history()
     fclose(fp);
 }
 
+NSString *dospad_state_path()
+{
+    NSString *docs = [NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+    return [docs stringByAppendingPathComponent:@"dospad.sav"];
+}
+
 void dospad_should_pause()
 {
+    // State requests posted while suspended still have to be handled
+    dospad_service_state();
     while (dospad_pause_flag)
     {
         [NSThread sleepForTimeInterval:0.5];
+        dospad_service_state();
     }
 }
 